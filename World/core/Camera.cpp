@@ -140,7 +140,8 @@ namespace Pix {
 		
 		mCurrentViewMatrix = glm::lookAt(mPosition, mPosition + mFrontVector, mUpVector);
 		mCurrentInvViewMatrix = glm::inverse(mCurrentViewMatrix);
-		mFrustum = new Frustum(mProjectionMatrix * mCurrentViewMatrix);
+		if (mFrustum == nullptr) mFrustum = new Frustum(mProjectionMatrix * mCurrentViewMatrix);
+		else *mFrustum = Frustum(mProjectionMatrix * mCurrentViewMatrix);
 	}
 
 	/**
@@ -52,11 +52,8 @@ namespace Pix {
 			fLastMouseX = mx;
 
 			currentRay = calculateMouseRay(Mouse::xNdc(), Mouse::yNdc());
-			if (intersectionInRange(0, RAY_RANGE, currentRay)) {
-				terrainPointValid = binarySearch(currentTerrainPoint, 0, 0, RAY_RANGE, currentRay);
-			} else {
-				terrainPointValid = false;
-			}
+			terrainPointValid = pWorld->raycastTerrain(pWorld->camera()->getPosition(), currentRay, RAY_RANGE,
+													   currentTerrainPoint);
 		}
 	}
 
@@ -79,40 +76,6 @@ namespace Pix {
 		return {eyeCoords.x, eyeCoords.y, 1.0F, 0.0F};
 //		return {eyeCoords.x, eyeCoords.y, -1.0F, 0.0F};
 	}
-
-	//**********************************************************
-
-	glm::vec3 CameraPicker::getPointOnRay(glm::vec3& ray, float distance) {
-		glm::vec3 camPos = pWorld->camera()->getPosition();
-		return { camPos.x + ray.x * distance, camPos.y + ray.y * distance, camPos.z + ray.z * distance };
-	}
-
-	bool CameraPicker::binarySearch(glm::vec3& result, int count, float start, float finish, glm::vec3 ray) {
-
-		float half = start + ((finish - start) / 2.0F);
-		if (count >= RECURSION_COUNT) {
-			result = getPointOnRay(ray, half);
-			return pWorld->hasTerrain(result);
-		}
-	
-		if (intersectionInRange(start, half, ray)) {
-			return binarySearch(result, count + 1, start, half, ray);
-		} else {
-			return binarySearch(result, count + 1, half, finish, ray);
-		}
-	}
-
-	bool CameraPicker::intersectionInRange(float start, float finish, glm::vec3& ray) {
-		glm::vec3 startPoint = getPointOnRay(ray, start);
-		glm::vec3 endPoint = getPointOnRay(ray, finish);
-		return (!isUnderGround(startPoint) && isUnderGround(endPoint));
-	}
-
-	bool CameraPicker::isUnderGround(glm::vec3& testPoint) {
-		float height = 0;
-		height = pWorld->getHeight(testPoint);
-		return testPoint.y < height;
-	}
 };
 
 
@@ -0,0 +1,114 @@
+//
+//  DecalLayer.cpp
+//  PixFu Engine
+//
+//  Fading decals of a terrain canvas, in tiles allocated on first write.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "DecalLayer.hpp"
+#include "PixelBlend.hpp"
+
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	DecalLayer::DecalLayer(int width, int height)
+			: WIDTH(width), HEIGHT(height),
+			  COLS((width + TILE - 1) / TILE),
+			  ROWS((height + TILE - 1) / TILE) {
+		vTiles.resize(COLS * ROWS, nullptr);
+	}
+
+	DecalLayer::~DecalLayer() {
+		for (Pixel *tile : vTiles) delete[] tile;
+	}
+
+	Pixel *DecalLayer::tile(int col, int row) {
+
+		Pixel *&tile = vTiles[row * COLS + col];
+
+		if (tile == nullptr) {
+			tile = new Pixel[TILE * TILE];
+			std::fill(tile, tile + TILE * TILE, Colors::BLANK);
+			nTiles++;
+		}
+
+		return tile;
+	}
+
+	void DecalLayer::blendSpan(int x0, int x1, int y, Pixel color) {
+
+		if (y < 0 || y >= HEIGHT || color.a == 0) return;
+
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, WIDTH - 1);
+
+		while (x0 <= x1) {
+			const int col = x0 / TILE, end = std::min(x1, col * TILE + TILE - 1);
+			Pixel *row = tile(col, y / TILE) + (y % TILE) * TILE;
+			Pix::blendSpan(row + x0 % TILE, end - x0 + 1, color);
+			x0 = end + 1;
+		}
+	}
+
+	void DecalLayer::clearSpan(int x0, int x1, int y) {
+
+		if (y < 0 || y >= HEIGHT) return;
+
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, WIDTH - 1);
+
+		// never allocates: a missing tile is blank already
+		while (x0 <= x1) {
+			const int col = x0 / TILE, end = std::min(x1, col * TILE + TILE - 1);
+			Pixel *tile = vTiles[(y / TILE) * COLS + col];
+			if (tile != nullptr) {
+				Pixel *row = tile + (y % TILE) * TILE;
+				std::fill(row + x0 % TILE, row + end % TILE + 1, Colors::BLANK);
+			}
+			x0 = end + 1;
+		}
+	}
+
+	bool DecalLayer::covers(int x0, int y0, int x1, int y1) const {
+
+		if (nTiles == 0) return false;
+
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, WIDTH);
+		y1 = std::min(y1, HEIGHT);
+
+		for (int row = y0 / TILE; row * TILE < y1; row++)
+			for (int col = x0 / TILE; col * TILE < x1; col++)
+				if (vTiles[row * COLS + col] != nullptr) return true;
+
+		return false;
+	}
+
+	void DecalLayer::compose(int x0, int y0, int x1, int y1, Pixel *dst, int stride) const {
+
+		const int left = std::max(x0, 0), right = std::min(x1, WIDTH);
+
+		for (int y = std::max(y0, 0), l = std::min(y1, HEIGHT); y < l; y++) {
+
+			Pixel *out = dst + (y - y0) * stride;
+
+			for (int x = left; x < right;) {
+				const int col = x / TILE, end = std::min(right, col * TILE + TILE);
+				const Pixel *tile = vTiles[(y / TILE) * COLS + col];
+				if (tile != nullptr)
+					composeSpan(out + (x - x0), tile + (y % TILE) * TILE + x % TILE, end - x);
+				x = end;
+			}
+		}
+	}
+
+}
+
+#pragma clang diagnostic pop
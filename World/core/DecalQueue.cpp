@@ -0,0 +1,317 @@
+//
+//  DecalQueue.cpp
+//  PixFu Engine
+//
+//  Marks left on the terrain canvas, drawn in one pass per frame.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "DecalQueue.hpp"
+#include "Terrain.hpp"
+#include "DecalLayer.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "OCDFAInspection"
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string DecalQueue::TAG = "DecalQueue";
+
+	/** x interval of the row y inside a circle */
+	static bool circleRow(const glm::vec2 &c, float r, float y, float &x0, float &x1) {
+		const float dy = y - c.y;
+		if (dy * dy > r * r) return false;
+		const float h = sqrtf(r * r - dy * dy);
+		x0 = c.x - h;
+		x1 = c.x + h;
+		return true;
+	}
+
+	/** Narrows [x0, x1] to where lo <= c + k * x <= hi */
+	static bool clampLinear(float c, float k, float lo, float hi, float &x0, float &x1) {
+		if (fabsf(k) < 1e-6F) return c >= lo && c <= hi;
+		float a = (lo - c) / k, b = (hi - c) / k;
+		if (a > b) std::swap(a, b);
+		x0 = std::max(x0, a);
+		x1 = std::min(x1, b);
+		return x0 <= x1;
+	}
+
+	void DecalQueue::stamp(const glm::vec3 &posWorld, float radius, Pixel color, float life) {
+		if (color.a == 0 || radius <= 0) return;
+		const glm::vec2 center = {posWorld.x, posWorld.z};
+		vQueued.push_back({DECAL_STAMP, center, center, radius, color, life, 0, 0});
+	}
+
+	void DecalQueue::line(const glm::vec3 &from, const glm::vec3 &to, float width, Pixel color, float life) {
+		if (color.a == 0 || width <= 0) return;
+		vQueued.push_back({DECAL_LINE, {from.x, from.z}, {to.x, to.z}, width / 2, color, life, 0, 0});
+	}
+
+	void DecalQueue::clear() {
+		vQueued.clear();
+		vFading.clear();
+		vLayered.clear();
+	}
+
+	bool DecalQueue::row(const Decal_t &decal, float y, float &x0, float &x1) const {
+
+		// never thinner than a storage pixel, or low resolution canvases would drop the decal
+		const float r = std::max(decal.radius * fScale, 0.5F);
+		const glm::vec2 a = (decal.a - mOrigin) * fScale;
+
+		bool hit = circleRow(a, r, y, x0, x1);
+
+		if (decal.kind == DECAL_STAMP) return hit;
+
+		const glm::vec2 b = (decal.b - mOrigin) * fScale, d = b - a;
+		const float length2 = d.x * d.x + d.y * d.y;
+
+		if (length2 < 1e-6F) return hit;
+
+		// the capsule is convex: the row is the hull of the rows of both end discs and the body
+		float s0, s1;
+		if (circleRow(b, r, y, s0, s1)) {
+			x0 = hit ? std::min(x0, s0) : s0;
+			x1 = hit ? std::max(x1, s1) : s1;
+			hit = true;
+		}
+
+		// body: 0 <= t <= 1 along the segment and |n| <= r across, both linear in x
+		const float length = sqrtf(length2);
+		const glm::vec2 n = {-d.y / length, d.x / length};
+		s0 = -INFINITY;
+		s1 = INFINITY;
+		if (clampLinear((y - a.y) * d.y / length2 - a.x * d.x / length2, d.x / length2, 0, 1, s0, s1)
+			&& clampLinear((y - a.y) * n.y - a.x * n.x, n.x, -r, r, s0, s1)
+			&& s0 <= s1) {
+			x0 = hit ? std::min(x0, s0) : s0;
+			x1 = hit ? std::max(x1, s1) : s1;
+			hit = true;
+		}
+
+		return hit;
+	}
+
+	DirtyRect_t DecalQueue::bounds(const Decal_t &decal) const {
+		const float r = std::max(decal.radius * fScale, 0.5F);
+		const glm::vec2 a = (decal.a - mOrigin) * fScale, b = (decal.b - mOrigin) * fScale;
+		return {static_cast<int>(floorf(std::min(a.x, b.x) - r)), static_cast<int>(floorf(std::min(a.y, b.y) - r)),
+				static_cast<int>(ceilf(std::max(a.x, b.x) + r)) + 1, static_cast<int>(ceilf(std::max(a.y, b.y) + r)) + 1};
+	}
+
+	template<typename Func>
+	DirtyRect_t DecalQueue::rasterize(const Decal_t &decal, const DirtyRect_t &clip, Func spanOp) {
+
+		const DirtyRect_t box = bounds(decal);
+
+		const int top = std::max({0, box.y0, clip.y0}), bottom = std::min(box.y1, clip.y1) - 1;
+		int left = INT32_MAX, right = INT32_MIN;
+
+		if (box.x1 <= clip.x0 || box.x0 >= clip.x1) return {0, 0, 0, 0};
+
+		// a pixel is covered when its center is
+		for (int y = top; y <= bottom; y++) {
+			float x0, x1;
+			if (!row(decal, y + 0.5F, x0, x1)) continue;
+			const int from = std::max(clip.x0, static_cast<int>(ceilf(x0 - 0.5F)));
+			const int to = std::min(clip.x1 - 1, static_cast<int>(floorf(x1 - 0.5F)));
+			if (from > to) continue;
+			spanOp(from, to, y);
+			left = std::min(left, from);
+			right = std::max(right, to);
+		}
+
+		if (left > right) return {0, 0, 0, 0};
+		return {left, top, right + 1, bottom + 1};
+	}
+
+	/** Key of the bucket (x, z) */
+	static int64_t bucketKey(int x, int z) {
+		return static_cast<int64_t>(x) << 32 | static_cast<uint32_t>(z);
+	}
+
+	void DecalQueue::bucket() {
+
+		mBuckets.clear();
+
+		for (size_t i = 0; i < vFading.size(); i++) {
+			const Decal_t &decal = vFading[i];
+			if (decal.step == FADE_STEPS) continue;
+			const glm::vec2 min = (glm::min(decal.a, decal.b) - decal.radius) / BUCKET;
+			const glm::vec2 max = (glm::max(decal.a, decal.b) + decal.radius) / BUCKET;
+			for (int z = static_cast<int>(floorf(min.y)), zl = static_cast<int>(floorf(max.y)); z <= zl; z++)
+				for (int x = static_cast<int>(floorf(min.x)), xl = static_cast<int>(floorf(max.x)); x <= xl; x++)
+					mBuckets[bucketKey(x, z)].push_back(i);
+		}
+	}
+
+	void DecalQueue::candidates(const glm::vec2 &minWorld, const glm::vec2 &maxWorld) {
+
+		vCandidates.clear();
+		vFound.resize(vFading.size(), 0);
+
+		// a new mark for every query, so a decal in several buckets is found once
+		if (++nQuery == 0) {
+			std::fill(vFound.begin(), vFound.end(), 0);
+			nQuery = 1;
+		}
+
+		const glm::vec2 min = minWorld / BUCKET, max = maxWorld / BUCKET;
+
+		for (int z = static_cast<int>(floorf(min.y)), zl = static_cast<int>(floorf(max.y)); z <= zl; z++)
+			for (int x = static_cast<int>(floorf(min.x)), xl = static_cast<int>(floorf(max.x)); x <= xl; x++) {
+				const auto cell = mBuckets.find(bucketKey(x, z));
+				if (cell == mBuckets.end()) continue;
+				for (size_t i : cell->second)
+					if (vFound[i] != nQuery) {
+						vFound[i] = nQuery;
+						vCandidates.push_back(i);
+					}
+			}
+
+		std::sort(vCandidates.begin(), vCandidates.end());
+	}
+
+	void DecalQueue::resolve(const Decal_t &decal, const TerrainResolver_t &resolver) {
+		const glm::vec2 extent = {decal.radius, decal.radius};
+		resolver(glm::min(decal.a, decal.b) - extent, glm::max(decal.a, decal.b) + extent, vTargets);
+	}
+
+	TerrainCanvas *DecalQueue::target(Terrain *terrain) {
+		TerrainCanvas *canvas = terrain->canvas();
+		if (canvas != nullptr) {
+			fScale = canvas->resolution();
+			mOrigin = terrain->CONFIG.origin;
+		}
+		return canvas;
+	}
+
+	DecalLayer *DecalQueue::layer(Terrain *terrain, TerrainCanvas *canvas) {
+		if (std::find(vLayered.begin(), vLayered.end(), terrain) == vLayered.end()) vLayered.push_back(terrain);
+		return canvas->layer();
+	}
+
+	void DecalQueue::redraw(Terrain *terrain, TerrainCanvas *canvas, const DirtyRect_t &rect) {
+
+		DecalLayer *decals = layer(terrain, canvas);
+
+		for (int y = rect.y0; y < rect.y1; y++) decals->clearSpan(rect.x0, rect.x1 - 1, y);
+		canvas->invalidate(rect.x0, rect.y0, rect.x1, rect.y1);
+
+		// a storage pixel around, decals are never thinner than one
+		const glm::vec2 pad = glm::vec2(1.0F / fScale);
+		candidates(mOrigin + glm::vec2(rect.x0, rect.y0) / fScale - pad, mOrigin + glm::vec2(rect.x1, rect.y1) / fScale + pad);
+
+		// in drawing order, each one at what is left of its alpha
+		for (size_t i : vCandidates) {
+			const Decal_t &decal = vFading[i];
+			Pixel color = decal.color;
+			color.a = static_cast<uint8_t>(color.a * (FADE_STEPS - decal.step) / FADE_STEPS);
+			rasterize(decal, rect, [decals, color](int x0, int x1, int y) {
+				decals->blendSpan(x0, x1, y, color);
+			});
+		}
+	}
+
+	void DecalQueue::flush(float elapsed, const TerrainResolver_t &resolver) {
+
+		static const DirtyRect_t ALL = {INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX};
+
+		// fade first, so a decal queued this frame is not redrawn twice
+		vStepped.clear();
+		for (size_t i = 0; i < vFading.size(); i++) {
+			Decal_t &decal = vFading[i];
+			decal.age += elapsed;
+			const int step = std::min(FADE_STEPS, static_cast<int>(decal.age / decal.life * FADE_STEPS));
+			if (step > decal.step) {
+				decal.step = step;
+				vStepped.push_back(i);
+			}
+		}
+
+		// the footprints of the decals that took a step, merged per terrain so every pixel is redrawn once
+		vRedrawTerrains.clear();
+		vRedrawRegions.clear();
+
+		for (size_t i : vStepped) {
+			resolve(vFading[i], resolver);
+			for (Terrain *terrain : vTargets) {
+				TerrainCanvas *canvas = target(terrain);
+				if (canvas == nullptr) continue;
+				const size_t index = std::find(vRedrawTerrains.begin(), vRedrawTerrains.end(), terrain) - vRedrawTerrains.begin();
+				if (index == vRedrawTerrains.size()) {
+					vRedrawTerrains.push_back(terrain);
+					vRedrawRegions.emplace_back(std::max(1, static_cast<int>(ceilf(canvas->width() * fScale))),
+												std::max(1, static_cast<int>(ceilf(canvas->height() * fScale))));
+				}
+				const DirtyRect_t box = bounds(vFading[i]);
+				vRedrawRegions[index].add(box.x0, box.y0, box.x1, box.y1);
+			}
+		}
+
+		// after the last step a decal is left out of the redraw, which clears it
+		if (!vRedrawTerrains.empty()) {
+			bucket();
+			for (size_t t = 0; t < vRedrawTerrains.size(); t++) {
+				TerrainCanvas *canvas = target(vRedrawTerrains[t]);
+				for (const DirtyRect_t &rect : vRedrawRegions[t].rects()) redraw(vRedrawTerrains[t], canvas, rect);
+			}
+		}
+
+		vFading.erase(std::remove_if(vFading.begin(), vFading.end(), [](const Decal_t &decal) {
+			return decal.step == FADE_STEPS;
+		}), vFading.end());
+
+		for (const Decal_t &decal : vQueued) {
+
+			resolve(decal, resolver);
+			bool drawn = false;
+
+			for (Terrain *terrain : vTargets) {
+
+				TerrainCanvas *canvas = target(terrain);
+				if (canvas == nullptr) continue;
+
+				DirtyRect_t rect;
+				if (decal.life > 0) {
+					DecalLayer *decals = layer(terrain, canvas);
+					rect = rasterize(decal, ALL, [decals, &decal](int x0, int x1, int y) {
+						decals->blendSpan(x0, x1, y, decal.color);
+					});
+				} else {
+					rect = rasterize(decal, ALL, [canvas, &decal](int x0, int x1, int y) {
+						canvas->blendSpan(x0, x1, y, decal.color);
+					});
+				}
+
+				if (rect.x0 < rect.x1) canvas->invalidate(rect.x0, rect.y0, rect.x1, rect.y1);
+				drawn = true;
+			}
+
+			if (decal.life > 0 && drawn) vFading.push_back(decal);
+		}
+
+		// the last fading decal took the contents of the layers with it
+		if (vFading.empty() && !vLayered.empty()) {
+			for (Terrain *terrain : vLayered)
+				if (terrain->canvas() != nullptr) terrain->canvas()->releaseLayer();
+			vLayered.clear();
+		}
+
+		if (DBG && !vQueued.empty())
+			LogV(TAG, SF("Drawn %zu decals, %zu fading", vQueued.size(), vFading.size()));
+
+		vQueued.clear();
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,120 @@
+//
+//  DirtyRegions.cpp
+//  PixFu Engine
+//
+//  Modified rectangles of a pixel buffer.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "DirtyRegions.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace Pix {
+
+	DirtyRegions::DirtyRegions(int width, int height) : WIDTH(width), HEIGHT(height) {}
+
+	DirtyRect_t DirtyRegions::join(const DirtyRect_t &a, const DirtyRect_t &b) {
+		return {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+	}
+
+	bool DirtyRegions::touch(const DirtyRect_t &a, const DirtyRect_t &b) {
+		return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+	}
+
+	void DirtyRegions::mergeOverlapping(DirtyRect_t rect) {
+
+		// merge with every rectangle it overlaps, or that is close enough to not waste much
+		for (bool merged = true; merged;) {
+			merged = false;
+			for (size_t i = 0; i < vRects.size(); i++) {
+				const DirtyRect_t joined = join(rect, vRects[i]);
+				if (touch(rect, vRects[i]) || joined.area() <= MERGE_WASTE * (rect.area() + vRects[i].area())) {
+					rect = joined;
+					vRects[i] = vRects.back();
+					vRects.pop_back();
+					merged = true;
+					break;
+				}
+			}
+		}
+
+		vRects.emplace_back(rect);
+	}
+
+	void DirtyRegions::add(int x0, int y0, int x1, int y1) {
+
+		const DirtyRect_t rect = {std::max(x0, 0), std::max(y0, 0), std::min(x1, WIDTH), std::min(y1, HEIGHT)};
+
+		if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return;
+
+		mergeOverlapping(rect);
+
+		// too many rectangles: merge the pair that grows the least
+		while (vRects.size() > MAXRECTS) {
+
+			size_t bestA = 0, bestB = 1, bestGrowth = SIZE_MAX;
+
+			for (size_t a = 0; a < vRects.size(); a++) {
+				for (size_t b = a + 1; b < vRects.size(); b++) {
+					const size_t growth = join(vRects[a], vRects[b]).area() - vRects[a].area() - vRects[b].area();
+					if (growth < bestGrowth) {
+						bestGrowth = growth;
+						bestA = a;
+						bestB = b;
+					}
+				}
+			}
+
+			const DirtyRect_t joined = join(vRects[bestA], vRects[bestB]);
+			vRects.erase(vRects.begin() + bestB);
+			vRects.erase(vRects.begin() + bestA);
+			mergeOverlapping(joined);
+		}
+	}
+
+	void DirtyRegions::addAll() {
+		vRects.clear();
+		vRects.push_back({0, 0, WIDTH, HEIGHT});
+	}
+
+	size_t DirtyRegions::pixels() const {
+		size_t total = 0;
+		for (const DirtyRect_t &rect : vRects) total += rect.area();
+		return total;
+	}
+
+	size_t DirtyRegions::take(size_t budget, size_t bytesPerPixel, std::vector<DirtyRect_t> &out) {
+
+		size_t taken = 0;
+
+		while (!vRects.empty()) {
+
+			DirtyRect_t &rect = vRects.back();
+			const size_t rowBytes = rect.width() * bytesPerPixel;
+			const size_t bytes = rect.height() * rowBytes;
+
+			if (taken + bytes <= budget || (taken == 0 && rect.height() == 1)) {
+				out.emplace_back(rect);
+				taken += bytes;
+				vRects.pop_back();
+				continue;
+			}
+
+			// split by rows. Always take one, even over budget, if nothing was taken yet
+			int rows = taken < budget ? static_cast<int>((budget - taken) / rowBytes) : 0;
+			if (rows == 0 && taken > 0) break;
+			rows = std::max(rows, 1);
+
+			out.push_back({rect.x0, rect.y0, rect.x1, rect.y0 + rows});
+			taken += rows * rowBytes;
+			rect.y0 += rows;
+			break;
+		}
+
+		return taken;
+	}
+
+}
@@ -0,0 +1,140 @@
+//
+//  FrustumCuller.cpp
+//  PixFu Engine
+//
+//  Batched sphere - frustum tests.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "FrustumCuller.hpp"
+#include "Simd.hpp"
+
+#include <cmath>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	void FrustumCuller::setFrustum(const Frustum &frustum) {
+
+		// normalized, so the plane equation is a distance that compares with the radius
+		for (int i = 0; i < Frustum::PLANES; i++) {
+			const glm::vec4 &plane = frustum.plane(i);
+			const float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+			const float inverse = length > 0 ? 1.0F / length : 0.0F;
+			mPlanes[i][0] = plane.x * inverse;
+			mPlanes[i][1] = plane.y * inverse;
+			mPlanes[i][2] = plane.z * inverse;
+			mPlanes[i][3] = plane.w * inverse;
+		}
+	}
+
+	CullResult_t FrustumCuller::classify(const glm::vec3 &min, const glm::vec3 &max) const {
+
+		CullResult_t result = CULL_INSIDE;
+
+		for (const float *P : mPlanes) {
+
+			// the corners farthest along and against the plane normal
+			const float ahead = P[0] * (P[0] > 0 ? max.x : min.x) + P[1] * (P[1] > 0 ? max.y : min.y)
+							  + P[2] * (P[2] > 0 ? max.z : min.z) + P[3];
+			if (ahead < 0) return CULL_OUTSIDE;
+
+			const float behind = P[0] * (P[0] > 0 ? min.x : max.x) + P[1] * (P[1] > 0 ? min.y : max.y)
+							   + P[2] * (P[2] > 0 ? min.z : max.z) + P[3];
+			if (behind < 0) result = CULL_INTERSECT;
+		}
+
+		return result;
+	}
+
+	void FrustumCuller::clear() {
+		vX.clear();
+		vY.clear();
+		vZ.clear();
+		vRadius.clear();
+		nCount = 0;
+	}
+
+	void FrustumCuller::add(const glm::vec3 &center, float radius) {
+
+		// keep the arrays padded, the padding lanes are masked out after the test
+		if (nCount == vX.size()) {
+			const size_t padded = nCount + Simd::WIDTH;
+			vX.resize(padded, 0);
+			vY.resize(padded, 0);
+			vZ.resize(padded, 0);
+			vRadius.resize(padded, 0);
+		}
+
+		vX[nCount] = center.x;
+		vY[nCount] = center.y;
+		vZ[nCount] = center.z;
+		vRadius[nCount] = radius;
+		nCount++;
+	}
+
+	size_t FrustumCuller::cull(std::vector<size_t> *visible) {
+
+		using namespace Simd;
+
+		const size_t groups = (nCount + WIDTH - 1) / WIDTH;
+
+		// a different list: forget the coherency
+		if (vLastPlane.size() != groups) vLastPlane.assign(groups, 0);
+
+		vMask.assign((nCount + 31) / 32, 0);
+
+		if (visible != nullptr) visible->clear();
+
+		size_t count = 0;
+
+		for (size_t group = 0; group < groups; group++) {
+
+			const size_t first = group * WIDTH;
+
+			const float4 x = load(&vX[first]), y = load(&vY[first]), z = load(&vZ[first]);
+			const float4 minusRadius = -load(&vRadius[first]);
+
+			// lanes out so far
+			int out = 0;
+
+			const int last = vLastPlane[group];
+
+			for (int p = 0; p < Frustum::PLANES && out != 0xF; p++) {
+
+				// the plane that rejected the group last time goes first
+				const int plane = p == 0 ? last : (p == last ? 0 : p);
+
+				const float *P = mPlanes[plane];
+				const float4 distance = x * float4(P[0]) + y * float4(P[1]) + z * float4(P[2]) + float4(P[3]);
+
+				out |= lessMask(distance, minusRadius);
+
+				if (out == 0xF) vLastPlane[group] = static_cast<uint8_t>(plane);
+			}
+
+			// the padding lanes of the last group
+			int in = ~out & 0xF;
+			if (first + WIDTH > nCount) in &= (1 << (nCount - first)) - 1;
+
+			if (in == 0) continue;
+
+			vMask[first >> 5] |= static_cast<uint32_t>(in) << (first & 31);
+
+			for (int lane = 0; lane < WIDTH; lane++) {
+				if (in & (1 << lane)) {
+					count++;
+					if (visible != nullptr) visible->push_back(first + lane);
+				}
+			}
+		}
+
+		return count;
+	}
+
+}
+
+#pragma clang diagnostic pop
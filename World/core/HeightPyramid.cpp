@@ -0,0 +1,142 @@
+//
+//  HeightPyramid.cpp
+//  PixFu Engine
+//
+//  Min/max mip pyramid over a terrain heightmap, and the hierarchical ray
+//  march that uses it.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "HeightPyramid.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	// clips the ray parameter range against the slab [0, size] of one axis
+	static bool clipSlab(float origin, float direction, float size, float &tmin, float &tmax) {
+
+		if (direction == 0) return origin >= 0 && origin <= size;
+
+		float t0 = (0 - origin) / direction;
+		float t1 = (size - origin) / direction;
+		if (t0 > t1) std::swap(t0, t1);
+
+		tmin = std::max(tmin, t0);
+		tmax = std::min(tmax, t1);
+		return tmin <= tmax;
+	}
+
+	HeightPyramid::HeightPyramid(Drawable *heightMap, int width, int height, float scale)
+			: WIDTH(width), HEIGHT(height), SCALE(scale) {
+
+		vHeights0.resize(WIDTH * HEIGHT);
+
+		for (int z = 0; z < HEIGHT; z++)
+			for (int x = 0; x < WIDTH; x++)
+				vHeights0[z * WIDTH + x] = heightMap->getPixel(x, z).r;
+
+		vWidths.emplace_back(WIDTH);
+		vHeights.emplace_back(HEIGHT);
+
+		const uint8_t *srcMin = vHeights0.data(), *srcMax = vHeights0.data();
+
+		for (int w = WIDTH, h = HEIGHT; w > 1 || h > 1;) {
+
+			const int nw = (w + 1) / 2, nh = (h + 1) / 2;
+			std::vector<uint8_t> levelMin(nw * nh), levelMax(nw * nh);
+
+			for (int z = 0; z < nh; z++) {
+				const int z0 = 2 * z * w, z1 = std::min(2 * z + 1, h - 1) * w;
+				for (int x = 0; x < nw; x++) {
+					const int x0 = 2 * x, x1 = std::min(2 * x + 1, w - 1);
+					levelMin[z * nw + x] = std::min(std::min(srcMin[z0 + x0], srcMin[z0 + x1]),
+													std::min(srcMin[z1 + x0], srcMin[z1 + x1]));
+					levelMax[z * nw + x] = std::max(std::max(srcMax[z0 + x0], srcMax[z0 + x1]),
+													std::max(srcMax[z1 + x0], srcMax[z1 + x1]));
+				}
+			}
+
+			vMin.emplace_back(std::move(levelMin));
+			vMax.emplace_back(std::move(levelMax));
+			srcMin = vMin.back().data();
+			srcMax = vMax.back().data();
+
+			vWidths.emplace_back(w = nw);
+			vHeights.emplace_back(h = nh);
+		}
+	}
+
+	bool HeightPyramid::raycast(const glm::vec3 &o, const glm::vec3 &d, float maxDistance, float &distance) const {
+
+		float tmin = 0, tmax = maxDistance;
+
+		if (!clipSlab(o.x, d.x, (float) WIDTH, tmin, tmax)) return false;
+		if (!clipSlab(o.z, d.z, (float) HEIGHT, tmin, tmax)) return false;
+
+		const int TOP = levels() - 1;
+
+		int level = TOP;
+		float t = tmin;
+
+		// level 0 cell the ray is in. When the ray leaves a node, the cell it enters is
+		// derived from the face it crossed, so even the tiniest corner clips are visited
+		int px = std::min(std::max((int) floorf(o.x + d.x * t), 0), WIDTH - 1);
+		int pz = std::min(std::max((int) floorf(o.z + d.z * t), 0), HEIGHT - 1);
+
+		while (true) {
+
+			const int cx = px >> level, cz = pz >> level;
+			const int size = 1 << level;
+
+			// where the ray leaves the node
+			const float tx = d.x > 0 ? ((float) ((cx + 1) * size) - o.x) / d.x
+									 : d.x < 0 ? ((float) (cx * size) - o.x) / d.x : INFINITY;
+			const float tz = d.z > 0 ? ((float) ((cz + 1) * size) - o.z) / d.z
+									 : d.z < 0 ? ((float) (cz * size) - o.z) / d.z : INFINITY;
+			const float tNode = std::min(std::min(tx, tz), tmax);
+
+			const float y0 = o.y + d.y * t;
+			const float y1 = o.y + d.y * tNode;
+
+			if (std::min(y0, y1) > maxHeight(level, cx, cz)) {
+
+				// the ray flies over the whole node: skip it and go coarser
+				if (tNode >= tmax) return false;
+
+				t = std::max(t, tNode);
+
+				px = tx <= tz ? (d.x > 0 ? (cx + 1) * size : cx * size - 1)
+							  : std::min(std::max((int) floorf(o.x + d.x * t), 0), WIDTH - 1);
+				pz = tz <= tx ? (d.z > 0 ? (cz + 1) * size : cz * size - 1)
+							  : std::min(std::max((int) floorf(o.z + d.z * t), 0), HEIGHT - 1);
+
+				if (px < 0 || pz < 0 || px >= WIDTH || pz >= HEIGHT) return false;
+				if (level < TOP) level++;
+				continue;
+			}
+
+			if (y0 <= minHeight(level, cx, cz)) {
+				// the ray enters the node below its lowest column, so it hits the wall
+				distance = t;
+				return true;
+			}
+
+			if (level == 0) {
+				// y0 is over the column and y1 under it: the ray descends onto its top
+				distance = (maxHeight(0, cx, cz) - o.y) / d.y;
+				return true;
+			}
+
+			level--;
+		}
+	}
+
+}
+
+#pragma clang diagnostic pop
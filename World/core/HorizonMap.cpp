@@ -0,0 +1,114 @@
+//
+//  HorizonMap.cpp
+//  PixFu Engine
+//
+//  Terrain horizon around the camera.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "HorizonMap.hpp"
+#include "Terrain.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string HorizonMap::TAG = "HorizonMap";
+
+	HorizonMap::HorizonMap(int sectors) : SECTORS(sectors), SECTOR(2.0F * (float) M_PI / (float) sectors) {
+
+		if (SECTORS < 4) throw std::runtime_error("Horizon map needs at least 4 sectors");
+
+		for (int s = 0; s < SECTORS; s++) {
+			vCos.push_back(cosf((s + 0.5F) * SECTOR));
+			vSin.push_back(sinf((s + 0.5F) * SECTOR));
+		}
+	}
+
+	void HorizonMap::build(const glm::vec3 &eyeWorld, float maxDistance, const TerrainResolver_t &terrainAt) {
+
+		mEye = eyeWorld;
+		nTested = nHidden = 0;
+
+		// rings as far apart as the sectors are wide, so every sample covers its part of the sector
+		if (maxDistance != fRingsDistance) {
+			vRings.clear();
+			for (float d = FIRST_RING; d <= maxDistance; d += std::max(FIRST_RING, d * SECTOR)) vRings.push_back(d);
+			fRingsDistance = maxDistance;
+		}
+
+		const size_t rings = vRings.size();
+		vSlopes.resize(SECTORS * rings);
+
+		for (int s = 0; s < SECTORS; s++) {
+
+			float *slopes = &vSlopes[s * rings];
+			float steepest = -INFINITY;
+
+			for (size_t r = 0; r < rings; r++) {
+
+				// the arc of the sector at this ring fits in a square as wide as the sector
+				const float d = vRings[r];
+				const glm::vec3 sample = {mEye.x + d * vCos[s], mEye.y, mEye.z + d * vSin[s]};
+
+				Terrain *terrain = terrainAt(sample);
+				float height;
+
+				if (terrain != nullptr && terrain->lowest(sample.x, sample.z, d * SECTOR, height))
+					steepest = std::max(steepest, (height - mEye.y) / d);
+
+				slopes[r] = steepest;
+			}
+		}
+
+		if (DBG) LogV(TAG, SF("Horizon of %d sectors, %zu rings", SECTORS, rings));
+	}
+
+	bool HorizonMap::visible(const glm::vec3 &centerWorld, float radius) const {
+
+		nTested++;
+
+		const float dx = centerWorld.x - mEye.x, dz = centerWorld.z - mEye.z;
+		const float distance = sqrtf(dx * dx + dz * dz), nearest = distance - radius;
+
+		if (vRings.empty() || nearest <= vRings[0]) return true;
+
+		// the steepest line from the eye to the sphere
+		const float top = centerWorld.y + radius - mEye.y;
+		const float slope = top > 0 ? top / nearest : top / (distance + radius);
+
+		// the horizon strictly before the sphere
+		const size_t rings = vRings.size();
+		const size_t ring = std::upper_bound(vRings.begin(), vRings.end(), nearest) - vRings.begin() - 1;
+
+		// and the sectors it spans
+		float azimuth = atan2f(dz, dx);
+		if (azimuth < 0) azimuth += 2.0F * (float) M_PI;
+
+		const float half = asinf(std::min(radius / distance, 1.0F));
+		const int first = (int) floorf((azimuth - half) / SECTOR), last = (int) floorf((azimuth + half) / SECTOR);
+
+		for (int s = first; s <= last && s < first + SECTORS; s++) {
+			const int sector = ((s % SECTORS) + SECTORS) % SECTORS;
+			if (vSlopes[sector * rings + ring] <= slope) return true;
+		}
+
+		nHidden++;
+		return false;
+	}
+
+	bool HorizonMap::visible(const glm::vec3 &minWorld, const glm::vec3 &maxWorld) const {
+		const glm::vec3 half = (maxWorld - minWorld) * 0.5F;
+		return visible(minWorld + half, sqrtf(half.x * half.x + half.y * half.y + half.z * half.z));
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,147 @@
+//
+//  ImpostorBatch.cpp
+//  PixFu Engine
+//
+//  Camera facing quads for the far objects.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "ImpostorBatch.hpp"
+#include "PixelCache.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string ImpostorBatch::TAG = "ImpostorBatch";
+
+	ImpostorBatch::ImpostorBatch(const std::string &filename) {
+
+		pTexture = PixelCache::enabled()
+				   ? new Texture2D(PixelCache::load(filename), true)
+				   : new Texture2D(filename, true);
+
+		// square cells in one row, the sheet says how many views it has
+		sInfo.filename = filename;
+		sInfo.width = pTexture->width();
+		sInfo.height = pTexture->height();
+		sInfo.numX = sInfo.height > 0 ? sInfo.width / sInfo.height : 0;
+		sInfo.numY = 1;
+		sInfo.spriteWidth = sInfo.spriteHeight = sInfo.height;
+
+		if (sInfo.numX < 1) throw std::runtime_error("Impostor atlas " + filename + " has no views");
+
+		if (DBG) LogV(TAG, SF("Impostor atlas %s, %d views", filename.c_str(), sInfo.numX));
+	}
+
+	ImpostorBatch::~ImpostorBatch() {
+		if (mQuadVao != 0) glDeleteVertexArrays(1, &mQuadVao);
+		if (mQuadBuffer != 0) glDeleteBuffers(1, &mQuadBuffer);
+		if (mBuffer != 0) glDeleteBuffers(1, &mBuffer);
+		delete pTexture;
+	}
+
+	int ImpostorBatch::view(const glm::vec3 &eyeWorld, const glm::vec3 &posWorld, float yaw) const {
+
+		// where the camera is around the object, in the object frame, as a fraction of a turn
+		float turn = (atan2f(eyeWorld.x - posWorld.x, eyeWorld.z - posWorld.z) - yaw) / (2.0F * (float) M_PI);
+		turn -= floorf(turn);
+
+		return static_cast<int>(turn * sInfo.numX + 0.5F) % sInfo.numX;
+	}
+
+	void ImpostorBatch::add(const glm::vec3 &eyeWorld, const glm::vec3 &posWorld, float yaw, float radius,
+							const glm::vec4 &tint) {
+		vImpostors.push_back({glm::vec4(posWorld / 1000.0F, radius), tint,
+							  static_cast<float>(view(eyeWorld, posWorld, yaw))});
+	}
+
+	void ImpostorBatch::init() {
+
+		pTexture->upload();
+
+		static const GLfloat corners[] = {
+				-1.0F, -1.0F,
+				1.0F, -1.0F,
+				-1.0F, 1.0F,
+				1.0F, 1.0F
+		};
+
+		const auto stride = static_cast<GLsizei>(sizeof(Impostor_t));
+
+		glGenVertexArrays(1, &mQuadVao);
+		glGenBuffers(1, &mQuadBuffer);
+		glGenBuffers(1, &mBuffer);
+
+		glBindVertexArray(mQuadVao);
+
+		glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(LOC_CORNER);
+		glVertexAttribPointer(LOC_CORNER, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid *) nullptr);
+
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+		glEnableVertexAttribArray(LOC_SPHERE);
+		glVertexAttribPointer(LOC_SPHERE, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid *) offsetof(Impostor_t, sphere));
+		glVertexAttribDivisor(LOC_SPHERE, 1);
+
+		glEnableVertexAttribArray(LOC_TINT);
+		glVertexAttribPointer(LOC_TINT, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid *) offsetof(Impostor_t, tint));
+		glVertexAttribDivisor(LOC_TINT, 1);
+
+		glEnableVertexAttribArray(LOC_SPRITE);
+		glVertexAttribPointer(LOC_SPRITE, 1, GL_FLOAT, GL_FALSE, stride, (GLvoid *) offsetof(Impostor_t, sprite));
+		glVertexAttribDivisor(LOC_SPRITE, 1);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void ImpostorBatch::draw(Shader *shader) {
+
+		if (vImpostors.empty()) return;
+
+		if (mQuadVao == 0) init();
+
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+		// grow with room, and orphan the storage so the driver does not wait for the last frame
+		if (vImpostors.size() > nCapacity) {
+			nCapacity = std::max(vImpostors.size(), nCapacity * 2);
+			if (DBG) LogV(TAG, SF("Impostor buffer grown to %zu", nCapacity));
+		}
+
+		glBufferData(GL_ARRAY_BUFFER, nCapacity * sizeof(Impostor_t), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vImpostors.size() * sizeof(Impostor_t), vImpostors.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// a reloaded shader is a new program, its locations may have moved
+		if (shader != pLocated || shader->id() != nLocatedProgram) {
+			LOC_SPRITESHEET = shader->getLocator("iSpriteSheet");
+			LOC_SAMPLER = shader->getLocator("sampler");
+			pLocated = shader;
+			nLocatedProgram = shader->id();
+		}
+
+		// the sprite sheet metrics and sampler, as the sprites shader gets them
+		shader->setVec4(LOC_SPRITESHEET, sInfo.width, sInfo.height, sInfo.numX, sInfo.numY);
+		shader->setInt(LOC_SAMPLER, static_cast<int>(pTexture->unit()));
+		pTexture->bind();
+
+		glBindVertexArray(mQuadVao);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(vImpostors.size()));
+		glBindVertexArray(0);
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,71 @@
+//
+//  InstanceBuffer.cpp
+//  PixFu Engine
+//
+//  Per instance data for instanced draws.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "InstanceBuffer.hpp"
+#include "Utils.hpp"
+
+#include <cstddef>
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string InstanceBuffer::TAG = "InstanceBuffer";
+
+	InstanceBuffer::~InstanceBuffer() {
+		if (mBuffer != 0) glDeleteBuffers(1, &mBuffer);
+	}
+
+	void InstanceBuffer::upload() {
+
+		if (mBuffer == 0) glGenBuffers(1, &mBuffer);
+
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+		// grow with room, clusters gain objects one by one
+		if (vInstances.size() > nCapacity) {
+			nCapacity = std::max(vInstances.size(), nCapacity * 2);
+			if (DBG) LogV(TAG, SF("Instance buffer grown to %zu", nCapacity));
+		}
+
+		// orphan the storage, so the driver does not wait for the draws of the last frame
+		glBufferData(GL_ARRAY_BUFFER, nCapacity * sizeof(Instance_t), nullptr, GL_STREAM_DRAW);
+
+		if (!vInstances.empty())
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vInstances.size() * sizeof(Instance_t), vInstances.data());
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void InstanceBuffer::attach() {
+
+		const auto stride = static_cast<GLsizei>(sizeof(Instance_t));
+
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+		// a mat4 attribute is four vec4 columns
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(LOC_TRANSFORM + column);
+			glVertexAttribPointer(LOC_TRANSFORM + column, 4, GL_FLOAT, GL_FALSE, stride,
+								  (GLvoid *) (offsetof(Instance_t, transform) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(LOC_TRANSFORM + column, 1);
+		}
+
+		glEnableVertexAttribArray(LOC_TINT);
+		glVertexAttribPointer(LOC_TINT, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid *) offsetof(Instance_t, tint));
+		glVertexAttribDivisor(LOC_TINT, 1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+}
+
+#pragma clang diagnostic pop
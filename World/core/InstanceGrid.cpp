@@ -0,0 +1,84 @@
+//
+//  InstanceGrid.cpp
+//  PixFu Engine
+//
+//  Cells of static objects, for hierarchical culling.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "InstanceGrid.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	InstanceGrid::InstanceGrid(float cellSize) : CELLSIZE(cellSize) {
+		if (CELLSIZE <= 0) throw std::runtime_error("Instance grid cell size must be positive");
+	}
+
+	void InstanceGrid::clear() {
+		vCells.clear();
+		vMembers.clear();
+		mMin = mMax = {0, 0, 0};
+	}
+
+	void InstanceGrid::build(const std::vector<glm::vec4> &spheres, const std::vector<size_t> &indices) {
+
+		clear();
+
+		if (spheres.empty()) return;
+
+		// cell key of every sphere, then sort so every cell is one run
+		typedef struct sKeyed {
+			int64_t key;
+			size_t sphere;
+		} Keyed_t;
+
+		std::vector<Keyed_t> keyed(spheres.size());
+
+		for (size_t i = 0; i < spheres.size(); i++) {
+			const auto col = static_cast<int64_t>(floorf(spheres[i].x / CELLSIZE));
+			const auto row = static_cast<int64_t>(floorf(spheres[i].z / CELLSIZE));
+			keyed[i] = {row * (INT64_C(1) << 32) + col, i};
+		}
+
+		std::sort(keyed.begin(), keyed.end(), [](const Keyed_t &a, const Keyed_t &b) { return a.key < b.key; });
+
+		vMembers.reserve(spheres.size());
+
+		for (size_t i = 0; i < keyed.size(); i++) {
+
+			const glm::vec4 &sphere = spheres[keyed[i].sphere];
+			const glm::vec3 center = {sphere.x, sphere.y, sphere.z};
+
+			if (i == 0 || keyed[i].key != keyed[i - 1].key) {
+				const auto start = static_cast<unsigned>(vMembers.size());
+				vCells.push_back({center - sphere.w, center + sphere.w, start, start});
+			}
+
+			InstanceCell_t &cell = vCells.back();
+			cell.min = glm::min(cell.min, center - sphere.w);
+			cell.max = glm::max(cell.max, center + sphere.w);
+			cell.end++;
+
+			vMembers.push_back(indices[keyed[i].sphere]);
+		}
+
+		mMin = vCells[0].min;
+		mMax = vCells[0].max;
+		for (const InstanceCell_t &cell : vCells) {
+			mMin = glm::min(mMin, cell.min);
+			mMax = glm::max(mMax, cell.max);
+		}
+	}
+
+}
+
+#pragma clang diagnostic pop
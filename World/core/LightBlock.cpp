@@ -0,0 +1,97 @@
+//
+//  LightBlock.cpp
+//  PixFu Engine
+//
+//  Shared uniform buffer of lights.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "LightBlock.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string LightBlock::TAG = "LightBlock";
+
+	LightBlock::LightBlock() : vData(MAXPOINTS * POINT_FLOATS + MAXSPOTS * SPOT_FLOATS, 0.0F) {
+		// all of it goes on the first upload
+		nDirtyTo = vData.size();
+	}
+
+	LightBlock::~LightBlock() {
+		if (mBuffer != 0) glDeleteBuffers(1, &mBuffer);
+	}
+
+	void LightBlock::pack(size_t offset, const float *light, size_t floats) {
+		if (memcmp(&vData[offset], light, floats * sizeof(float)) == 0) return;
+		memcpy(&vData[offset], light, floats * sizeof(float));
+		nDirtyFrom = nDirtyTo > nDirtyFrom ? std::min(nDirtyFrom, offset) : offset;
+		nDirtyTo = std::max(nDirtyTo, offset + floats);
+		nChanged++;
+	}
+
+	void LightBlock::update(const std::vector<std::shared_ptr<PointLight>> &points,
+							const std::vector<std::shared_ptr<SpotLight>> &spots) {
+
+		nChanged = 0;
+
+		for (size_t i = 0; i < points.size() && i < MAXPOINTS; i++) {
+			const PointLight *p = points[i].get();
+			const float light[POINT_FLOATS] = {
+					p->position.x, p->position.y, p->position.z, 0,
+					p->color.ambient.x, p->color.ambient.y, p->color.ambient.z, 0,
+					p->color.diffuse.x, p->color.diffuse.y, p->color.diffuse.z, 0,
+					p->color.specular.x, p->color.specular.y, p->color.specular.z, 0,
+					p->params.constant, p->params.linear, p->params.quadratic, p->enabled ? 1.0F : 0.0F
+			};
+			pack(i * POINT_FLOATS, light, POINT_FLOATS);
+		}
+
+		for (size_t i = 0; i < spots.size() && i < MAXSPOTS; i++) {
+			const SpotLight *s = spots[i].get();
+			const float light[SPOT_FLOATS] = {
+					s->position.x, s->position.y, s->position.z, 0,
+					s->direction.x, s->direction.y, s->direction.z, 0,
+					s->color.ambient.x, s->color.ambient.y, s->color.ambient.z, 0,
+					s->color.diffuse.x, s->color.diffuse.y, s->color.diffuse.z, 0,
+					s->color.specular.x, s->color.specular.y, s->color.specular.z, 0,
+					s->params.constant, s->params.linear, s->params.quadratic, s->enabled ? 1.0F : 0.0F,
+					s->cutOffCosine(), s->outerCutOffCosine(), 0, 0
+			};
+			pack(MAXPOINTS * POINT_FLOATS + i * SPOT_FLOATS, light, SPOT_FLOATS);
+		}
+	}
+
+	void LightBlock::upload() {
+
+		if (mBuffer == 0) {
+			glGenBuffers(1, &mBuffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+			glBufferData(GL_UNIFORM_BUFFER, vData.size() * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, LightingShader::LIGHTBLOCK_BINDING, mBuffer);
+		} else {
+			glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+		}
+
+		// one range covering the changed lights: static lights between them are cheaper to resend than to split
+		if (nDirtyTo > nDirtyFrom) {
+			glBufferSubData(GL_UNIFORM_BUFFER, nDirtyFrom * sizeof(float), (nDirtyTo - nDirtyFrom) * sizeof(float),
+							&vData[nDirtyFrom]);
+			if (DBG) LogV(TAG, SF("Sent %zu bytes, %d lights changed", (nDirtyTo - nDirtyFrom) * sizeof(float), nChanged));
+			nDirtyFrom = nDirtyTo = 0;
+		}
+
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,209 @@
+//
+//  LightGrid.cpp
+//  PixFu Engine
+//
+//  Light binning and selection.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "LightGrid.hpp"
+#include "Frustum.hpp"
+#include "Fu.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string LightGrid::TAG = "LightGrid";
+
+	LightGrid::LightGrid(float cellSize) : CELLSIZE(cellSize) {
+		if (CELLSIZE <= 0) throw std::runtime_error("Light grid cell size must be positive");
+	}
+
+	void LightGrid::build(const std::vector<std::shared_ptr<PointLight>> &points,
+						  const std::vector<std::shared_ptr<SpotLight>> &spots, float darkness,
+						  const HorizonMap *horizon) {
+
+		pPoints = &points;
+		pSpots = &spots;
+
+		vSpheres.clear();
+		vCellKeys.clear();
+		vCellStart.clear();
+		vCellSpheres.clear();
+		vEverywhere.clear();
+		vSets.clear();
+
+		// the horizon is in world units
+		auto hidden = [horizon](const glm::vec3 &center, float radius) {
+			return horizon != nullptr && !horizon->visible(center * 1000.0F, radius * 1000.0F);
+		};
+
+		for (size_t i = 0; i < points.size(); i++) {
+			const PointLight *light = points[i].get();
+			const float radius = light->radius(darkness);
+			if (light->enabled && !hidden(light->position, radius))
+				vSpheres.push_back({light->position, radius, false, static_cast<uint16_t>(i)});
+		}
+
+		for (size_t i = 0; i < spots.size(); i++) {
+			const SpotLight *light = spots[i].get();
+			const float radius = light->radius(darkness);
+			if (light->enabled && !hidden(light->position, radius))
+				vSpheres.push_back({light->position, radius, true, static_cast<uint16_t>(i)});
+		}
+
+		// every cell each light touches, then sort so every cell is one run
+		typedef struct sBinned {
+			int64_t key;
+			uint16_t sphere;
+		} Binned_t;
+
+		std::vector<Binned_t> binned;
+
+		for (size_t i = 0; i < vSpheres.size(); i++) {
+
+			const LightSphere_t &sphere = vSpheres[i];
+
+			const float col0 = floorf((sphere.center.x - sphere.radius) / CELLSIZE),
+					col1 = floorf((sphere.center.x + sphere.radius) / CELLSIZE),
+					row0 = floorf((sphere.center.z - sphere.radius) / CELLSIZE),
+					row1 = floorf((sphere.center.z + sphere.radius) / CELLSIZE);
+
+			// also catches infinite radius
+			if (!((col1 - col0 + 1) * (row1 - row0 + 1) <= MAXCELLS)) {
+				vEverywhere.push_back(static_cast<uint16_t>(i));
+				continue;
+			}
+
+			for (int row = (int) row0; row <= (int) row1; row++)
+				for (int col = (int) col0; col <= (int) col1; col++)
+					binned.push_back({key(col, row), static_cast<uint16_t>(i)});
+		}
+
+		std::sort(binned.begin(), binned.end(), [](const Binned_t &a, const Binned_t &b) { return a.key < b.key; });
+
+		for (size_t i = 0; i < binned.size(); i++) {
+			if (i == 0 || binned[i].key != binned[i - 1].key) {
+				vCellKeys.push_back(binned[i].key);
+				vCellStart.push_back(static_cast<unsigned>(vCellSpheres.size()));
+			}
+			vCellSpheres.push_back(binned[i].sphere);
+		}
+
+		vCellStart.push_back(static_cast<unsigned>(vCellSpheres.size()));
+
+		if (DBG) LogV(TAG, SF("%zu lights in %zu cells, %zu everywhere", vSpheres.size(), vCellKeys.size(), vEverywhere.size()));
+	}
+
+	void LightGrid::rank(LightSet_t &set, float scores[2][LightingShader::MAXLIGHTS], const LightSphere_t &sphere, float score) {
+
+		uint8_t &count = sphere.spot ? set.spots : set.points;
+		uint16_t *slots = sphere.spot ? set.spot : set.point;
+		float *ranked = scores[sphere.spot ? 1 : 0];
+
+		// sorted insertion, the weakest falls out
+		int at = count;
+		if (count == LightingShader::MAXLIGHTS) {
+			if (score <= ranked[count - 1]) return;
+			at--;
+		} else {
+			count++;
+		}
+
+		for (; at > 0 && ranked[at - 1] < score; at--) {
+			ranked[at] = ranked[at - 1];
+			slots[at] = slots[at - 1];
+		}
+
+		ranked[at] = score;
+		slots[at] = sphere.index;
+	}
+
+	int LightGrid::store(const LightSet_t &set) {
+
+		// by light index, so a light keeps its slot while it stays selected
+		LightSet_t sorted = set;
+		std::sort(sorted.point, sorted.point + sorted.points);
+		std::sort(sorted.spot, sorted.spot + sorted.spots);
+
+		// neighbour draws usually get the same lights
+		if (!vSets.empty() && memcmp(&vSets.back(), &sorted, sizeof(LightSet_t)) == 0)
+			return static_cast<int>(vSets.size()) - 1;
+
+		vSets.push_back(sorted);
+		return static_cast<int>(vSets.size()) - 1;
+	}
+
+	int LightGrid::select(const glm::vec3 &posRender) {
+
+		LightSet_t set = {};
+		float scores[2][LightingShader::MAXLIGHTS];
+
+		// the lights that reach the position: nearer and bigger score more
+		auto consider = [this, &set, &scores, &posRender](uint16_t index) {
+			const LightSphere_t &sphere = vSpheres[index];
+			const glm::vec3 d = sphere.center - posRender;
+			const float distance = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+			if (distance < sphere.radius) rank(set, scores, sphere, 1 / (1 + distance / sphere.radius));
+		};
+
+		const int64_t cell = key((int) floorf(posRender.x / CELLSIZE), (int) floorf(posRender.z / CELLSIZE));
+		const auto found = std::lower_bound(vCellKeys.begin(), vCellKeys.end(), cell);
+
+		if (found != vCellKeys.end() && *found == cell) {
+			const size_t i = found - vCellKeys.begin();
+			for (unsigned s = vCellStart[i]; s < vCellStart[i + 1]; s++) consider(vCellSpheres[s]);
+		}
+
+		for (uint16_t index : vEverywhere) consider(index);
+
+		return store(set);
+	}
+
+	int LightGrid::select(const Frustum *frustum, const glm::vec3 &eyeRender) {
+
+		LightSet_t set = {};
+		float scores[2][LightingShader::MAXLIGHTS];
+
+		for (const LightSphere_t &sphere : vSpheres) {
+			if (frustum != nullptr && !frustum->IsBoxVisible(sphere.center, sphere.radius)) continue;
+			const glm::vec3 d = sphere.center - eyeRender;
+			const float distance = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+			rank(set, scores, sphere, 1 / (1 + distance / sphere.radius));
+		}
+
+		return store(set);
+	}
+
+	void LightGrid::load(LightingShader *shader, int set) const {
+
+		const LightSet_t &lights = vSets[set];
+
+		// the lights are in the shared block already: just say which
+		if (shader->lightBlock()) {
+			shader->loadLightIndices(lights.point, lights.points, lights.spot, lights.spots);
+			return;
+		}
+
+		// unchanged slots cost nothing, the shader skips uniforms that hold the value already
+		for (int i = 0; i < LightingShader::MAXLIGHTS; i++) {
+
+			if (i < lights.points) shader->loadLight((*pPoints)[lights.point[i]].get(), i, true);
+			else shader->enablePointLight(i, false);
+
+			if (i < lights.spots) shader->loadLight((*pSpots)[lights.spot[i]].get(), i, true);
+			else shader->enableSpotLight(i, false);
+		}
+	}
+
+}
+
+#pragma clang diagnostic pop
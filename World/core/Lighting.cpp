@@ -14,6 +14,8 @@
 #include "Lighting.hpp"
 #include "Utils.hpp"
 
+#include <stdexcept>
+
 namespace Pix {
 	
 	LightingShader::LightingShader(const std::string& name, int maxLights)
@@ -23,6 +25,10 @@ namespace Pix {
 
 		L_LIGHTMODE  = getLocator("lightMode");
 
+		// light indices into the shared block
+		LOC_POINTINDEX = getLocator("pointLightIndex");
+		LOC_SPOTINDEX  = getLocator("spotLightIndex");
+
 		// cache directional light locators
 
 		DL_DIRECTION = getLocator("dirLight.direction");
@@ -57,36 +63,62 @@ namespace Pix {
 		}
 	}
 
+	void LightingShader::useLightBlock() {
+
+		GLint program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+		const GLuint block = glGetUniformBlockIndex(static_cast<GLuint>(program), "Lights");
+		if (block == GL_INVALID_INDEX) throw std::runtime_error("Shader has no Lights uniform block");
+
+		glUniformBlockBinding(static_cast<GLuint>(program), block, LIGHTBLOCK_BINDING);
+		bLightBlock = true;
+	}
+
+	void LightingShader::loadLightIndices(const uint16_t *points, int pointCount, const uint16_t *spots, int spotCount) const {
+
+		float p[MAXLIGHTS], s[MAXLIGHTS];
+
+		for (int i = 0; i < MAXLIGHTS; i++) {
+			p[i] = i < pointCount ? points[i] : -1.0F;
+			s[i] = i < spotCount ? spots[i] : -1.0F;
+		}
+
+		static_assert(MAXLIGHTS == 4, "light indices are sent as vec4");
+		uploadVec4(LOC_POINTINDEX, p[0], p[1], p[2], p[3]);
+		uploadVec4(LOC_SPOTINDEX, s[0], s[1], s[2], s[3]);
+	}
+
 	void LightingShader::loadLight(const DirLight& light) const {
-		setVec3(DL_DIRECTION, light.direction);
-		setVec3(DL_AMBIENT,   light.color.ambient);
-		setVec3(DL_DIFFUSE,   light.color.diffuse);
-		setVec3(DL_SPECULAR,  light.color.specular);
+		uploadVec3(DL_DIRECTION, light.direction);
+		uploadVec3(DL_AMBIENT,   light.color.ambient);
+		uploadVec3(DL_DIFFUSE,   light.color.diffuse);
+		uploadVec3(DL_SPECULAR,  light.color.specular);
 	}
 
 	void LightingShader::loadLight(PointLight *light, int index, bool enable) const {
 
-		setInt(PL_ENABLED[index], enable?1:0);
+		uploadInt(PL_ENABLED[index], enable?1:0);
 		
 		if (enable) {
-			setVec3(PL_POSITION[index], light->position);
-			setVec3(PL_AMBIENT[index], 	light->color.ambient);
-			setVec3(PL_DIFFUSE[index],  light->color.diffuse);
-			setVec3(PL_SPECULAR[index], light->color.specular);
-			setVec3(PL_PARAMS[index], 	light->params.constant, light->params.linear, light->params.quadratic);
+			uploadVec3(PL_POSITION[index], light->position);
+			uploadVec3(PL_AMBIENT[index], 	light->color.ambient);
+			uploadVec3(PL_DIFFUSE[index],  light->color.diffuse);
+			uploadVec3(PL_SPECULAR[index], light->color.specular);
+			uploadVec3(PL_PARAMS[index], 	light->params.constant, light->params.linear, light->params.quadratic);
 		}
 	}
 
 	void LightingShader::loadLight(SpotLight *light, int index, bool enable) const {
-		setInt(SL_ENABLED[index], light->enabled ? 1:0);
+		uploadInt(SL_ENABLED[index], light->enabled ? 1:0);
 		if (enable) {
-			setVec3(SL_POSITION[index],		light->position);
-			setVec3(SL_DIRECTION[index], 	light->direction);
-			setVec3(SL_AMBIENT[index], 		light->color.ambient);
-			setVec3(SL_DIFFUSE[index], 		light->color.diffuse);
-			setVec3(SL_SPECULAR[index], 	light->color.specular);
-			setVec3(SL_PARAMS[index], 		light->params.constant, light->params.linear, light->params.quadratic);
-			setVec2(SL_CUTOFF[index], 		cosf(light->params.cutOff), cosf(light->params.outerCutOff));
+			uploadVec3(SL_POSITION[index],		light->position);
+			uploadVec3(SL_DIRECTION[index], 	light->direction);
+			uploadVec3(SL_AMBIENT[index], 		light->color.ambient);
+			uploadVec3(SL_DIFFUSE[index], 		light->color.diffuse);
+			uploadVec3(SL_SPECULAR[index], 	light->color.specular);
+			uploadVec3(SL_PARAMS[index], 		light->params.constant, light->params.linear, light->params.quadratic);
+			uploadVec2(SL_CUTOFF[index], 		light->cutOffCosine(), light->outerCutOffCosine());
 		}
 	}
 }
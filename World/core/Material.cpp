@@ -10,6 +10,7 @@
 //
 
 #include "Material.hpp"
+#include "PixelCache.hpp"
 
 namespace Pix {
 
@@ -22,8 +23,10 @@ namespace Pix {
 		};
 
 		if (map_Kd.size()>0) {
-			std::string filename = getName(map_Kd);
-			textureKd = new Texture2D(FOLDER + "/" + NAME + "/"+filename, true);
+			std::string path = FOLDER + "/" + NAME + "/" + getName(map_Kd);
+			textureKd = PixelCache::enabled()
+						? new Texture2D(PixelCache::load(path), true)
+						: new Texture2D(path, true);
 		}
 
 	}
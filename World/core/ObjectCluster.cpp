@@ -18,12 +18,18 @@
 #include "ObjLoader.hpp"
 #include "ObjectCluster.hpp"
 #include "Camera.hpp"
+#include "TransformBatch.hpp"
 #include "Config.hpp"
 
 #include "glm/mat4x4.hpp"
 #include "glm/vec3.hpp"
 #include "Fu.hpp"
 
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCSimplifyInspection"
 #pragma ide diagnostic ignored "OCDFAInspection"
@@ -38,20 +44,39 @@ namespace Pix {
 							   bool flipY = false, bool flipZ = false);
 
 	ObjectCluster::ObjectCluster(World *planet, std::string name, Transformation_t initialTransform)
-			: PLANET(planet->CONFIG),
+			: mCells(planet->CONFIG.objectCellSize / 1000.0F),
+			  PLANET(planet->CONFIG),
 			  PLACER(initialTransform),
 			  NAME(std::move(name)),
 			  WORLD(planet) {
 
 		if (DBG) LogV(TAG, "New Object Cluster " + NAME);
 
-		// load object model
-		pLoader = new ObjLoader(std::string(PATH_OBJECTS) + "/" + NAME + "/" + NAME + ".obj");
+		// load object model, and its lower details if there are
+		const std::string base = std::string(PATH_OBJECTS) + "/" + NAME + "/" + NAME;
+		vLods.emplace_back(new ObjLoader(base + ".obj"));
 
-		for (int i = 0; i< pLoader->meshCount(); i++) {
-		  pLoader->material(i).init(NAME);
+		struct stat st = {};
+		for (int lod = 1; lod < MAXLODS; lod++) {
+			const std::string path = base + SF(".lod%d.obj", lod);
+			if (stat(FuPlatform::getPath(path).c_str(), &st) != 0) break;
+			vLods.emplace_back(new ObjLoader(path));
 		}
 
+		vLodMesh.push_back(0);
+		for (ObjLoader *loader : vLods) {
+			for (int i = 0; i < loader->meshCount(); i++) {
+				loader->material(i).init(NAME);
+			}
+			vLodMesh.push_back(vLodMesh.back() + static_cast<int>(loader->meshCount()));
+		}
+
+		if (DBG && vLods.size() > 1) LogV(TAG, SF("%s has %zu detail levels", NAME.c_str(), vLods.size()));
+
+		// and the far tier, pre-rendered
+		if (PLANET.impostors && stat(FuPlatform::getPath(base + ".impostor.png").c_str(), &st) == 0)
+			pImpostors = new ImpostorBatch(base + ".impostor.png");
+
 		mPlacer = PLACER.toMatrix();
 		vInstances.clear();
 
@@ -63,11 +88,336 @@ namespace Pix {
 //		glm::vec3 pos = object->pos();
 // TODO	if (setHeight) pos.y = WORLD->getHeight(pos);
 		vInstances.emplace_back(object);
+
+		// records kept in step, unless objects were added behind our back
+		if (vRecords.size() + 1 == vInstances.size() && !bRecordsDirty) {
+			const size_t index = vInstances.size() - 1;
+			object->pCluster = this;
+			object->nRecord = index;
+			vRecords.emplace_back();
+			refresh(index);
+			vTransforms.push_back({});
+			vTransforms.back().valid = false;
+			vLod.push_back(0);
+			if (object->CONFIG.ISSTATIC) bCellsDirty = true;
+		}
+
 		if (DBG) LogV(TAG, SF("Add to cluster %s, total %d", NAME.c_str(), vInstances.size()));
 	}
 
+	void ObjectCluster::remove(WorldObject *object) {
+
+		if (bRecordsDirty || vRecords.size() != vInstances.size()) sync();
+
+		const size_t index = object->nRecord, last = vInstances.size() - 1;
+
+		if (object->pCluster != this || index > last || vInstances[index] != object)
+			throw std::runtime_error("Object " + std::to_string(object->ID) + " is not in cluster " + NAME);
+
+		// the cells hold the static objects by their index
+		if ((vRecords[index].flags | vRecords[last].flags) & INSTANCE_STATIC) bCellsDirty = true;
+
+		vInstances[index] = vInstances[last];
+		vRecords[index] = vRecords[last];
+		vTransforms[index] = vTransforms[last];
+		vLod[index] = vLod[last];
+
+		vInstances.pop_back();
+		vRecords.pop_back();
+		vTransforms.pop_back();
+		vLod.pop_back();
+
+		// changes waiting for the moved object were noted at its old place
+		if (index < last) {
+			vInstances[index]->nRecord = index;
+			refresh(index);
+		}
+
+		object->pCluster = nullptr;
+
+		if (DBG) LogV(TAG, SF("Remove from cluster %s, total %d", NAME.c_str(), vInstances.size()));
+	}
+
+	void ObjectCluster::sync() {
+
+		// objects may have been added or removed behind our back
+		if (vRecords.size() != vInstances.size()) {
+			vRecords.resize(vInstances.size());
+			vTransforms.resize(vInstances.size());
+			for (CachedTransform_t &cached : vTransforms) cached.valid = false;
+			vLod.assign(vInstances.size(), 0);
+			bCellsDirty = bRecordsDirty = true;
+		}
+
+		if (bRecordsDirty) {
+			for (size_t index = 0; index < vInstances.size(); index++) {
+				vInstances[index]->pCluster = this;
+				vInstances[index]->nRecord = index;
+				refresh(index);
+			}
+			// a cluster is one class of objects
+			if (!vInstances.empty()) {
+				fMaxDrawDistance = vInstances[0]->CONFIG.maxDrawDistance;
+				fImpostorDistance = vInstances[0]->CONFIG.impostorDistance;
+			}
+			bRecordsDirty = false;
+		} else {
+			// only the moving objects change on their own, the others tell when they do
+			for (size_t index = 0; index < vRecords.size(); index++)
+				if (!(vRecords[index].flags & INSTANCE_STATIC)) refresh(index);
+			for (size_t index : vTouched)
+				if (index < vRecords.size()) refresh(index);
+		}
+
+		vTouched.clear();
+	}
+
+	void ObjectCluster::refresh(size_t index) {
+		WorldObject *object = vInstances[index];
+		InstanceRecord_t &record = vRecords[index];
+		record.pos = object->pos();
+		record.radius = object->drawRadius();
+		record.rot = object->rot();
+		record.flags = (object->CONFIG.ISSTATIC ? INSTANCE_STATIC : 0) | (object->isSelected() ? INSTANCE_SELECTED : 0);
+		record.tint = object->isSelected() ? WorldObject::TINT_SELECT : object->tintCode();
+	}
+
+	int ObjectCluster::cull(const Frustum *frustum, bool merged) {
+
+		sync();
+
+		int frustumHits = 0;
+
+		vBatchedCells.clear();
+
+		if (frustum != nullptr) {
+
+			if (bCellsDirty) buildCells();
+
+			mCuller.setFrustum(*frustum);
+			mCuller.clear();
+			vCullIndex.clear();
+			vVisibleIndex.clear();
+
+			auto test = [this](size_t index) {
+				const InstanceRecord_t &record = vRecords[index];
+				mCuller.add(record.pos / 1000.0F, record.radius);
+				vCullIndex.push_back(index);
+			};
+
+			auto accept = [this](const InstanceCell_t &cell) {
+				const size_t *members = mCells.members(cell);
+				vVisibleIndex.insert(vVisibleIndex.end(), members, members + (cell.end - cell.start));
+			};
+
+			// static objects: the whole cluster, then every cell, are accepted or rejected at once
+			const CullResult_t cluster = mCells.empty() ? CULL_OUTSIDE : mCuller.classify(mCells.min(), mCells.max());
+
+			// visible cells drawn merged take all their objects, even those just outside
+			size_t mergedObjects = 0;
+
+			for (unsigned c = 0; c < mCells.cells().size(); c++) {
+				const InstanceCell_t &cell = mCells.cells()[c];
+				const CullResult_t result = cluster == CULL_INTERSECT ? mCuller.classify(cell.min, cell.max) : cluster;
+				if (result != CULL_OUTSIDE && hidden(cell.min, cell.max)) continue;
+				if (result != CULL_OUTSIDE && merged && batchable(cell)) {
+					vBatchedCells.push_back(c);
+					mergedObjects += cell.end - cell.start;
+				} else if (result == CULL_INSIDE) accept(cell);
+				else if (result == CULL_INTERSECT)
+					for (unsigned i = 0; i < cell.end - cell.start; i++) test(mCells.members(cell)[i]);
+				else if (cluster == CULL_OUTSIDE) break;
+			}
+
+			// moving objects one by one in a batch
+			for (size_t index = 0; index < vRecords.size(); index++)
+				if (!(vRecords[index].flags & INSTANCE_STATIC)) test(index);
+
+			mCuller.cull(&vCulled);
+			for (size_t sphere : vCulled) vVisibleIndex.push_back(vCullIndex[sphere]);
+
+			// and what the frustum leaves, unless it is behind the terrain or the big objects
+			if (pOcclusion != nullptr || pHorizon != nullptr) {
+				size_t kept = 0;
+				for (size_t index : vVisibleIndex) {
+					const InstanceRecord_t &record = vRecords[index];
+					const glm::vec3 center = record.pos / 1000.0F;
+					const float radius = record.radius;
+					if (!hidden(center - radius, center + radius)) vVisibleIndex[kept++] = index;
+				}
+				vVisibleIndex.resize(kept);
+			}
+
+			frustumHits = static_cast<int>(vInstances.size() - vVisibleIndex.size() - mergedObjects);
+
+		} else {
+			vVisibleIndex.resize(vInstances.size());
+			for (size_t index = 0; index < vInstances.size(); index++) vVisibleIndex[index] = index;
+		}
+
+		// the draw distance, the far objects, and the detail level of what remains
+		for (std::vector<size_t> &visible : vLodVisible) visible.clear();
+		if (pImpostors != nullptr) pImpostors->clear();
+
+		size_t kept = 0;
+
+		for (size_t index : vVisibleIndex) {
+
+			int lod = 0;
+
+			if (fPixelScale > 0) {
+
+				const InstanceRecord_t &record = vRecords[index];
+
+				const glm::vec3 d = record.pos - mEye;
+				const float distance = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+
+				if (fMaxDrawDistance > 0 && distance > fMaxDrawDistance) continue;
+
+				if (pImpostors != nullptr && fImpostorDistance > 0 && distance > fImpostorDistance) {
+					pImpostors->add(mEye, record.pos, record.rot.y, record.radius, record.tint);
+					continue;
+				}
+
+				if (vLods.size() > 1)
+					lod = selectLod(vLod[index], record.radius * 1000.0F / std::max(distance, 1.0F) * fPixelScale);
+			}
+
+			vLod[index] = static_cast<uint8_t>(lod);
+			vLodVisible[lod].push_back(index);
+			vVisibleIndex[kept++] = index;
+		}
+
+		frustumHits += static_cast<int>(vVisibleIndex.size() - kept - impostorCount());
+		vVisibleIndex.resize(kept);
+
+		vStale.clear();
+		mBatch.clear();
+
+		for (size_t index : vVisibleIndex) {
+
+			const InstanceRecord_t &record = vRecords[index];
+
+			const glm::vec3 &pos = record.pos, &rot = record.rot;
+			const float radius = record.radius;
+
+			// comparing 7 floats is much cheaper than the 3 rotations, and catches every way of moving an object
+			CachedTransform_t &cached = vTransforms[index];
+			if (!cached.valid || cached.pos != pos || cached.rot != rot || cached.radius != radius) {
+				cached.pos = pos;
+				cached.rot = rot;
+				cached.radius = radius;
+				cached.valid = true;
+				vStale.push_back(index);
+				mBatch.add(pos / 1000.0F, rot, radius);
+			}
+		}
+
+		// rebuild the stale matrices together
+		if (!vStale.empty()) {
+			vBuilt.resize(vStale.size());
+			mBatch.build(vBuilt.data(), &mPlacer);
+			for (size_t i = 0; i < vStale.size(); i++) vTransforms[vStale[i]].matrix = vBuilt[i];
+		}
+
+		nRebuilt += static_cast<int>(vStale.size());
+
+		return frustumHits;
+	}
+
+	int ObjectCluster::selectLod(int current, float pixels) const {
+
+		const int lods = static_cast<int>(vLods.size());
+		const float down = 1.0F - PLANET.lodHysteresis, up = 1.0F + PLANET.lodHysteresis;
+
+		// level l takes over below lodPixels / 2^(l-1): coarser once clearly under the switch, finer once clearly over
+		auto below = [this](int lod) { return PLANET.lodPixels / static_cast<float>(1 << (lod - 1)); };
+
+		int lod = std::min(current, lods - 1);
+		while (lod + 1 < lods && pixels < below(lod + 1) * down) lod++;
+		while (lod > 0 && pixels > below(lod) * up) lod--;
+
+		return lod;
+	}
+
+	bool ObjectCluster::batchable(const InstanceCell_t &cell) const {
+
+		const size_t *members = mCells.members(cell);
+
+		// the merged meshes have no tint
+		for (unsigned i = 0; i < cell.end - cell.start; i++)
+			if (vRecords[members[i]].tint != WorldObject::TINT_NONE) return false;
+
+		if (fPixelScale <= 0) return true;
+
+		// judged from the nearest point of the cell, where its objects look biggest
+		const glm::vec3 eye = mEye / 1000.0F;
+		const glm::vec3 nearest = {std::min(std::max(eye.x, cell.min.x), cell.max.x),
+								   std::min(std::max(eye.y, cell.min.y), cell.max.y),
+								   std::min(std::max(eye.z, cell.min.z), cell.max.z)};
+		const glm::vec3 d = (nearest - eye) * 1000.0F;
+		const float distance = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+
+		if (fMaxDrawDistance > 0 && distance > fMaxDrawDistance) return false;
+		if (pImpostors != nullptr && fImpostorDistance > 0 && distance > fImpostorDistance) return false;
+
+		// only the full detail model is merged
+		return vLods.size() == 1 ||
+			   selectLod(0, vRecords[members[0]].radius * 1000.0F / std::max(distance, 1.0F) * fPixelScale) == 0;
+	}
+
+	void ObjectCluster::buildStatic() {
+
+		delete pStatic;
+
+		// matrices of the static objects, cell by cell
+		TransformBatch batch;
+		std::vector<size_t> order;
+
+		for (const InstanceCell_t &cell : mCells.cells()) {
+			for (unsigned i = 0; i < cell.end - cell.start; i++) {
+				const size_t index = mCells.members(cell)[i];
+				const InstanceRecord_t &record = vRecords[index];
+				batch.add(record.pos / 1000.0F, record.rot, record.radius);
+				order.push_back(index);
+			}
+		}
+
+		std::vector<glm::mat4> built(order.size()), transforms(vInstances.size());
+		if (!order.empty()) batch.build(built.data(), &mPlacer);
+		for (size_t i = 0; i < order.size(); i++) transforms[order[i]] = built[i];
+
+		pStatic = new StaticBatch(vLods[0], mCells, transforms);
+		bStaticDirty = false;
+
+		if (DBG) LogV(TAG, SF("%s: merged %zu static objects, %zu bytes", NAME.c_str(), order.size(), pStatic->bytes()));
+	}
+
+	void ObjectCluster::buildCells() {
+
+		std::vector<glm::vec4> spheres;
+		std::vector<size_t> indices;
+
+		for (size_t index = 0; index < vRecords.size(); index++) {
+			const InstanceRecord_t &record = vRecords[index];
+			if (record.flags & INSTANCE_STATIC) {
+				spheres.emplace_back(record.pos / 1000.0F, record.radius);
+				indices.push_back(index);
+			}
+		}
+
+		mCells.build(spheres, indices);
+		bCellsDirty = false;
+		bStaticDirty = true;
+
+		if (DBG) LogV(TAG, SF("%s: %zu cells, %zu moving objects", NAME.c_str(), mCells.cells().size(),
+							  vRecords.size() - indices.size()));
+	}
+
 	ObjectCluster::~ObjectCluster() {
-		delete pLoader;
+		for (ObjLoader *loader : vLods) delete loader;
+		delete pImpostors;
+		delete pStatic;
 		if (DBG) LogV(TAG, SF("Destroyed ObjectCluster %s", NAME.c_str()));
 	}
 
@@ -75,110 +425,189 @@ namespace Pix {
 
 		if (!bInited) init();
 
-		shader->setFloat("iTime", (float) Fu::METRONOME);
+		shader->setTime((float) Fu::METRONOME);
 
-		int frustumHits = 0;
+		nRebuilt = 0;
 
-		bool oneMesh = vMeshes.size() == 1;
+		if (shader->INSTANCED) {
+			renderInstanced(shader, camera);
+			return;
+		}
 
-		Frustum *frustum = camera->getFrustum();
+		const int frustumHits = cull(camera->getFrustum(), PLANET.staticBatching);
 
-		if (oneMesh) {
+		// the merged cells, one draw per material each
+		if (!vBatchedCells.empty()) {
 
-			constexpr int MESH = 0;
-			
-			Material& material = pLoader->material(MESH);
-			shader->loadMaterial(material);
-			shader->bindMaterial(material);
-			bind(0);
-		}
+			if (bStaticDirty) buildStatic();
 
-		for (WorldObject *object : vInstances) {
+			shader->loadTransformationMatrix(pStatic->identity());
+			shader->setTint(WorldObject::TINT_NONE);
 
-			// cache object properties
-			glm::vec3 rot = object->rot();
-			glm::vec3 pos = object->pos() / 1000.0F;
+			for (int i = 0; i < vLods[0]->meshCount(); i++) {
+				Material &material = vLods[0]->material(i);
+				shader->loadMaterial(material);
+				shader->bindMaterial(material);
+				for (unsigned cell : vBatchedCells) pStatic->draw(pStatic->mesh(cell, i));
+			}
+		}
 
-			float radius = object->drawRadius();
+		// every mesh of every detail level, set up once for all the objects that use it
+		for (int lod = 0; lod < vLods.size(); lod++) {
 
-			if (frustum == nullptr || frustum->IsBoxVisible(pos - radius, pos + radius)) {
+			if (vLodVisible[lod].empty()) continue;
 
-				// the object is visible, so transform its model to the desired rotation,
-				// position and radius
+			for (int i = 0; i < vLods[lod]->meshCount(); i++) {
 
-				glm::mat4 tmatrix = createTransformationMatrix(
-						pos, //CONFIG.position,
-						rot.x, rot.y, rot.z,
-						radius
-				);
+				const int mesh = vLodMesh[lod] + i;
+
+				Material &material = vLods[lod]->material(i);
+				shader->loadMaterial(material);
+				shader->bindMaterial(material);
+				bind(mesh);
 
-				if (oneMesh) {
+				for (size_t index : vLodVisible[lod]) {
 
-					// only one mesh
-					glm::mat4 result = tmatrix * mPlacer;
-					// load the transformation matrix
-					shader->loadTransformationMatrix(result);
+					// the model transformed to the object rotation, position and radius
+					shader->loadTransformationMatrix(vTransforms[index].matrix);
 
 					// Set object tint
-					shader->setTint(object->isSelected() ? WorldObject::TINT_SELECT:object->tintCode());
+					shader->setTint(vRecords[index].tint);
 
 					// VAO thunder
-					draw(0, false);
+					draw(mesh, false);
+				}
 
-				} else {
+				unbind();
+			}
+		}
 
-					Visible_t v = {object, tmatrix * mPlacer};
-					// save the transform matrix as we will use it several times to draw he individual meshes
-					vVisibles.emplace_back(v);
-				}
-			} else {
-				// we saved drawing this object
-				frustumHits++;
+		if (DBG) LogV(TAG, SF("Frustum Hits %d, rebuilt matrices %d", frustumHits, nRebuilt));
+	}
+
+	int ObjectCluster::collect(const Frustum *frustum) {
+
+		const int frustumHits = cull(frustum);
+
+		for (int lod = 0; lod < MAXLODS; lod++) {
+			mInstances[lod].clear();
+			for (size_t index : vLodVisible[lod]) mInstances[lod].add(vTransforms[index].matrix, vRecords[index].tint);
+		}
+
+		return frustumHits;
+	}
+
+	int ObjectCluster::enqueue(RenderQueue &queue, const Frustum *frustum, LightGrid *lights) {
+
+		if (!bInited) init();
+
+		nRebuilt = 0;
+
+		const int frustumHits = cull(frustum, PLANET.staticBatching);
+
+		// the merged cells, lit from their center
+		if (!vBatchedCells.empty() && bStaticDirty) buildStatic();
+
+		for (unsigned cell : vBatchedCells) {
+
+			const InstanceCell_t &bounds = mCells.cells()[cell];
+			const glm::vec3 center = (bounds.min + bounds.max) * 0.5F;
+			const int set = lights != nullptr ? lights->select(center) : -1;
+
+			for (int i = 0; i < vLods[0]->meshCount(); i++) {
+				const int mesh = pStatic->mesh(cell, i);
+				Material &material = vLods[0]->material(i);
+				queue.submit(queue.state(PASS_OBJECTS, &material, pStatic, mesh), center * 1000.0F,
+							 {nullptr, pStatic, mesh, &material, &pStatic->identity(), WorldObject::TINT_NONE, set});
 			}
 		}
 
-		if (oneMesh) {
-			unbind();
-			if (DBG) LogV(TAG, SF("Frustum Hits %d", frustumHits));
-			return;
+		// the lights of each object, shared by its meshes
+		vLightSets.resize(vInstances.size());
+		if (lights != nullptr)
+			for (size_t index : vVisibleIndex) vLightSets[index] = lights->select(vRecords[index].pos / 1000.0F);
+
+		for (int lod = 0; lod < vLods.size(); lod++) {
+
+			for (int i = 0; i < vLods[lod]->meshCount() && !vLodVisible[lod].empty(); i++) {
+
+				const int mesh = vLodMesh[lod] + i;
+				Material &material = vLods[lod]->material(i);
+				const uint64_t state = queue.state(PASS_OBJECTS, &material, this, mesh);
+
+				for (size_t index : vLodVisible[lod]) {
+					const InstanceRecord_t &record = vRecords[index];
+					queue.submit(state, record.pos, {nullptr, this, mesh, &material, &vTransforms[index].matrix, record.tint,
+													 lights != nullptr ? vLightSets[index] : -1});
+				}
+			}
 		}
 
-		// multi-mesh
-		// draw the meshes
+		if (DBG) LogV(TAG, SF("Queued %zu, merged cells %zu, Frustum Hits %d, rebuilt matrices %d", vVisibleIndex.size(),
+							  vBatchedCells.size(), frustumHits, nRebuilt));
+
+		return frustumHits;
+	}
+
+	void ObjectCluster::renderInstanced(ObjectShader *shader, Camera *camera) {
 
-		for (int i = 0; i < vMeshes.size(); i++) {
+		const int frustumHits = collect(camera->getFrustum());
 
-			Material& material = pLoader->material(i);
-			shader->loadMaterial(material);
-			shader->bindMaterial(material);
-			bind(i);
+		size_t drawn = 0;
 
-			for (Visible_t visible: vVisibles) {
+		// one draw per mesh of each detail level, every level reads its own instance buffer
+		for (int lod = 0; lod < vLods.size(); lod++) {
 
-				// load the transformation matrix
-				shader->loadTransformationMatrix(visible.transformMatrix);
+			InstanceBuffer &instances = mInstances[lod];
 
-				// Set object tint
-				shader->setTint(visible.object->isSelected() ? WorldObject::TINT_SELECT:visible.object->tintCode());
+			if (instances.empty()) continue;
 
-				// VAO thunder
-				draw(i, false);
+			instances.upload();
 
+			// the attribute setup is VAO state, once per level is enough, after its buffer exists
+			if (!bAttached[lod]) {
+				for (int mesh = vLodMesh[lod]; mesh < vLodMesh[lod + 1]; mesh++) {
+					bind(mesh);
+					instances.attach();
+					unbind();
+				}
+				bAttached[lod] = true;
 			}
-			unbind();
+
+			for (int i = 0; i < vLods[lod]->meshCount(); i++) {
+
+				Material &material = vLods[lod]->material(i);
+				shader->loadMaterial(material);
+				shader->bindMaterial(material);
+				bind(vLodMesh[lod] + i);
+
+				glDrawElementsInstanced(LayerVao::DRAWMODE, static_cast<GLsizei>(vLods[lod]->indicesCount(i)), GL_UNSIGNED_INT,
+										nullptr, static_cast<GLsizei>(instances.size()));
+
+				unbind();
+			}
+
+			drawn += instances.size();
 		}
-		vVisibles.clear();
-		if (DBG) LogV(TAG, SF("Frustum Hits %d", frustumHits));
+
+		if (DBG) LogV(TAG, SF("Instanced %zu, Frustum Hits %d, rebuilt matrices %d", drawn, frustumHits, nRebuilt));
+	}
+
+	void ObjectCluster::renderImpostors(Shader *shader) {
+		if (pImpostors != nullptr) pImpostors->draw(shader);
 	}
 
 	void ObjectCluster::init() {
 
-		for (int i = 0, l = pLoader->meshCount(); i < l; i++) {
-			LayerVao::add(
-					pLoader->vertices(i), pLoader->verticesCount(i),
-					pLoader->indices(i), pLoader->indicesCount(i)
-			);
-			pLoader->material(i).upload();
+		// all detail levels in the one VAO set, the meshes of level l start at vLodMesh[l]
+		for (ObjLoader *loader : vLods) {
+			for (int i = 0, l = loader->meshCount(); i < l; i++) {
+				LayerVao::add(
+						loader->vertices(i), loader->verticesCount(i),
+						loader->indices(i), loader->indicesCount(i)
+				);
+				loader->material(i).upload();
+			}
 		}
 		bInited = true;
 	}
@@ -11,6 +11,7 @@
 #include "ObjectShader.hpp"
 #include "Frustum.hpp"
 #include "Material.hpp"
+#include "InstanceBuffer.hpp"
 
 #include "glm/gtc/matrix_inverse.hpp"
 
@@ -19,14 +20,22 @@
 
 namespace Pix {
 
-	ObjectShader::ObjectShader(std::string name)
-	: LightingShader(name) {
+	ObjectShader::ObjectShader(std::string name, bool instanced)
+	: LightingShader(name), INSTANCED(instanced) {
 		// cache locators
 		LOC_TINTMODE = getLocator("tintMode");
 	}
 	
 	void ObjectShader::setTint(glm::vec4 tint) {
-		setVec4(LOC_TINTMODE, tint.x, tint.y, tint.z, tint.w);
+		uploadVec4(LOC_TINTMODE, tint.x, tint.y, tint.z, tint.w);
+	}
+
+	void ObjectShader::bindAttributes() {
+		WorldShader::bindAttributes();
+		if (INSTANCED) {
+			bindAttribute(InstanceBuffer::LOC_TRANSFORM, "instanceTransform");
+			bindAttribute(InstanceBuffer::LOC_TINT, "instanceTint");
+		}
 	}
 
 }
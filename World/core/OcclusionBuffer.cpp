@@ -0,0 +1,247 @@
+//
+//  OcclusionBuffer.cpp
+//  PixFu Engine
+//
+//  Occluder rasterizer and hi-Z tests.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "OcclusionBuffer.hpp"
+#include "Simd.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string OcclusionBuffer::TAG = "OcclusionBuffer";
+
+	OcclusionBuffer::OcclusionBuffer(int width, int height)
+			: WIDTH(width), HEIGHT(height), STRIDE((width + Simd::WIDTH - 1) / Simd::WIDTH * Simd::WIDTH) {
+
+		if (WIDTH < 1 || HEIGHT < 1) throw std::runtime_error("Occlusion buffer needs a size");
+
+		vDepth.assign(static_cast<size_t>(STRIDE) * HEIGHT, 0.0F);
+
+		vWidths.push_back(WIDTH);
+		vHeights.push_back(HEIGHT);
+
+		for (int w = WIDTH, h = HEIGHT; w > 1 || h > 1;) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			vWidths.push_back(w);
+			vHeights.push_back(h);
+			vLevels.emplace_back(static_cast<size_t>(w) * h, 0.0F);
+		}
+	}
+
+	void OcclusionBuffer::begin(const glm::mat4 &viewProjection, float near) {
+		mViewProjection = viewProjection;
+		fNear = near;
+		std::fill(vDepth.begin(), vDepth.end(), 0.0F);
+		nTriangles = nTested = nOccluded = 0;
+	}
+
+	glm::vec3 OcclusionBuffer::screen(const glm::vec4 &clip) const {
+		const float inv = 1.0F / clip.w;
+		return {(clip.x * inv * 0.5F + 0.5F) * WIDTH, (clip.y * inv * 0.5F + 0.5F) * HEIGHT, inv};
+	}
+
+	void OcclusionBuffer::addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+		draw(mViewProjection * glm::vec4(a, 1.0F), mViewProjection * glm::vec4(b, 1.0F), mViewProjection * glm::vec4(c, 1.0F));
+	}
+
+	void OcclusionBuffer::addMesh(const OccluderMesh_t &mesh) {
+
+		std::vector<glm::vec4> clip(mesh.vertices.size());
+		for (size_t i = 0; i < clip.size(); i++) clip[i] = mViewProjection * glm::vec4(mesh.vertices[i], 1.0F);
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			draw(clip[mesh.indices[i]], clip[mesh.indices[i + 1]], clip[mesh.indices[i + 2]]);
+	}
+
+	void OcclusionBuffer::addBox(const glm::vec3 &min, const glm::vec3 &max) {
+
+		glm::vec4 corner[8];
+		for (int i = 0; i < 8; i++)
+			corner[i] = mViewProjection * glm::vec4(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1.0F);
+
+		// two triangles per face, corners numbered by their max bits
+		static const int faces[6][4] = {{0, 1, 3, 2}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 3, 7, 5}};
+
+		for (const int *face : faces) {
+			draw(corner[face[0]], corner[face[1]], corner[face[2]]);
+			draw(corner[face[0]], corner[face[2]], corner[face[3]]);
+		}
+	}
+
+	void OcclusionBuffer::draw(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+
+		const glm::vec4 in[3] = {a, b, c};
+
+		// one plane clips a triangle to at most a quad
+		glm::vec4 out[4];
+		int count = 0;
+
+		for (int i = 0; i < 3; i++) {
+			const glm::vec4 &p = in[i], &q = in[(i + 1) % 3];
+			const bool pIn = p.w >= fNear, qIn = q.w >= fNear;
+			if (pIn) out[count++] = p;
+			if (pIn != qIn) out[count++] = p + (q - p) * ((fNear - p.w) / (q.w - p.w));
+		}
+
+		if (count < 3) return;
+
+		const glm::vec3 first = screen(out[0]);
+		for (int i = 1; i + 1 < count; i++) rasterize(first, screen(out[i]), screen(out[i + 1]));
+	}
+
+	void OcclusionBuffer::rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+
+		const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		if (!(fabsf(area) > 1e-6F)) return;
+
+		// the pixel centers in the bounds, clamped before converting so huge coordinates do not overflow
+		const float minX = std::min(std::min(a.x, b.x), c.x), maxX = std::max(std::max(a.x, b.x), c.x);
+		const float minY = std::min(std::min(a.y, b.y), c.y), maxY = std::max(std::max(a.y, b.y), c.y);
+
+		if (maxX < 0 || maxY < 0 || minX > WIDTH || minY > HEIGHT) return;
+
+		const int x0 = (int) ceilf(std::max(minX - 0.5F, 0.0F)), x1 = (int) floorf(std::min(maxX - 0.5F, WIDTH - 1.0F));
+		const int y0 = (int) ceilf(std::max(minY - 0.5F, 0.0F)), y1 = (int) floorf(std::min(maxY - 0.5F, HEIGHT - 1.0F));
+
+		if (x0 > x1 || y0 > y1) return;
+
+		nTriangles++;
+
+		// edge functions, positive inside whatever the winding
+		const float sign = area > 0 ? 1.0F : -1.0F;
+		const glm::vec3 *v[3] = {&a, &b, &c};
+		float A[3], B[3], C[3];
+
+		for (int i = 0; i < 3; i++) {
+			const glm::vec3 &p = *v[i], &q = *v[(i + 1) % 3];
+			A[i] = sign * (p.y - q.y);
+			B[i] = sign * (q.x - p.x);
+			C[i] = sign * (p.x * q.y - p.y * q.x);
+		}
+
+		// 1 / w is a plane on the screen
+		const float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+		const float dzdy = ((b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z)) / area;
+
+		static const float CENTERS[Simd::WIDTH] = {0.5F, 1.5F, 2.5F, 3.5F};
+		const Simd::float4 centers = Simd::load(CENTERS), zero(0.0F), stepZ(dzdx);
+		const Simd::float4 stepE0(A[0]), stepE1(A[1]), stepE2(A[2]);
+
+		for (int y = y0; y <= y1; y++) {
+
+			const float py = y + 0.5F;
+			const Simd::float4 rowE0(B[0] * py + C[0]), rowE1(B[1] * py + C[1]), rowE2(B[2] * py + C[2]);
+			const Simd::float4 rowZ(a.z + dzdy * (py - a.y) - dzdx * a.x);
+
+			float *row = &vDepth[static_cast<size_t>(y) * STRIDE];
+
+			for (int x = x0 & ~(Simd::WIDTH - 1); x <= x1; x += Simd::WIDTH) {
+
+				const Simd::float4 px = Simd::float4((float) x) + centers;
+
+				int outside = Simd::lessMask(stepE0 * px + rowE0, zero)
+							  | Simd::lessMask(stepE1 * px + rowE1, zero)
+							  | Simd::lessMask(stepE2 * px + rowE2, zero);
+
+				// lanes off the bounds, the buffer may be padded there
+				if (x < x0) outside |= (1 << (x0 - x)) - 1;
+				if (x + Simd::WIDTH - 1 > x1) outside |= (0xF << (x1 - x + 1)) & 0xF;
+
+				if (outside == 0xF) continue;
+
+				const Simd::float4 z = stepZ * px + rowZ;
+
+				if (outside == 0) {
+					Simd::store(row + x, Simd::max(Simd::load(row + x), z));
+				} else {
+					float lanes[Simd::WIDTH];
+					Simd::store(lanes, z);
+					for (int i = 0; i < Simd::WIDTH; i++)
+						if ((outside & (1 << i)) == 0) row[x + i] = std::max(row[x + i], lanes[i]);
+				}
+			}
+		}
+	}
+
+	void OcclusionBuffer::finish() {
+
+		for (size_t level = 1; level < vWidths.size(); level++) {
+
+			const int w = vWidths[level - 1], h = vHeights[level - 1], nw = vWidths[level], nh = vHeights[level];
+			std::vector<float> &texels = vLevels[level - 1];
+
+			for (int y = 0; y < nh; y++) {
+				const int y0 = 2 * y, y1 = std::min(2 * y + 1, h - 1);
+				for (int x = 0; x < nw; x++) {
+					const int x0 = 2 * x, x1 = std::min(2 * x + 1, w - 1);
+					texels[y * nw + x] = std::min(std::min(texel(level - 1, x0, y0), texel(level - 1, x1, y0)),
+												  std::min(texel(level - 1, x0, y1), texel(level - 1, x1, y1)));
+				}
+			}
+		}
+
+		if (DBG) LogV(TAG, SF("Rasterized %d occluder triangles", nTriangles));
+	}
+
+	bool OcclusionBuffer::visible(const glm::vec3 &min, const glm::vec3 &max) const {
+
+		nTested++;
+
+		float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, nearest = 0;
+
+		for (int i = 0; i < 8; i++) {
+
+			const glm::vec4 clip = mViewProjection * glm::vec4(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+															   i & 4 ? max.z : min.z, 1.0F);
+
+			// reaches the eye
+			if (clip.w < fNear) return true;
+
+			const glm::vec3 p = screen(clip);
+			minX = std::min(minX, p.x);
+			maxX = std::max(maxX, p.x);
+			minY = std::min(minY, p.y);
+			maxY = std::max(maxY, p.y);
+			nearest = std::max(nearest, p.z);
+		}
+
+		// off the screen, that is for the frustum to say
+		if (maxX < 0 || maxY < 0 || minX >= WIDTH || minY >= HEIGHT) return true;
+
+		const int x0 = (int) std::max(minX, 0.0F), x1 = (int) std::min(maxX, WIDTH - 1.0F);
+		const int y0 = (int) std::max(minY, 0.0F), y1 = (int) std::min(maxY, HEIGHT - 1.0F);
+
+		// the level where the rectangle spans at most 2x2 texels
+		int level = 0;
+		while (level + 1 < (int) vWidths.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+			level++;
+
+		float farthest = INFINITY;
+		for (int y = y0 >> level; y <= y1 >> level; y++)
+			for (int x = x0 >> level; x <= x1 >> level; x++)
+				farthest = std::min(farthest, texel(level, x, y));
+
+		if (nearest < farthest) {
+			nOccluded++;
+			return false;
+		}
+
+		return true;
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,189 @@
+//
+//  PixelCache.cpp
+//  PixFu Engine
+//
+//  On-disk cache of decoded images.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "PixelCache.hpp"
+#include "Utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "OCDFAInspection"
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string PixelCache::TAG = "PixelCache";
+
+	std::string PixelCache::sFolder;
+
+	static_assert(sizeof(PixelCacheHeader_t) <= 64, "PixelCache header does not fit before the pixels");
+
+	bool PixelCache::enable(const std::string &folder) {
+
+		if (mkdir(folder.c_str(), 0755) != 0 && errno != EEXIST) {
+			LogE(TAG, SF("Cannot create the cache folder %s: %s", folder.c_str(), strerror(errno)));
+			return false;
+		}
+
+		sFolder = folder;
+		if (DBG) LogV(TAG, SF("Caching decoded images in %s", folder.c_str()));
+		return true;
+	}
+
+	uint64_t PixelCache::hash(const void *data, size_t bytes, uint64_t seed) {
+		// FNV-1a
+		const auto *p = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < bytes; i++) seed = (seed ^ p[i]) * 0x100000001b3ULL;
+		return seed;
+	}
+
+	bool PixelCache::hashFile(const std::string &path, uint64_t &result) {
+
+		FILE *file = fopen(path.c_str(), "rb");
+		if (file == nullptr) return false;
+
+		uint8_t chunk[64 * 1024];
+		size_t bytes;
+		result = 0xcbf29ce484222325ULL;
+		while ((bytes = fread(chunk, 1, sizeof(chunk), file)) > 0) result = hash(chunk, bytes, result);
+
+		const bool ok = ferror(file) == 0;
+		fclose(file);
+		return ok;
+	}
+
+	std::string PixelCache::entry(const std::string &path) {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.pix",
+				 static_cast<unsigned long long>(hash(path.data(), path.size(), 0xcbf29ce484222325ULL)));
+		return sFolder + "/" + name;
+	}
+
+	Drawable *PixelCache::read(const std::string &entry, int64_t mtime, uint64_t size, const std::string &source) {
+
+		const int fd = open(entry.c_str(), O_RDONLY);
+		if (fd < 0) return nullptr;
+
+		struct stat st = {};
+		void *map = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > DATA_OFFSET)
+			map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map == MAP_FAILED) {
+			close(fd);
+			return nullptr;
+		}
+
+		PixelCacheHeader_t header;
+		memcpy(&header, map, sizeof(header));
+
+		const size_t bytes = static_cast<size_t>(header.width) * header.height * sizeof(Pixel);
+
+		bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+					 && header.version == VERSION
+					 && header.width > 0 && header.height > 0
+					 && static_cast<size_t>(st.st_size) == DATA_OFFSET + bytes
+					 && header.size == size;
+
+		// same size but touched: trust the content, and remember the new mtime
+		if (valid && header.mtime != mtime) {
+			uint64_t contents;
+			valid = hashFile(source, contents) && contents == header.hash;
+			if (valid) {
+				// best effort, a read-only cache still hits and only pays the hash again
+				header.mtime = mtime;
+				const int out = open(entry.c_str(), O_WRONLY);
+				if (out >= 0) {
+					if (pwrite(out, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) && DBG)
+						LogV(TAG, SF("Cannot update %s", entry.c_str()));
+					close(out);
+				}
+			}
+		}
+
+		Drawable *image = nullptr;
+
+		if (valid) {
+			image = new Drawable(header.width, header.height);
+			memcpy(image->getData(), static_cast<const uint8_t *>(map) + DATA_OFFSET, bytes);
+		}
+
+		munmap(map, static_cast<size_t>(st.st_size));
+		close(fd);
+		return image;
+	}
+
+	void PixelCache::write(const std::string &entry, PixelCacheHeader_t header, Drawable *image) {
+
+		// written aside and renamed, so concurrent loads never see a partial entry
+		std::string temp = entry + ".XXXXXX";
+		const int fd = mkstemp(&temp[0]);
+		if (fd < 0) {
+			LogE(TAG, SF("Cannot create %s: %s", temp.c_str(), strerror(errno)));
+			return;
+		}
+
+		uint8_t head[DATA_OFFSET] = {};
+		memcpy(head, &header, sizeof(header));
+
+		const size_t bytes = static_cast<size_t>(header.width) * header.height * sizeof(Pixel);
+		const bool ok = ::write(fd, head, DATA_OFFSET) == static_cast<ssize_t>(DATA_OFFSET)
+						&& ::write(fd, image->getData(), bytes) == static_cast<ssize_t>(bytes);
+
+		close(fd);
+
+		if (!ok || rename(temp.c_str(), entry.c_str()) != 0) {
+			LogE(TAG, SF("Cannot write %s", entry.c_str()));
+			unlink(temp.c_str());
+		}
+	}
+
+	Drawable *PixelCache::load(const std::string &path) {
+
+		struct stat st = {};
+		if (!enabled() || stat(path.c_str(), &st) != 0)
+			return Drawable::fromFile(path);
+
+		const std::string file = entry(path);
+		const auto mtime = static_cast<int64_t>(st.st_mtime);
+		const auto size = static_cast<uint64_t>(st.st_size);
+
+		Drawable *image = read(file, mtime, size, path);
+
+		if (image != nullptr) {
+			if (DBG) LogV(TAG, SF("Hit %s", path.c_str()));
+			return image;
+		}
+
+		image = Drawable::fromFile(path);
+
+		PixelCacheHeader_t header = {};
+		if (image != nullptr && hashFile(path, header.hash)) {
+			memcpy(header.magic, MAGIC, sizeof(MAGIC));
+			header.version = VERSION;
+			header.width = image->width;
+			header.height = image->height;
+			header.mtime = mtime;
+			header.size = size;
+			write(file, header, image);
+			if (DBG) LogV(TAG, SF("Stored %s", path.c_str()));
+		}
+
+		return image;
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,190 @@
+//
+//  RenderQueue.cpp
+//  PixFu Engine
+//
+//  Sorted draws of a frame.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "RenderQueue.hpp"
+#include "Terrain.hpp"
+#include "TerrainShader.hpp"
+#include "ObjectShader.hpp"
+#include "LightGrid.hpp"
+#include "Camera.hpp"
+#include "Fu.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string RenderQueue::TAG = "RenderQueue";
+
+	void RenderQueue::begin(const glm::vec3 &eye, float far) {
+		vItems.clear();
+		vKeys.clear();
+		mEye = eye;
+		fDepthScale = far > 0 ? static_cast<float>((1 << DEPTH_BITS) - 1) / far : 0;
+		bSorted = false;
+	}
+
+	uint64_t RenderQueue::state(RenderPass_t pass, const Material *material, const LayerVao *vao, int mesh) {
+
+		// ids are handed out on first sight, 0 is nothing
+		uint64_t materialId = 0, meshId = 0;
+
+		if (material != nullptr) {
+			auto found = mMaterialIds.find(material);
+			if (found == mMaterialIds.end()) found = mMaterialIds.emplace(material, mMaterialIds.size() + 1).first;
+			materialId = found->second;
+		}
+
+		if (vao != nullptr) {
+			auto found = mMeshIds.find({vao, mesh});
+			if (found == mMeshIds.end()) found = mMeshIds.emplace(std::make_pair(vao, mesh), mMeshIds.size() + 1).first;
+			meshId = found->second;
+		}
+
+		// past the field size the ids wrap: the order is still valid, only some state is set twice
+		return static_cast<uint64_t>(pass) << PASS_SHIFT
+			   | (materialId & ((UINT64_C(1) << MATERIAL_BITS) - 1)) << MATERIAL_SHIFT
+			   | (meshId & ((UINT64_C(1) << MESH_BITS) - 1)) << MESH_SHIFT;
+	}
+
+	void RenderQueue::submit(uint64_t state, const glm::vec3 &posWorld, const DrawItem_t &item) {
+
+		const glm::vec3 d = posWorld - mEye;
+		const float depth = std::min(sqrtf(d.x * d.x + d.y * d.y + d.z * d.z) * fDepthScale,
+									 static_cast<float>((1 << DEPTH_BITS) - 1));
+
+		vKeys.push_back(state | static_cast<uint64_t>(depth));
+		vItems.push_back(item);
+		bSorted = false;
+	}
+
+	void RenderQueue::submit(Terrain *terrain, float distance) {
+
+		const float depth = std::min(distance * fDepthScale, static_cast<float>((1 << DEPTH_BITS) - 1));
+
+		vKeys.push_back(state(PASS_TERRAIN, nullptr, nullptr, 0) | static_cast<uint64_t>(depth));
+		vItems.push_back({terrain, nullptr, 0, nullptr, nullptr, {0, 0, 0, 0}, -1});
+		bSorted = false;
+	}
+
+	void RenderQueue::sort() {
+
+		const size_t n = vKeys.size();
+
+		vOrder.resize(n);
+		for (size_t i = 0; i < n; i++) vOrder[i] = static_cast<uint32_t>(i);
+
+		vKeysScratch.resize(n);
+		vOrderScratch.resize(n);
+
+		// the histograms of the 8 bytes in one read
+		static constexpr int BYTES = 8;
+		size_t counts[BYTES][256] = {};
+
+		for (uint64_t key : vKeys)
+			for (int b = 0; b < BYTES; b++) counts[b][(key >> (b * 8)) & 0xFF]++;
+
+		for (int b = 0; b < BYTES; b++) {
+
+			const int shift = b * 8;
+
+			// all keys share this byte: nothing to move
+			if (n == 0 || counts[b][(vKeys[0] >> shift) & 0xFF] == n) continue;
+
+			size_t offset = 0;
+			for (size_t &count : counts[b]) {
+				const size_t c = count;
+				count = offset;
+				offset += c;
+			}
+
+			for (size_t i = 0; i < n; i++) {
+				const size_t to = counts[b][(vKeys[i] >> shift) & 0xFF]++;
+				vKeysScratch[to] = vKeys[i];
+				vOrderScratch[to] = vOrder[i];
+			}
+
+			vKeys.swap(vKeysScratch);
+			vOrder.swap(vOrderScratch);
+		}
+
+		bSorted = true;
+	}
+
+	void RenderQueue::range(RenderPass_t pass, size_t &first, size_t &last) const {
+		const uint64_t from = static_cast<uint64_t>(pass) << PASS_SHIFT, to = from + (UINT64_C(1) << PASS_SHIFT);
+		first = std::lower_bound(vKeys.begin(), vKeys.end(), from) - vKeys.begin();
+		last = std::lower_bound(vKeys.begin(), vKeys.end(), to) - vKeys.begin();
+	}
+
+	void RenderQueue::execute(TerrainShader *shader, Camera *camera) {
+
+		if (!bSorted) sort();
+
+		size_t first, last;
+		range(PASS_TERRAIN, first, last);
+
+		for (size_t i = first; i < last; i++) vItems[vOrder[i]].terrain->render(shader, camera);
+	}
+
+	void RenderQueue::execute(ObjectShader *shader, const LightGrid *lights) {
+
+		if (!bSorted) sort();
+
+		size_t first, last;
+		range(PASS_OBJECTS, first, last);
+
+		nMaterialChanges = nMeshChanges = nLightChanges = 0;
+
+		const Material *material = nullptr;
+		LayerVao *vao = nullptr;
+		int mesh = -1, set = -1;
+
+		for (size_t i = first; i < last; i++) {
+
+			const DrawItem_t &item = vItems[vOrder[i]];
+
+			if (item.material != material) {
+				shader->loadMaterial(*item.material);
+				shader->bindMaterial(*item.material);
+				material = item.material;
+				nMaterialChanges++;
+			}
+
+			if (item.vao != vao || item.mesh != mesh) {
+				if (vao != nullptr) vao->unbind();
+				item.vao->bind(item.mesh);
+				vao = item.vao;
+				mesh = item.mesh;
+				nMeshChanges++;
+			}
+
+			if (lights != nullptr && item.lights >= 0 && item.lights != set) {
+				lights->load(shader, item.lights);
+				set = item.lights;
+				nLightChanges++;
+			}
+
+			shader->loadTransformationMatrix(*item.transform);
+			shader->setTint(item.tint);
+			vao->draw(mesh, false);
+		}
+
+		if (vao != nullptr) vao->unbind();
+
+		if (DBG) LogV(TAG, SF("Drew %zu objects, %d material, %d mesh and %d light changes", last - first,
+							  nMaterialChanges, nMeshChanges, nLightChanges));
+	}
+
+}
+
+#pragma clang diagnostic pop
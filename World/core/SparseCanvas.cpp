@@ -0,0 +1,373 @@
+//
+//  SparseCanvas.cpp
+//  PixFu Engine
+//
+//  Terrain canvas stored in tiles allocated on first write.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "SparseCanvas.hpp"
+#include "PixelBlend.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string SparseCanvas::TAG = "SparseCanvas";
+
+	SparseCanvas::SparseCanvas(int width, int height, float resolution, Font *font)
+			: TerrainCanvas(new Drawable(SCRATCH_WIDTH, SCRATCH_HEIGHT), font),
+			  WIDTH(width), HEIGHT(height),
+			  SCALE(resolution),
+			  SWIDTH(std::max(1, static_cast<int>(ceilf(width * resolution)))),
+			  SHEIGHT(std::max(1, static_cast<int>(ceilf(height * resolution)))),
+			  COLS((SWIDTH + TILE - 1) / TILE),
+			  ROWS((SHEIGHT + TILE - 1) / TILE),
+			  pBlank(new Texture2D(new Drawable(1, 1))) {
+
+		if (resolution <= 0 || resolution > 1)
+			throw std::runtime_error("Canvas resolution must be in (0, 1]");
+
+		pBlank->buffer()->setPixel(0, 0, Colors::BLANK);
+		pScratch = buffer();
+		vTiles.resize(COLS * ROWS, nullptr);
+		vPending.resize(COLS * ROWS, false);
+	}
+
+	SparseCanvas::~SparseCanvas() {
+		for (Pixel *tile : vTiles) delete[] tile;
+		if (mTexture != 0) glDeleteTextures(1, &mTexture);
+		delete pBlank;
+		delete pScratch;
+	}
+
+	Pixel *SparseCanvas::tile(int col, int row) {
+
+		const int index = row * COLS + col;
+		Pixel *&tile = vTiles[index];
+
+		if (tile == nullptr) {
+			tile = new Pixel[TILE * TILE];
+			std::fill(tile, tile + TILE * TILE, Colors::BLANK);
+			nTiles++;
+		}
+
+		queue(index);
+
+		return tile;
+	}
+
+	void SparseCanvas::queue(int index) {
+		if (!vPending[index]) {
+			vPending[index] = true;
+			qPending.push_back(index);
+		}
+	}
+
+	void SparseCanvas::invalidate(int x0, int y0, int x1, int y1) {
+
+		// tiles are queued as they are touched, but the decal layer does not go through them
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, SWIDTH);
+		y1 = std::min(y1, SHEIGHT);
+
+		for (int row = y0 / TILE; row * TILE < y1; row++)
+			for (int col = x0 / TILE; col * TILE < x1; col++)
+				queue(row * COLS + col);
+	}
+
+	void SparseCanvas::span(int x0, int x1, int y, Pixel p) {
+
+		if (y < 0 || y >= SHEIGHT) return;
+
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, SWIDTH - 1);
+
+		// one tile at a time
+		while (x0 <= x1) {
+			const int col = x0 / TILE, end = std::min(x1, col * TILE + TILE - 1);
+			Pixel *row = tile(col, y / TILE) + (y % TILE) * TILE;
+			std::fill(row + x0 % TILE, row + end % TILE + 1, p);
+			x0 = end + 1;
+		}
+	}
+
+	void SparseCanvas::blendSpan(int x0, int x1, int y, Pixel color) {
+
+		if (y < 0 || y >= SHEIGHT || color.a == 0) return;
+
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, SWIDTH - 1);
+
+		while (x0 <= x1) {
+			const int col = x0 / TILE, end = std::min(x1, col * TILE + TILE - 1);
+			Pixel *row = tile(col, y / TILE) + (y % TILE) * TILE;
+			Pix::blendSpan(row + x0 % TILE, end - x0 + 1, color);
+			x0 = end + 1;
+		}
+	}
+
+	void SparseCanvas::fadeSpan(int x0, int x1, int y, uint32_t factor) {
+
+		if (y < 0 || y >= SHEIGHT) return;
+
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, SWIDTH - 1);
+
+		// never allocates: there is nothing to fade in a missing tile
+		while (x0 <= x1) {
+			const int col = x0 / TILE, end = std::min(x1, col * TILE + TILE - 1);
+			if (vTiles[(y / TILE) * COLS + col] != nullptr) {
+				Pixel *row = tile(col, y / TILE) + (y % TILE) * TILE;
+				Pix::fadeSpan(row + x0 % TILE, end - x0 + 1, factor);
+			}
+			x0 = end + 1;
+		}
+	}
+
+	void SparseCanvas::line(int x1, int y1, int x2, int y2, Pixel p, uint32_t pattern) {
+
+		const int dx = abs(x2 - x1), dy = -abs(y2 - y1);
+		const int sx = x1 < x2 ? 1 : -1, sy = y1 < y2 ? 1 : -1;
+
+		for (int error = dx + dy;;) {
+
+			pattern = (pattern << 1) | (pattern >> 31);
+			if (pattern & 1) plot(x1, y1, p);
+
+			if (x1 == x2 && y1 == y2) break;
+
+			const int e2 = 2 * error;
+			if (e2 >= dy) {
+				error += dy;
+				x1 += sx;
+			}
+			if (e2 <= dx) {
+				error += dx;
+				y1 += sy;
+			}
+		}
+	}
+
+	void SparseCanvas::setPixel(int32_t x, int32_t y, Pixel p) {
+		plot(toStorage(x), toStorage(y), p);
+	}
+
+	void SparseCanvas::drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p, uint32_t pattern) {
+		line(toStorage(x1), toStorage(y1), toStorage(x2), toStorage(y2), p, pattern);
+	}
+
+	void SparseCanvas::drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask) {
+
+		const int cx = toStorage(x), cy = toStorage(y);
+		const int r = static_cast<int>(roundf(radius * SCALE));
+
+		if (r <= 0) {
+			plot(cx, cy, p);
+			return;
+		}
+
+		// midpoint circle, one bit of the mask per octant
+		for (int x0 = 0, y0 = r, d = 3 - 2 * r; y0 >= x0;) {
+
+			if (mask & 0x01) plot(cx + x0, cy - y0, p);
+			if (mask & 0x04) plot(cx + y0, cy + x0, p);
+			if (mask & 0x10) plot(cx - x0, cy + y0, p);
+			if (mask & 0x40) plot(cx - y0, cy - x0, p);
+
+			if (x0 != 0 && x0 != y0) {
+				if (mask & 0x02) plot(cx + y0, cy - x0, p);
+				if (mask & 0x08) plot(cx + x0, cy + y0, p);
+				if (mask & 0x20) plot(cx - y0, cy + x0, p);
+				if (mask & 0x80) plot(cx - x0, cy - y0, p);
+			}
+
+			if (d < 0) d += 4 * x0++ + 6;
+			else d += 4 * (x0++ - y0--) + 10;
+		}
+	}
+
+	void SparseCanvas::fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p) {
+
+		const int cx = toStorage(x), cy = toStorage(y);
+		const int r = static_cast<int>(roundf(radius * SCALE));
+
+		for (int dy = -r; dy <= r; dy++) {
+			const int half = static_cast<int>(sqrtf(static_cast<float>(r * r - dy * dy)));
+			span(cx - half, cx + half, cy + dy, p);
+		}
+	}
+
+	void SparseCanvas::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) {
+		const int x0 = toStorage(x), y0 = toStorage(y), x1 = toStorage(x + w), y1 = toStorage(y + h);
+		span(x0, x1, y0, p);
+		span(x0, x1, y1, p);
+		line(x0, y0, x0, y1, p, 0xFFFFFFFF);
+		line(x1, y0, x1, y1, p, 0xFFFFFFFF);
+	}
+
+	void SparseCanvas::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) {
+		if (w <= 0 || h <= 0) return;
+		const int x0 = toStorage(x), y0 = toStorage(y);
+		const int x1 = std::max(x0, toStorage(x + w) - 1), y1 = std::max(y0, toStorage(y + h) - 1);
+		for (int row = y0; row <= y1; row++) span(x0, x1, row, p);
+	}
+
+	void SparseCanvas::drawString(int32_t x, int32_t y, const std::string &text, Pixel col, uint32_t scale) {
+
+		// glyphs are rendered by Canvas2D in the scratch area, then copied to the tiles
+		scale = std::min(scale, static_cast<uint32_t>(SCRATCH_HEIGHT / 8));
+		const int glyph = 8 * static_cast<int>(scale);
+		const int perPass = SCRATCH_WIDTH / glyph;
+
+		int lines = 0;
+		for (size_t start = 0; start <= text.size(); lines++) {
+
+			size_t end = text.find('\n', start);
+			if (end == std::string::npos) end = text.size();
+
+			for (size_t chunk = start; chunk < end; chunk += perPass) {
+
+				const std::string piece = text.substr(chunk, std::min(end - chunk, (size_t) perPass));
+				const int ox = x + static_cast<int>(chunk - start) * glyph, oy = y + lines * glyph;
+
+				Canvas2D::blank();
+				Canvas2D::drawString(0, 0, piece, col, scale);
+
+				for (int py = 0; py < glyph; py++)
+					for (int px = 0, l = static_cast<int>(piece.size()) * glyph; px < l; px++) {
+						const Pixel p = pScratch->getPixel(px, py);
+						if (p.a != 0) plot(toStorage(ox + px), toStorage(oy + py), p);
+					}
+			}
+
+			start = end + 1;
+		}
+	}
+
+	void SparseCanvas::clear(Pixel p) {
+		if (p.n == Colors::BLANK.n) {
+			blank();
+			return;
+		}
+		for (int row = 0; row < SHEIGHT; row++) span(0, SWIDTH - 1, row, p);
+	}
+
+	void SparseCanvas::blank() {
+
+		// freed tiles upload as blank, if the GPU ever had them
+		for (int i = 0, l = (int) vTiles.size(); i < l; i++) {
+			if (vTiles[i] == nullptr) continue;
+			delete[] vTiles[i];
+			vTiles[i] = nullptr;
+			if (mTexture != 0) queue(i);
+		}
+
+		nTiles = 0;
+	}
+
+	void SparseCanvas::init() {
+
+		// a new context: the textures of the old one are gone
+		pBlank->upload();
+		mTexture = 0;
+
+		// the canvas texture is created again on the first upload with something to show
+		for (int i = 0, l = (int) vTiles.size(); i < l; i++) {
+			const int x0 = (i % COLS) * TILE, y0 = (i / COLS) * TILE;
+			if (vTiles[i] != nullptr || (pLayer != nullptr && pLayer->covers(x0, y0, x0 + TILE, y0 + TILE))) queue(i);
+		}
+	}
+
+	void SparseCanvas::createTexture() {
+
+		glGenTextures(1, &mTexture);
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SWIDTH, SHEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		// texture storage starts undefined
+		std::vector<Pixel> blank(SWIDTH * TILE, Colors::BLANK);
+		for (int y = 0; y < SHEIGHT; y += TILE)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, SWIDTH, std::min(TILE, SHEIGHT - y),
+							GL_RGBA, GL_UNSIGNED_BYTE, blank.data());
+
+		if (DBG) LogV(TAG, SF("Created canvas texture %dx%d", SWIDTH, SHEIGHT));
+	}
+
+	size_t SparseCanvas::upload(size_t budget) {
+
+		if (qPending.empty()) return 0;
+
+		if (mTexture == 0) createTexture();
+		else glBindTexture(GL_TEXTURE_2D, mTexture);
+
+		static const std::vector<Pixel> BLANK(TILE * TILE, Colors::BLANK);
+		constexpr size_t TILEBYTES = TILE * TILE * sizeof(Pixel);
+
+		size_t bytes = 0;
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, TILE);
+
+		// at least one tile per call, so the queue makes progress
+		while (!qPending.empty() && (bytes == 0 || bytes + TILEBYTES <= budget)) {
+
+			const int index = qPending.front();
+			qPending.pop_front();
+			vPending[index] = false;
+
+			const int col = index % COLS, row = index / COLS;
+			const Pixel *data = vTiles[index] != nullptr ? vTiles[index] : BLANK.data();
+
+			// fading decals go over a copy, the tile keeps what is below them
+			const int x0 = col * TILE, y0 = row * TILE;
+			if (pLayer != nullptr && pLayer->covers(x0, y0, x0 + TILE, y0 + TILE)) {
+				vComposed.assign(data, data + TILE * TILE);
+				pLayer->compose(x0, y0, x0 + TILE, y0 + TILE, vComposed.data(), TILE);
+				data = vComposed.data();
+			}
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0,
+							std::min(TILE, SWIDTH - col * TILE), std::min(TILE, SHEIGHT - row * TILE),
+							GL_RGBA, GL_UNSIGNED_BYTE, data);
+
+			bytes += TILEBYTES;
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		return bytes;
+	}
+
+	void SparseCanvas::bind(Shader *shader, const std::string &sampler) {
+
+		if (mTexture == 0) {
+			shader->textureUnit(sampler, pBlank);
+			return;
+		}
+
+		glActiveTexture(GL_TEXTURE0 + pBlank->unit());
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		shader->setInt(sampler, static_cast<int>(pBlank->unit()));
+	}
+
+	size_t SparseCanvas::bytes() {
+		return nTiles * TILE * TILE * sizeof(Pixel)
+			   + (mTexture != 0 ? SWIDTH * SHEIGHT * sizeof(Pixel) : 0)
+			   + SCRATCH_WIDTH * SCRATCH_HEIGHT * sizeof(Pixel)
+			   + (pLayer != nullptr ? pLayer->bytes() : 0);
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,85 @@
+//
+//  StaticBatch.cpp
+//  PixFu Engine
+//
+//  Static objects merged per cell.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "StaticBatch.hpp"
+#include "Utils.hpp"
+
+#include <cmath>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string StaticBatch::TAG = "StaticBatch";
+
+	StaticBatch::StaticBatch(ObjLoader *model, const InstanceGrid &cells, const std::vector<glm::mat4> &transforms)
+			: MESHES(static_cast<int>(model->meshCount())), mIdentity(1.0F) {
+
+		std::vector<float> vertices;
+		std::vector<unsigned> indices;
+
+		for (const InstanceCell_t &cell : cells.cells()) {
+
+			const size_t *members = cells.members(cell);
+			const unsigned count = cell.end - cell.start;
+
+			for (int m = 0; m < MESHES; m++) {
+
+				const float *source = model->vertices(m);
+				const unsigned *sourceIndices = model->indices(m);
+				const unsigned sourceVertices = model->verticesCount(m), sourceIndicesCount = model->indicesCount(m);
+
+				vertices.resize(static_cast<size_t>(count) * sourceVertices * FLOATS);
+				indices.resize(static_cast<size_t>(count) * sourceIndicesCount);
+
+				float *out = vertices.data();
+				unsigned *outIndices = indices.data();
+
+				for (unsigned o = 0; o < count; o++) {
+
+					const glm::mat4 &M = transforms[members[o]];
+
+					for (unsigned v = 0; v < sourceVertices; v++, out += FLOATS) {
+
+						const float *in = source + v * FLOATS;
+
+						// objects scale uniformly, so the normals turn with the upper 3x3 and only need normalizing
+						const float nx = M[0][0] * in[3] + M[1][0] * in[4] + M[2][0] * in[5],
+								ny = M[0][1] * in[3] + M[1][1] * in[4] + M[2][1] * in[5],
+								nz = M[0][2] * in[3] + M[1][2] * in[4] + M[2][2] * in[5];
+						const float length = sqrtf(nx * nx + ny * ny + nz * nz), inv = length > 0 ? 1.0F / length : 0;
+
+						out[0] = M[0][0] * in[0] + M[1][0] * in[1] + M[2][0] * in[2] + M[3][0];
+						out[1] = M[0][1] * in[0] + M[1][1] * in[1] + M[2][1] * in[2] + M[3][1];
+						out[2] = M[0][2] * in[0] + M[1][2] * in[1] + M[2][2] * in[2] + M[3][2];
+						out[3] = nx * inv;
+						out[4] = ny * inv;
+						out[5] = nz * inv;
+						out[6] = in[6];
+						out[7] = in[7];
+					}
+
+					const unsigned base = o * sourceVertices;
+					for (unsigned i = 0; i < sourceIndicesCount; i++) *outIndices++ = sourceIndices[i] + base;
+				}
+
+				LayerVao::add(vertices.data(), static_cast<unsigned>(vertices.size() / FLOATS),
+							  indices.data(), static_cast<unsigned>(indices.size()));
+
+				nBytes += vertices.size() * sizeof(float) + indices.size() * sizeof(unsigned);
+			}
+		}
+
+		if (DBG) LogV(TAG, SF("Merged %zu cells, %zu bytes", cells.cells().size(), nBytes));
+	}
+
+}
+
+#pragma clang diagnostic pop
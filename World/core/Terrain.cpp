@@ -12,6 +12,8 @@
 #include "Terrain.hpp"
 #include "Config.hpp"
 #include "Fu.hpp"
+#include "Camera.hpp"
+#include "PixelCache.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCSimplifyInspection"
@@ -23,44 +25,251 @@ namespace Pix {
 	std::string Terrain::TAG = "Terrain";
 	constexpr int MESH = 0;
 
-	Terrain::Terrain(WorldConfig_t planetConfig, TerrainConfig_t config)
+	Terrain::Terrain(WorldConfig_t planetConfig, TerrainConfig_t config, bool deferred)
 			: CONFIG(config), PLANET(std::move(planetConfig)) {
 
+		mSize = CONFIG.size;
+
+		// heightmap generated meshes are built in world axes, they do not need the terrain transform
+		mTransform = createTransformationMatrix(
+				{CONFIG.origin.x / 1000.0F, 0, CONFIG.origin.y / 1000.0F},
+				0, 0, 0, 1, false, false, false)
+					 * (CONFIG.meshFromHeightmap ? glm::mat4(1.0F) : PLANET.terrainTransform.toMatrix());
+
+		if (deferred) {
+			if (mSize.x <= 0 || mSize.y <= 0)
+				throw std::runtime_error("Streamed terrain " + CONFIG.name + " needs a size");
+		} else {
+			adopt(load(CONFIG, mSize, true, true));
+		}
+
+		if (DBG) LogV(TAG, SF("Created terrain %s", config.name.c_str()));
+	};
+
+	Terrain::~Terrain() {
+		release(TERRAIN_UNLOADED);
+		if (DBG) LogV(TAG, SF("Destroyed terrain %s", CONFIG.name.c_str()));
+	}
+
+	TerrainResources_t Terrain::load(const TerrainConfig_t &config, glm::vec2 size, bool heights, bool render) {
+
+		TerrainResources_t resources;
+		resources.size = size;
+
 		std::string path = std::string(PATH_LEVELS) + "/" + config.name;
 
-		// load resources
-		pLoader = new ObjLoader(path + "/" + config.name + ".obj");
-	
-		// at the moment terrain is single mesh
-		pLoader->material(MESH).init(config.name, std::string(PATH_LEVELS));
+		if (render && config.meshFromHeightmap) {
 
-		pHeightMap = Drawable::fromFile(path + "/" + config.name + ".heights.png");
+			// no model to parse: the texture determines the map size, and the heightmap the mesh
+			resources.material = new Material();
+			resources.material->name = config.name;
+			resources.material->Ka = {1, 1, 1};
+			resources.material->Kd = {1, 1, 1};
+			resources.material->Ks = {0, 0, 0};
+			resources.material->illum = 1;
+			resources.material->map_Kd = config.name + ".png";
+			resources.material->init(config.name, std::string(PATH_LEVELS));
 
-		// first texture determines the map size
-		Texture2D *t= pLoader->material(0).textureKd;
-		mSize = {t->width(), t->height()};
+			Texture2D *t = resources.material->textureKd;
+			resources.size = {t->width(), t->height()};
 
-		// 3d canvas
-		if (PLANET.withCanvas) {
-			pDirtTexture = new Texture2D(new Drawable(static_cast<int>(mSize.x), static_cast<int>(mSize.y)));
-			pDirtCanvas = new Canvas2D(pDirtTexture->buffer(), new Font(PLANET.withFont));
-			pDirtCanvas->blank();
-			if (PLANET.debugMode == DEBUG_GRID) wireframe();
+		} else if (render) {
+
+			// load resources
+			resources.loader = new ObjLoader(path + "/" + config.name + ".obj");
+
+			// at the moment terrain is single mesh
+			resources.loader->material(MESH).init(config.name, std::string(PATH_LEVELS));
+
+			// first texture determines the map size
+			Texture2D *t = resources.loader->material(0).textureKd;
+			resources.size = {t->width(), t->height()};
 		}
 
+		if (heights || resources.material != nullptr) {
+			// the heightmap is only kept as a min/max pyramid, that also serves the ray casts
+			Drawable *heightMap = PixelCache::load(path + "/" + config.name + ".heights.png");
+			if (heightMap == nullptr) {
+				delete resources.loader;
+				delete resources.material;
+				throw std::runtime_error("Cannot load the heightmap of terrain " + config.name);
+			}
+			resources.heights = new HeightPyramid(heightMap,
+												  static_cast<int>(resources.size.x), static_cast<int>(resources.size.y),
+												  config.scaleHeight * 1000 / 255.0F);
+			delete heightMap;
+		}
 
-		if (DBG) LogV(TAG, SF("Created terrain %s", config.name.c_str()));
-	};
+		if (resources.material != nullptr) {
+			resources.mesh = new TerrainMesh(resources.heights, resources.size, config.origin,
+											 config.meshStep, config.meshChunkSize, config.meshLods,
+											 config.meshLodDistance);
+			// adopt() discards the heights if the terrain already has them
+		}
 
-	Terrain::~Terrain() {
-		delete pLoader;
-		if (PLANET.withCanvas) {
+		return resources;
+	}
+
+	void Terrain::adopt(TerrainResources_t resources) {
+
+		if (mSize.x <= 0 || mSize.y <= 0) mSize = resources.size;
+
+		if (resources.heights != nullptr) {
+			if (pHeights == nullptr) pHeights = resources.heights;
+			else delete resources.heights;
+		}
+
+		if (resources.loader != nullptr || resources.mesh != nullptr) {
+
+			if (residency() == TERRAIN_RESIDENT) {
+				delete resources.loader;
+				delete resources.mesh;
+				delete resources.material;
+				return;
+			}
+
+			pLoader = resources.loader;
+			pChunks = resources.mesh;
+			pMaterial = resources.material;
+
+			// 3d canvas
+			if (PLANET.withCanvas) {
+				const int width = static_cast<int>(mSize.x), height = static_cast<int>(mSize.y);
+				Font *font = new Font(PLANET.withFont);
+				pDirtCanvas = PLANET.sparseCanvas
+							  ? new SparseCanvas(width, height, PLANET.canvasResolution, font)
+							  : new TerrainCanvas(new Texture2D(new Drawable(width, height)), font);
+				pDirtCanvas->blank();
+				if (PLANET.debugMode == DEBUG_GRID) wireframe();
+			}
+		}
+	}
+
+	void Terrain::release(TerrainResidency_t residency) {
+
+		if (residency < TERRAIN_RESIDENT) {
+			delete pMesh;
+			vChunkBounds.clear();
+			delete pLoader;
+			delete pChunks;
+			delete pMaterial;
 			delete pDirtCanvas;
-			delete pDirtTexture;
+			pMesh = nullptr;
+			pLoader = nullptr;
+			pChunks = nullptr;
+			pMaterial = nullptr;
 			pDirtCanvas = nullptr;
-			pDirtTexture = nullptr;
+			mOccluder = {};
+			bInited = false;
 		}
-		if (DBG) LogV(TAG, SF("Destroyed terrain %s", CONFIG.name.c_str()));
+
+		if (residency < TERRAIN_HEIGHTS) {
+			delete pHeights;
+			pHeights = nullptr;
+		}
+	}
+
+	const OccluderMesh_t &Terrain::occluder() {
+		if (mOccluder.vertices.empty() && pChunks != nullptr && pHeights != nullptr) buildOccluder();
+		return mOccluder;
+	}
+
+	void Terrain::buildOccluder() {
+
+		// nodes no smaller than the coarsest mesh step: the mesh around a point comes from the 3x3 nodes around it
+		const int coarsest = CONFIG.meshStep << (CONFIG.meshLods - 1);
+
+		int level = 0;
+		while (level + 1 < pHeights->levels()
+			   && ((1 << level) < coarsest
+				   || std::max(pHeights->levelWidth(level), pHeights->levelHeight(level)) > OCCLUDER_NODES))
+			level++;
+
+		const int W = pHeights->levelWidth(level), H = pHeights->levelHeight(level), node = 1 << level;
+
+		// the lowest sample in the 3x3 nodes around every node
+		std::vector<float> low(W * H);
+
+		for (int z = 0; z < H; z++) {
+			for (int x = 0; x < W; x++) {
+				float lowest = INFINITY;
+				for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, H - 1); nz++)
+					for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, W - 1); nx++)
+						lowest = std::min(lowest, pHeights->minHeight(level, nx, nz));
+				low[z * W + x] = lowest;
+			}
+		}
+
+		// every corner under the 4 nodes that share it, so the triangles between stay under the surface
+		for (int z = 0; z <= H; z++) {
+			for (int x = 0; x <= W; x++) {
+				float lowest = INFINITY;
+				for (int nz = std::max(z - 1, 0); nz <= std::min(z, H - 1); nz++)
+					for (int nx = std::max(x - 1, 0); nx <= std::min(x, W - 1); nx++)
+						lowest = std::min(lowest, low[nz * W + nx]);
+				const int px = std::min(x * node, pHeights->levelWidth(0)), pz = std::min(z * node, pHeights->levelHeight(0));
+				mOccluder.vertices.emplace_back((CONFIG.origin.x + px) / 1000.0F, lowest / 1000.0F,
+												(CONFIG.origin.y + pz) / 1000.0F);
+			}
+		}
+
+		for (int z = 0; z < H; z++) {
+			for (int x = 0; x < W; x++) {
+				const unsigned corner = z * (W + 1) + x;
+				mOccluder.indices.insert(mOccluder.indices.end(), {corner, corner + W + 1, corner + 1,
+																   corner + 1, corner + W + 1, corner + W + 2});
+			}
+		}
+
+		if (DBG) LogV(TAG, SF("%s occluder: %dx%d nodes of %d pixels", CONFIG.name.c_str(), W, H, node));
+	}
+
+	bool Terrain::lowest(float xWorld, float zWorld, float size, float &height) const {
+
+		if (pChunks == nullptr || pHeights == nullptr) return false;
+
+		// the mesh around a point comes from the samples up to a coarsest step away, plus the sample itself
+		const int coarsest = CONFIG.meshStep << (CONFIG.meshLods - 1);
+		const float span = size + 2.0F * (coarsest + 1);
+
+		const float x0 = xWorld - CONFIG.origin.x - span * 0.5F, z0 = zWorld - CONFIG.origin.y - span * 0.5F;
+
+		if (x0 < 0 || z0 < 0 || x0 + span > pHeights->levelWidth(0) || z0 + span > pHeights->levelHeight(0)) return false;
+
+		// nodes at least as large as the span, so it touches at most 2x2 of them
+		int level = 0;
+		while (level + 1 < pHeights->levels() && (float) (1 << level) < span) level++;
+
+		const int W = pHeights->levelWidth(level), H = pHeights->levelHeight(level);
+
+		height = INFINITY;
+		for (int nz = (int) z0 >> level; nz <= std::min((int) (z0 + span) >> level, H - 1); nz++)
+			for (int nx = (int) x0 >> level; nx <= std::min((int) (x0 + span) >> level, W - 1); nx++)
+				height = std::min(height, pHeights->minHeight(level, nx, nz));
+
+		return true;
+	}
+
+	size_t Terrain::residentBytes() {
+
+		size_t bytes = pHeights != nullptr ? pHeights->bytes() : 0;
+
+		if (residency() == TERRAIN_RESIDENT) {
+
+			const auto pixels = static_cast<size_t>(mSize.x * mSize.y);
+
+			// mesh (CPU + GPU): objl vertices are 8 floats, indices are 32 bit
+			if (pLoader != nullptr)
+				bytes += 2 * (pLoader->verticesCount() * 8 * sizeof(float) + pLoader->indicesCount() * sizeof(unsigned));
+			else
+				bytes += pChunks->bytes();
+
+			// texture (CPU + GPU), RGBA
+			bytes += 2 * 4 * pixels;
+			if (pDirtCanvas != nullptr) bytes += pDirtCanvas->bytes();
+		}
+
+		return bytes;
 	}
 
 	void Terrain::wireframe(int INC) {
@@ -73,39 +282,127 @@ namespace Pix {
 		}
 	}
 
-	void Terrain::render(TerrainShader *shader) {
+	void Terrain::render(TerrainShader *shader, Camera *camera) {
+
+		// streamed terrains may not be loaded
+		if (residency() != TERRAIN_RESIDENT) return;
 
 		if (!bInited) init(shader);
 		
-		shader->setFloat("iTime", (float)Fu::METRONOME);
+		shader->loadTransformationMatrix(mTransform);
+		shader->setTime((float)Fu::METRONOME);
 		
-		Material& material = pLoader->material(MESH);
-		shader->loadMaterial(material);
-		shader->bindMaterial(material);
+		shader->loadMaterial(material());
+		shader->bindMaterial(material());
 
-		if (pDirtTexture != nullptr) {
-			if (pDirtTexture->buffer()->clearDirty()) pDirtTexture->update();
-			shader->textureUnit("dirtyTexture", pDirtTexture);
+		if (pDirtCanvas != nullptr) {
+			pDirtCanvas->upload(PLANET.canvasUploadBudget);
+			pDirtCanvas->bind(shader, "dirtyTexture");
 		}
 
-		draw();
+		Frustum *frustum = camera->getFrustum();
+		int drawn = 0;
 
+		if (pChunks != nullptr) {
+			drawn = pChunks->draw(camera->getPosition(), frustum, pHorizon);
+		} else {
+			for (int i = 0, l = (int) vChunkBounds.size(); i < l; i++) {
+				if ((frustum == nullptr || frustum->IsBoxVisible(vChunkBounds[i].min, vChunkBounds[i].max))
+					&& (pHorizon == nullptr || pHorizon->visible(vChunkBounds[i].min * 1000.0F, vChunkBounds[i].max * 1000.0F))) {
+					pMesh->draw(i);
+					drawn++;
+				}
+			}
+			pMesh->unbind();
+		}
+
+		if (DBG) LogV(TAG, SF("Terrain %s, drawn chunks %d", CONFIG.name.c_str(), drawn));
 	}
 
-	void Terrain::init(TerrainShader *shader) {
+	void Terrain::uploadChunks() {
 
-		glm::mat4 tmatrix = createTransformationMatrix(
-				{CONFIG.origin.x / 1000.0F, 0, CONFIG.origin.y / 1000.0F},
-				0, 0, 0, 1, false, false, false) * PLANET.terrainTransform.toMatrix();
+		constexpr int FLOATS = 8;    // objl vertex: position, normal, texture coordinates
+
+		const float *vertices = pLoader->vertices(MESH);
+		const unsigned *indices = pLoader->indices(MESH);
+		const unsigned indicesCount = pLoader->indicesCount(MESH);
+		const unsigned verticesCount = pLoader->verticesCount(MESH);
+
+		// vertices in render coordinates, as placed by the terrain transform
+		std::vector<glm::vec3> placed(verticesCount);
+		glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+
+		for (unsigned i = 0; i < verticesCount; i++) {
+			const float *v = vertices + i * FLOATS;
+			placed[i] = glm::vec3(mTransform * glm::vec4(v[0], v[1], v[2], 1.0F));
+			min = glm::min(min, placed[i]);
+			max = glm::max(max, placed[i]);
+		}
+
+		// chunk grid over the placed mesh, triangles go to the chunk of their centroid
+		const float chunkSize = std::max(CONFIG.cullChunkSize, 1.0F) / 1000.0F;
+		const int cols = std::max(1, (int) ceilf((max.x - min.x) / chunkSize));
+		const int rows = std::max(1, (int) ceilf((max.z - min.z) / chunkSize));
+
+		std::vector<std::vector<unsigned>> triangles(cols * rows);
+
+		for (unsigned t = 0; t + 2 < indicesCount; t += 3) {
+			const glm::vec3 centroid = (placed[indices[t]] + placed[indices[t + 1]] + placed[indices[t + 2]]) / 3.0F;
+			const int col = std::min(cols - 1, (int) ((centroid.x - min.x) / chunkSize));
+			const int row = std::min(rows - 1, (int) ((centroid.z - min.z) / chunkSize));
+			triangles[row * cols + col].emplace_back(t);
+		}
+
+		pMesh = new LayerVao();
+		vChunkBounds.clear();
 
-		shader->loadTransformationMatrix(tmatrix);
+		// every chunk gets its own compact copy of the vertices it uses
+		std::vector<int> remap(verticesCount, -1);
+		std::vector<float> chunkVertices;
+		std::vector<unsigned> chunkIndices;
 
-		LayerVao::add(
-				pLoader->vertices(), pLoader->verticesCount(),
-				pLoader->indices(), pLoader->indicesCount());
+		for (std::vector<unsigned> &chunk : triangles) {
+
+			if (chunk.empty()) continue;
+
+			chunkVertices.clear();
+			chunkIndices.clear();
+			ChunkBounds_t bounds = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+
+			for (unsigned t : chunk) {
+				for (int k = 0; k < 3; k++) {
+					const unsigned index = indices[t + k];
+					if (remap[index] < 0) {
+						remap[index] = (int) (chunkVertices.size() / FLOATS);
+						chunkVertices.insert(chunkVertices.end(), vertices + index * FLOATS, vertices + (index + 1) * FLOATS);
+						bounds.min = glm::min(bounds.min, placed[index]);
+						bounds.max = glm::max(bounds.max, placed[index]);
+					}
+					chunkIndices.emplace_back((unsigned) remap[index]);
+				}
+			}
+
+			for (unsigned t : chunk)
+				for (int k = 0; k < 3; k++) remap[indices[t + k]] = -1;
+
+			pMesh->add(chunkVertices.data(), (unsigned) (chunkVertices.size() / FLOATS),
+					   chunkIndices.data(), (unsigned) chunkIndices.size());
+			vChunkBounds.emplace_back(bounds);
+		}
+
+		if (DBG) LogV(TAG, SF("Terrain %s split in %d chunks", CONFIG.name.c_str(), (int) vChunkBounds.size()));
+	}
+
+	void Terrain::init(TerrainShader *shader) {
+
+		if (pChunks != nullptr) {
+			pChunks->upload();
+		} else {
+			uploadChunks();
+		}
 
-		pLoader->material(0).upload();
-		if (pDirtTexture != nullptr) pDirtTexture->upload();
+		material().upload();
+		if (pDirtCanvas != nullptr) pDirtCanvas->init();
 
 		bInited = true;
 	}
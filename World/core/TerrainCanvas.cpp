@@ -0,0 +1,141 @@
+//
+//  TerrainCanvas.cpp
+//  PixFu Engine
+//
+//  Terrain canvas with dirty region tracking and partial texture uploads.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "TerrainCanvas.hpp"
+#include "PixelBlend.hpp"
+#include "OpenGL.h"
+
+#include <cmath>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	TerrainCanvas::TerrainCanvas(Texture2D *texture, Font *font)
+			: Canvas2D(texture->buffer(), font),
+			  pTexture(texture),
+			  mRegions(texture->buffer()->width, texture->buffer()->height) {}
+
+	TerrainCanvas::TerrainCanvas(Drawable *scratch, Font *font)
+			: Canvas2D(scratch, font),
+			  mRegions(scratch->width, scratch->height) {}
+
+	TerrainCanvas::~TerrainCanvas() {
+		delete pLayer;
+		delete pTexture;
+	}
+
+	void TerrainCanvas::drawString(int32_t x, int32_t y, const std::string &text, Pixel col, uint32_t scale) {
+
+		// font glyphs are 8x8 pixels, lines break on \n
+		int columns = 0, lines = 1;
+		for (int i = 0, column = 0, l = (int) text.size(); i < l; i++) {
+			if (text[i] == '\n') {
+				lines++;
+				column = 0;
+			} else {
+				columns = std::max(columns, ++column);
+			}
+		}
+
+		touched(x, y, x + columns * 8 * (int) scale, y + lines * 8 * (int) scale);
+		Canvas2D::drawString(x, y, text, col, scale);
+	}
+
+	void TerrainCanvas::blendSpan(int x0, int x1, int y, Pixel color) {
+		const int32_t width = buffer()->width;
+		if (y < 0 || y >= buffer()->height) return;
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, width - 1);
+		if (x0 <= x1) Pix::blendSpan(buffer()->getData() + y * width + x0, x1 - x0 + 1, color);
+	}
+
+	void TerrainCanvas::fadeSpan(int x0, int x1, int y, uint32_t factor) {
+		const int32_t width = buffer()->width;
+		if (y < 0 || y >= buffer()->height) return;
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, width - 1);
+		if (x0 <= x1) Pix::fadeSpan(buffer()->getData() + y * width + x0, x1 - x0 + 1, factor);
+	}
+
+	DecalLayer *TerrainCanvas::layer() {
+		// in storage pixels, like the spans drawn on it
+		if (pLayer == nullptr)
+			pLayer = new DecalLayer(std::max(1, static_cast<int>(ceilf(width() * resolution()))),
+									std::max(1, static_cast<int>(ceilf(height() * resolution()))));
+		return pLayer;
+	}
+
+	void TerrainCanvas::releaseLayer() {
+		delete pLayer;
+		pLayer = nullptr;
+	}
+
+	void TerrainCanvas::init() {
+		pTexture->upload();
+		buffer()->clearDirty();
+		mRegions.clear();
+		bTracked = false;
+	}
+
+	void TerrainCanvas::bind(Shader *shader, const std::string &sampler) {
+		shader->textureUnit(sampler, pTexture);
+	}
+
+	size_t TerrainCanvas::bytes() {
+		// buffer and texture, RGBA
+		return 2 * sizeof(Pixel) * width() * height() + (pLayer != nullptr ? pLayer->bytes() : 0);
+	}
+
+	size_t TerrainCanvas::upload(size_t budget) {
+
+		// the buffer was modified behind our back: nothing to do but send it all
+		if (buffer()->clearDirty() && !bTracked) mRegions.addAll();
+		bTracked = false;
+
+		if (mRegions.empty()) return 0;
+
+		vUpload.clear();
+		const size_t bytes = mRegions.take(budget, sizeof(Pixel), vUpload);
+
+		const int32_t width = buffer()->width;
+		const Pixel *data = buffer()->getData();
+
+		pTexture->bind();
+
+		for (const DirtyRect_t &rect : vUpload) {
+
+			if (pLayer == nullptr || !pLayer->covers(rect.x0, rect.y0, rect.x1, rect.y1)) {
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x0, rect.y0, rect.width(), rect.height(),
+								GL_RGBA, GL_UNSIGNED_BYTE, data + rect.y0 * width + rect.x0);
+				continue;
+			}
+
+			// fading decals go over a copy, the buffer keeps what is below them
+			vComposed.resize(rect.area());
+			for (int y = rect.y0; y < rect.y1; y++)
+				std::copy(data + y * width + rect.x0, data + y * width + rect.x1,
+						  vComposed.data() + (y - rect.y0) * rect.width());
+			pLayer->compose(rect.x0, rect.y0, rect.x1, rect.y1, vComposed.data(), rect.width());
+
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, rect.width());
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x0, rect.y0, rect.width(), rect.height(),
+							GL_RGBA, GL_UNSIGNED_BYTE, vComposed.data());
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+		return bytes;
+	}
+
+}
+
+#pragma clang diagnostic pop
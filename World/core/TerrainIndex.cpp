@@ -0,0 +1,98 @@
+//
+//  TerrainIndex.cpp
+//  PixFu Engine
+//
+//  Grid index to look up terrains by world position.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "TerrainIndex.hpp"
+
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	void TerrainIndex::build(const std::vector<Terrain *> &terrains) {
+
+		vCellStart.clear();
+		vCandidates.clear();
+		nCols = nRows = 0;
+
+		if (terrains.empty()) return;
+
+		// bounds, and the smallest terrain determines the cell size
+		glm::vec2 min = terrains[0]->CONFIG.origin, max = min;
+		glm::vec2 cell = {terrains[0]->xPixels(), terrains[0]->zPixels()};
+
+		for (Terrain *terrain:terrains) {
+			const glm::vec2 &origin = terrain->CONFIG.origin;
+			min = glm::min(min, origin);
+			max = glm::max(max, origin + glm::vec2(terrain->xPixels(), terrain->zPixels()));
+			cell = glm::min(cell, glm::vec2(terrain->xPixels(), terrain->zPixels()));
+		}
+
+		mOrigin = min;
+		mExtent = max - min;
+		cell = glm::max(cell, glm::vec2(1, 1));
+
+		nCols = std::max(1, (int) ceilf(mExtent.x / cell.x));
+		nRows = std::max(1, (int) ceilf(mExtent.y / cell.y));
+
+		while ((long) nCols * nRows > MAXCELLS) {
+			cell *= 2.0F;
+			nCols = std::max(1, (int) ceilf(mExtent.x / cell.x));
+			nRows = std::max(1, (int) ceilf(mExtent.y / cell.y));
+		}
+
+		mInvCell = {1.0F / cell.x, 1.0F / cell.y};
+
+		// bucket the terrains, keeping insertion order inside every cell
+		std::vector<std::vector<Terrain *>> buckets(nCols * nRows);
+
+		for (Terrain *terrain:terrains) {
+			const glm::vec2 from = (terrain->CONFIG.origin - mOrigin) * mInvCell;
+			const glm::vec2 to = (terrain->CONFIG.origin + glm::vec2(terrain->xPixels(), terrain->zPixels()) - mOrigin) * mInvCell;
+			for (int row = std::max(0, (int) from.y), rl = std::min(nRows - 1, (int) to.y); row <= rl; row++)
+				for (int col = std::max(0, (int) from.x), cl = std::min(nCols - 1, (int) to.x); col <= cl; col++)
+					buckets[row * nCols + col].emplace_back(terrain);
+		}
+
+		vCellStart.reserve(buckets.size() + 1);
+		for (auto &bucket : buckets) {
+			vCellStart.emplace_back((int) vCandidates.size());
+			vCandidates.insert(vCandidates.end(), bucket.begin(), bucket.end());
+		}
+		vCellStart.emplace_back((int) vCandidates.size());
+
+	}
+
+	void TerrainIndex::find(const glm::vec2 &minWorld, const glm::vec2 &maxWorld, std::vector<Terrain *> &terrains) const {
+
+		terrains.clear();
+
+		const glm::vec2 from = (minWorld - mOrigin) * mInvCell, to = (maxWorld - mOrigin) * mInvCell;
+
+		if (nCols == 0 || to.x < 0 || to.y < 0 || from.x > nCols || from.y > nRows) return;
+
+		for (int row = std::max(0, (int) from.y), rl = std::min(nRows - 1, (int) to.y); row <= rl; row++)
+			for (int col = std::max(0, (int) from.x), cl = std::min(nCols - 1, (int) to.x); col <= cl; col++) {
+				const int cell = row * nCols + col;
+				for (int i = vCellStart[cell], l = vCellStart[cell + 1]; i < l; i++) {
+					Terrain *terrain = vCandidates[i];
+					const glm::vec2 &origin = terrain->CONFIG.origin;
+					if (maxWorld.x < origin.x || maxWorld.y < origin.y
+						|| minWorld.x > origin.x + terrain->xPixels() || minWorld.y > origin.y + terrain->zPixels())
+						continue;
+					if (std::find(terrains.begin(), terrains.end(), terrain) == terrains.end())
+						terrains.emplace_back(terrain);
+				}
+			}
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,272 @@
+//
+//  TerrainMesh.cpp
+//  PixFu Engine
+//
+//  Heightmap generated terrain mesh, with geomipmapped chunks.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "TerrainMesh.hpp"
+#include "LayerVao.hpp"
+#include "Utils.hpp"
+#include "glm/geometric.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string TerrainMesh::TAG = "TerrainMesh";
+
+	TerrainMesh::TerrainMesh(const HeightPyramid *heights, glm::vec2 size, glm::vec2 origin,
+							 int step, int chunkSize, int lods, float lodDistance)
+			: CHUNK(chunkSize), LODS(lods), LODDISTANCE(lodDistance) {
+
+		// chunk indices are 16 bit
+		if (CHUNK < 2 || CHUNK > 128 || (CHUNK & (CHUNK - 1)) != 0)
+			throw std::runtime_error("Terrain mesh chunk size must be a power of two up to 128");
+
+		if (LODS < 1 || (CHUNK >> (LODS - 1)) < 1)
+			throw std::runtime_error("Too many terrain mesh detail levels for the chunk size");
+
+		if (step < 1)
+			throw std::runtime_error("Terrain mesh step must be at least 1");
+
+		buildVertices(heights, size, origin, step);
+		buildIndices();
+
+		mBytes = vVertices.size() * sizeof(float) + vIndices.size() * sizeof(uint16_t);
+
+		if (DBG) LogV(TAG, SF("Built %d chunks, %zu vertices", (int) vChunks.size(), vVertices.size() / FLOATS));
+	}
+
+	TerrainMesh::~TerrainMesh() {
+		if (bUploaded) {
+			for (Chunk_t &chunk : vChunks) glDeleteVertexArrays(1, &chunk.vao);
+			glDeleteBuffers(1, &mVbo);
+			glDeleteBuffers(1, &mIbo);
+		}
+	}
+
+	void TerrainMesh::buildVertices(const HeightPyramid *heights, glm::vec2 size, glm::vec2 origin, int step) {
+
+		const int W = static_cast<int>(size.x), H = static_cast<int>(size.y);
+		const int SPAN = CHUNK * step;
+		const int SIDE = CHUNK + 1;
+
+		nCols = (W + SPAN - 1) / SPAN;
+		nRows = (H + SPAN - 1) / SPAN;
+
+		vChunks.resize(nCols * nRows);
+		vVertices.resize(vChunks.size() * SIDE * SIDE * FLOATS);
+
+		auto sample = [heights, W, H](int x, int z) {
+			return heights->height(std::min(std::max(x, 0), W - 1), std::min(std::max(z, 0), H - 1));
+		};
+
+		float *vertex = vVertices.data();
+
+		for (int row = 0; row < nRows; row++) {
+			for (int col = 0; col < nCols; col++) {
+
+				Chunk_t &chunk = vChunks[row * nCols + col];
+				chunk.firstVertex = (row * nCols + col) * SIDE * SIDE;
+				chunk.lod = 0;
+				chunk.vao = 0;
+
+				float minY = INFINITY, maxY = -INFINITY;
+
+				for (int j = 0; j < SIDE; j++) {
+					for (int i = 0; i < SIDE; i++) {
+
+						// the last chunks may overhang: clamp them to the terrain edge
+						const int x = std::min(col * SPAN + i * step, W);
+						const int z = std::min(row * SPAN + j * step, H);
+						const float y = sample(x, z);
+
+						const glm::vec3 normal = glm::normalize(glm::vec3(
+								sample(x - step, z) - sample(x + step, z),
+								2.0F * step,
+								sample(x, z - step) - sample(x, z + step)));
+
+						// render coordinates are world / 1000
+						*vertex++ = x / 1000.0F;
+						*vertex++ = y / 1000.0F;
+						*vertex++ = z / 1000.0F;
+						*vertex++ = normal.x;
+						*vertex++ = normal.y;
+						*vertex++ = normal.z;
+						*vertex++ = (float) x / W;
+						*vertex++ = (float) z / H;
+
+						minY = std::min(minY, y);
+						maxY = std::max(maxY, y);
+					}
+				}
+
+				chunk.min = {origin.x + col * SPAN, minY, origin.y + row * SPAN};
+				chunk.max = {origin.x + std::min((col + 1) * SPAN, W), maxY, origin.y + std::min((row + 1) * SPAN, H)};
+			}
+		}
+	}
+
+	void TerrainMesh::buildIndices() {
+
+		const int N = CHUNK;
+
+		vRanges.resize(LODS * EDGE_VARIANTS);
+
+		for (int lod = 0; lod < LODS; lod++) {
+
+			const int s = 1 << lod, s2 = s << 1;
+
+			for (int mask = 0; mask < EDGE_VARIANTS; mask++) {
+
+				// odd vertices on an edge shared with a coarser neighbor collapse onto
+				// the previous even one, so the edge matches the neighbor's
+				auto index = [N, s, s2, mask](int i, int j) {
+					if ((mask & EDGE_NORTH) && j == 0 && i % s2 != 0) i -= s;
+					if ((mask & EDGE_SOUTH) && j == N && i % s2 != 0) i -= s;
+					if ((mask & EDGE_WEST) && i == 0 && j % s2 != 0) j -= s;
+					if ((mask & EDGE_EAST) && i == N && j % s2 != 0) j -= s;
+					return static_cast<uint16_t>(j * (N + 1) + i);
+				};
+
+				auto triangle = [this](uint16_t a, uint16_t b, uint16_t c) {
+					if (a == b || b == c || a == c) return;
+					vIndices.push_back(a);
+					vIndices.push_back(b);
+					vIndices.push_back(c);
+				};
+
+				Range_t &range = vRanges[lod * EDGE_VARIANTS + mask];
+				range.offset = static_cast<unsigned>(vIndices.size());
+
+				for (int j = 0; j < N; j += s) {
+					for (int i = 0; i < N; i += s) {
+						// counter-clockwise seen from above
+						const uint16_t a = index(i, j), b = index(i + s, j);
+						const uint16_t c = index(i, j + s), d = index(i + s, j + s);
+						triangle(a, c, b);
+						triangle(b, c, d);
+					}
+				}
+
+				range.count = static_cast<unsigned>(vIndices.size()) - range.offset;
+			}
+		}
+	}
+
+	void TerrainMesh::upload() {
+
+		if (bUploaded) return;
+
+		glGenBuffers(1, &mVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+		glBufferData(GL_ARRAY_BUFFER, vVertices.size() * sizeof(float), vVertices.data(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &mIbo);
+
+		for (Chunk_t &chunk : vChunks) {
+
+			glGenVertexArrays(1, &chunk.vao);
+			glBindVertexArray(chunk.vao);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbo);
+
+			const size_t base = chunk.firstVertex * FLOATS * sizeof(float);
+			const GLsizei stride = FLOATS * sizeof(float);
+
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid *) base);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid *) (base + 3 * sizeof(float)));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid *) (base + 6 * sizeof(float)));
+		}
+
+		// the element buffer binding is part of the VAO state
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, vIndices.size() * sizeof(uint16_t), vIndices.data(), GL_STATIC_DRAW);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// the GPU has them now
+		std::vector<float>().swap(vVertices);
+		std::vector<uint16_t>().swap(vIndices);
+
+		bUploaded = true;
+	}
+
+	void TerrainMesh::selectLods(const glm::vec3 &camera) {
+
+		for (Chunk_t &chunk : vChunks) {
+			const glm::vec3 nearest = glm::max(chunk.min, glm::min(camera, chunk.max));
+			const float distance = glm::length(camera - nearest);
+			chunk.lod = distance < LODDISTANCE
+						? 0 : std::min(LODS - 1, 1 + static_cast<int>(log2f(distance / LODDISTANCE)));
+		}
+
+		// stitching only bridges one level: refine chunks that are much coarser than a neighbor
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (int row = 0; row < nRows; row++) {
+				for (int col = 0; col < nCols; col++) {
+					Chunk_t &chunk = vChunks[row * nCols + col];
+					for (Chunk_t *other : {neighbor(col, row - 1), neighbor(col + 1, row),
+										   neighbor(col, row + 1), neighbor(col - 1, row)}) {
+						if (other != nullptr && chunk.lod > other->lod + 1) {
+							chunk.lod = other->lod + 1;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int TerrainMesh::draw(const glm::vec3 &camera, const Frustum *frustum, const HorizonMap *horizon) {
+
+		// hidden chunks get a level too, visible neighbors stitch to it
+		selectLods(camera);
+
+		int drawn = 0;
+
+		for (int row = 0; row < nRows; row++) {
+			for (int col = 0; col < nCols; col++) {
+
+				Chunk_t &chunk = vChunks[row * nCols + col];
+
+				if (frustum != nullptr && !frustum->IsBoxVisible(chunk.min / 1000.0F, chunk.max / 1000.0F))
+					continue;
+
+				if (horizon != nullptr && !horizon->visible(chunk.min, chunk.max))
+					continue;
+
+				auto coarser = [&chunk](Chunk_t *other) { return other != nullptr && other->lod > chunk.lod; };
+
+				const int mask = (coarser(neighbor(col, row - 1)) ? EDGE_NORTH : 0)
+								 | (coarser(neighbor(col + 1, row)) ? EDGE_EAST : 0)
+								 | (coarser(neighbor(col, row + 1)) ? EDGE_SOUTH : 0)
+								 | (coarser(neighbor(col - 1, row)) ? EDGE_WEST : 0);
+
+				const Range_t &range = vRanges[chunk.lod * EDGE_VARIANTS + mask];
+
+				glBindVertexArray(chunk.vao);
+				glDrawElements(LayerVao::DRAWMODE, range.count, GL_UNSIGNED_SHORT,
+							   (GLvoid *) (range.offset * sizeof(uint16_t)));
+				drawn++;
+			}
+		}
+
+		glBindVertexArray(0);
+		return drawn;
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,267 @@
+//
+//  TerrainStreamer.cpp
+//  PixFu Engine
+//
+//  Background loading and unloading of terrains around the camera and the
+//  physics bodies, within a memory budget.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "TerrainStreamer.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "OCDFAInspection"
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	std::string TerrainStreamer::TAG = "TerrainStreamer";
+
+	TerrainStreamer::TerrainStreamer(const TerrainStreaming_t &config, const std::vector<Terrain *> &terrains)
+			: vTerrains(terrains), CONFIG(config) {
+
+		for (int i = 0, l = std::max(1, CONFIG.threads); i < l; i++)
+			vWorkers.emplace_back(&TerrainStreamer::work, this);
+
+		if (DBG) LogV(TAG, SF("Streaming terrains, budget %zu bytes", CONFIG.memoryBudget));
+	}
+
+	TerrainStreamer::~TerrainStreamer() {
+
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			bStop = true;
+		}
+
+		mSignal.notify_all();
+		for (std::thread &worker : vWorkers) worker.join();
+
+		// nobody will adopt these
+		for (Job_t &job : vFinished) discard(job.resources);
+	}
+
+	void TerrainStreamer::discard(TerrainResources_t &resources) {
+		delete resources.heights;
+		delete resources.loader;
+		delete resources.mesh;
+		delete resources.material;
+		resources.heights = nullptr;
+		resources.loader = nullptr;
+		resources.mesh = nullptr;
+		resources.material = nullptr;
+	}
+
+	void TerrainStreamer::fail(Terrain *terrain) {
+		Failure_t &failure = mFailed[terrain];
+		const uint64_t wait = RETRY_UPDATES << (failure.count < MAX_BACKOFF ? failure.count : MAX_BACKOFF);
+		failure.count++;
+		failure.retry = nUpdate + wait;
+		LogE(TAG, SF("Terrain %s failed to load %d times, retrying in %llu updates",
+					 terrain->CONFIG.name.c_str(), failure.count, static_cast<unsigned long long>(wait)));
+	}
+
+	void TerrainStreamer::work() {
+
+		while (true) {
+
+			Job_t job;
+
+			{
+				std::unique_lock<std::mutex> lock(mLock);
+				mSignal.wait(lock, [this] { return bStop || !qJobs.empty(); });
+				if (bStop) return;
+				job = qJobs.front();
+				qJobs.pop_front();
+			}
+
+			try {
+				job.resources = Terrain::load(job.terrain->CONFIG, job.size, job.heights, job.render);
+			} catch (std::exception &e) {
+				LogE(TAG, SF("Error loading terrain %s: %s", job.terrain->CONFIG.name.c_str(), e.what()));
+				job.failed = true;
+			}
+
+			std::lock_guard<std::mutex> lock(mLock);
+			vFinished.emplace_back(job);
+		}
+	}
+
+	void TerrainStreamer::request(Terrain *terrain, bool heights, bool render) {
+
+		if (sPending.count(terrain) > 0 || failed(terrain)) return;
+
+		sPending.insert(terrain);
+
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			qJobs.push_back({terrain, heights, render, {terrain->xPixels(), terrain->zPixels()}});
+		}
+
+		mSignal.notify_one();
+	}
+
+	void TerrainStreamer::adoptFinished() {
+
+		std::vector<Job_t> finished;
+
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			finished.swap(vFinished);
+		}
+
+		for (Job_t &job : finished) {
+
+			sPending.erase(job.terrain);
+
+			if (job.failed) {
+				fail(job.terrain);
+				continue;
+			}
+
+			mFailed.erase(job.terrain);
+
+			// the camera or the bodies moved away while it loaded: keep only what is still wanted
+			const bool render = has(vWantRender, job.terrain);
+			if (!render && (job.resources.loader != nullptr || job.resources.mesh != nullptr)) {
+				HeightPyramid *heights = job.resources.heights;
+				job.resources.heights = nullptr;
+				discard(job.resources);
+				job.resources.heights = heights;
+			}
+
+			if (!render && !has(vWantHeights, job.terrain)) {
+				discard(job.resources);
+				if (DBG) LogV(TAG, SF("Dropped terrain %s, no longer wanted", job.terrain->CONFIG.name.c_str()));
+				continue;
+			}
+
+			job.terrain->adopt(job.resources);
+			if (DBG) LogV(TAG, SF("Adopted terrain %s", job.terrain->CONFIG.name.c_str()));
+		}
+	}
+
+	void TerrainStreamer::update(const glm::vec3 &camera, const std::vector<glm::vec3> &bodies) {
+
+		nUpdate++;
+
+		vWantRender.clear();
+		vWantHeights.clear();
+		vPinned.clear();
+
+		for (Terrain *terrain : vTerrains) {
+
+			bool pinned = false, near = false;
+
+			for (const glm::vec3 &body : bodies) {
+				const float distance = terrain->distance(body);
+				pinned |= distance == 0;
+				near |= distance <= CONFIG.heightsDistance;
+			}
+
+			if (pinned) vPinned.emplace_back(terrain);
+			if (near) vWantHeights.emplace_back(terrain);
+			if (terrain->distance(camera) <= CONFIG.renderDistance) vWantRender.emplace_back(terrain);
+		}
+
+		// with the wanted sets known, so jobs nobody wants any more are dropped instead of adopted
+		adoptFinished();
+
+		// a body is on a terrain without heights: cannot wait for the loader.
+		// A terrain that failed is not retried here every frame, the body has no ground until it loads.
+		for (Terrain *terrain : vPinned) {
+			if (terrain->residency() == TERRAIN_UNLOADED && !failed(terrain)) {
+				if (DBG) LogV(TAG, SF("Loading terrain %s heights in place", terrain->CONFIG.name.c_str()));
+				try {
+					terrain->adopt(Terrain::load(terrain->CONFIG, {terrain->xPixels(), terrain->zPixels()}, true, false));
+					mFailed.erase(terrain);
+				} catch (std::exception &e) {
+					LogE(TAG, SF("Error loading terrain %s: %s", terrain->CONFIG.name.c_str(), e.what()));
+					fail(terrain);
+				}
+			}
+		}
+
+		// drop queued jobs that are no longer needed
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			qJobs.erase(std::remove_if(qJobs.begin(), qJobs.end(), [this](const Job_t &job) {
+				if (has(vWantRender, job.terrain) || has(vWantHeights, job.terrain)) return false;
+				sPending.erase(job.terrain);
+				return true;
+			}), qJobs.end());
+		}
+
+		// request missing resources, nearest to the camera first
+		std::vector<std::pair<float, Terrain *>> missing;
+
+		for (Terrain *terrain : vWantRender)
+			if (terrain->residency() != TERRAIN_RESIDENT) missing.emplace_back(terrain->distance(camera), terrain);
+
+		for (Terrain *terrain : vWantHeights)
+			if (terrain->residency() == TERRAIN_UNLOADED && !has(vWantRender, terrain))
+				missing.emplace_back(terrain->distance(camera), terrain);
+
+		std::sort(missing.begin(), missing.end(),
+				  [](const std::pair<float, Terrain *> &a, const std::pair<float, Terrain *> &b) { return a.first < b.first; });
+
+		for (auto &item : missing) {
+			Terrain *terrain = item.second;
+			request(terrain, terrain->residency() == TERRAIN_UNLOADED, has(vWantRender, terrain));
+		}
+
+		enforceBudget(camera);
+	}
+
+	void TerrainStreamer::enforceBudget(const glm::vec3 &camera) {
+
+		size_t total = residentBytes();
+
+		if (total <= CONFIG.memoryBudget) return;
+
+		// farthest first
+		std::vector<std::pair<float, Terrain *>> loaded;
+
+		for (Terrain *terrain : vTerrains)
+			if (terrain->residency() != TERRAIN_UNLOADED) loaded.emplace_back(terrain->distance(camera), terrain);
+
+		std::sort(loaded.begin(), loaded.end(),
+				  [](const std::pair<float, Terrain *> &a, const std::pair<float, Terrain *> &b) { return a.first > b.first; });
+
+		// first drop meshes and textures, then heightmaps. Heightmaps under a body are never dropped.
+
+		for (auto &item : loaded) {
+			Terrain *terrain = item.second;
+			if (total <= CONFIG.memoryBudget) break;
+			if (terrain->residency() == TERRAIN_RESIDENT && !has(vWantRender, terrain)) {
+				const size_t before = terrain->residentBytes();
+				terrain->release(TERRAIN_HEIGHTS);
+				total -= before - terrain->residentBytes();
+			}
+		}
+
+		for (auto &item : loaded) {
+			Terrain *terrain = item.second;
+			if (total <= CONFIG.memoryBudget) break;
+			if (!has(vWantRender, terrain) && !has(vWantHeights, terrain) && !has(vPinned, terrain)) {
+				total -= terrain->residentBytes();
+				terrain->release(TERRAIN_UNLOADED);
+			}
+		}
+
+		if (DBG && total > CONFIG.memoryBudget)
+			LogV(TAG, SF("Wanted terrains exceed the budget: %zu bytes", total));
+	}
+
+	size_t TerrainStreamer::residentBytes() {
+		size_t total = 0;
+		for (Terrain *terrain : vTerrains) total += terrain->residentBytes();
+		return total;
+	}
+
+}
+
+#pragma clang diagnostic pop
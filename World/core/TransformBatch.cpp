@@ -0,0 +1,125 @@
+//
+//  TransformBatch.cpp
+//  PixFu Engine
+//
+//  Batched model matrices.
+//
+//  With c* and s* the cosines and sines of the angles, Rx * Ry * Rz is
+//
+//    | cy*cz            -cy*sz             sy     |
+//    | cx*sz + sx*sy*cz  cx*cz - sx*sy*sz  -sx*cy |
+//    | sx*sz - cx*sy*cz  sx*cz + cx*sy*sz   cx*cy |
+//
+//  and every column is then multiplied by the scale and its flip sign.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "TransformBatch.hpp"
+#include "Simd.hpp"
+
+#include <cmath>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "err_typecheck_invalid_operands"
+
+namespace Pix {
+
+	TransformBatch::TransformBatch(bool flipX, bool flipY, bool flipZ)
+			: mFlip{flipX ? -1.0F : 1.0F, flipY ? -1.0F : 1.0F, flipZ ? -1.0F : 1.0F} {}
+
+	void TransformBatch::clear() {
+		vX.clear();
+		vY.clear();
+		vZ.clear();
+		vRX.clear();
+		vRY.clear();
+		vRZ.clear();
+		vScale.clear();
+	}
+
+	void TransformBatch::add(const glm::vec3 &translation, const glm::vec3 &rotation, float scale) {
+		vX.push_back(translation.x);
+		vY.push_back(translation.y);
+		vZ.push_back(translation.z);
+		vRX.push_back(rotation.x);
+		vRY.push_back(rotation.y);
+		vRZ.push_back(rotation.z);
+		vScale.push_back(scale);
+	}
+
+	glm::mat4 TransformBatch::build(const glm::vec3 &translation, const glm::vec3 &rotation, float scale,
+									const float flip[3], const glm::mat4 *placer) {
+
+		const float sx = sinf(rotation.x), cx = cosf(rotation.x);
+		const float sy = sinf(rotation.y), cy = cosf(rotation.y);
+		const float sz = sinf(rotation.z), cz = cosf(rotation.z);
+
+		const float k0 = scale * flip[0], k1 = scale * flip[1], k2 = scale * flip[2];
+
+		const glm::mat4 matrix = {
+				{k0 * cy * cz, k0 * (cx * sz + sx * sy * cz), k0 * (sx * sz - cx * sy * cz), 0},
+				{-k1 * cy * sz, k1 * (cx * cz - sx * sy * sz), k1 * (sx * cz + cx * sy * sz), 0},
+				{k2 * sy, -k2 * sx * cy, k2 * cx * cy, 0},
+				{translation.x, translation.y, translation.z, 1}
+		};
+
+		return placer != nullptr ? matrix * *placer : matrix;
+	}
+
+	void TransformBatch::build(glm::mat4 *out, const glm::mat4 *placer) const {
+
+		using namespace Simd;
+
+		const size_t count = size();
+		const glm::mat4 identity(1.0F);
+		const glm::mat4 &P = placer != nullptr ? *placer : identity;
+
+		size_t i = 0;
+
+		for (; i + WIDTH <= count; i += WIDTH) {
+
+			float4 sx, cx, sy, cy, sz, cz;
+			sincos(load(&vRX[i]), sx, cx);
+			sincos(load(&vRY[i]), sy, cy);
+			sincos(load(&vRZ[i]), sz, cz);
+
+			const float4 scale = load(&vScale[i]);
+			const float4 k0 = scale * float4(mFlip[0]), k1 = scale * float4(mFlip[1]), k2 = scale * float4(mFlip[2]);
+
+			const float4 sxsy = sx * sy, cxsy = cx * sy;
+
+			// the model matrix, one float4 per element, rows 0..2 of columns 0..2 and the translation
+			const float4 m[4][3] = {
+					{k0 * cy * cz, k0 * (cx * sz + sxsy * cz), k0 * (sx * sz - cxsy * cz)},
+					{-(k1 * cy * sz), k1 * (cx * cz - sxsy * sz), k1 * (sx * cz + cxsy * sz)},
+					{k2 * sy, -(k2 * sx * cy), k2 * cx * cy},
+					{load(&vX[i]), load(&vY[i]), load(&vZ[i])}
+			};
+
+			for (int col = 0; col < 4; col++) {
+
+				// column col of (matrix * placer): the matrix columns weighted by the placer column
+				const glm::vec4 &p = P[col];
+				float4 rows[3];
+				for (int row = 0; row < 3; row++)
+					rows[row] = m[0][row] * float4(p.x) + m[1][row] * float4(p.y) + m[2][row] * float4(p.z)
+								+ m[3][row] * float4(p.w);
+				float4 w(p.w);
+
+				// lanes are instances: transpose to get the column of each instance
+				transpose(rows[0], rows[1], rows[2], w);
+				store(&out[i][col][0], rows[0]);
+				store(&out[i + 1][col][0], rows[1]);
+				store(&out[i + 2][col][0], rows[2]);
+				store(&out[i + 3][col][0], w);
+			}
+		}
+
+		for (; i < count; i++)
+			out[i] = build({vX[i], vY[i], vZ[i]}, {vRX[i], vRY[i], vRZ[i]}, vScale[i], mFlip, placer);
+	}
+
+}
+
+#pragma clang diagnostic pop
@@ -12,6 +12,7 @@
 
 #include <utility>
 #include <memory>
+#include <stdexcept>
 
 #include "Fu.hpp"
 #include "Config.hpp"
@@ -20,6 +21,7 @@
 #include "World.hpp"
 #include "WorldMeta.hpp"
 #include "WorldObject.hpp"
+#include "PixelCache.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "err_typecheck_invalid_operands"
@@ -38,14 +40,26 @@ namespace Pix {
 
 	World::World(WorldConfig_t &config)
 			: FuExtension(true),                                // require add on constructor
+			  mLights(config.lightCellSize / 1000.0F),
 			  CONFIG(config) {
 		if (config.debugMode == DEBUG_WIREFRAME)
 			LayerVao::DRAWMODE = GL_LINES;
+		if (!config.pixelCache.empty())
+			PixelCache::enable(config.pixelCache);
+		if (config.streaming.enabled)
+			pStreamer = new TerrainStreamer(CONFIG.streaming, vTerrains);
 	};
 
 	World::~World() {
 
 		if (DBG) LogV(TAG, "Destroying World");
+		delete pStreamer;    // stops the loader threads before the terrains go away
+		delete pLightBlock;
+		delete pOcclusion;
+		delete pHorizon;
+		delete pShader;
+		delete pShaderObjects;
+		delete pShaderImpostors;
 		for (Terrain *terrain : vTerrains) {
 			delete terrain;
 		}
@@ -53,13 +67,14 @@ namespace Pix {
 	}
 
 	Terrain *World::add(TerrainConfig_t terrainConfig) {
-		Terrain *world = new Terrain(CONFIG, std::move(terrainConfig));
+		Terrain *world = new Terrain(CONFIG, std::move(terrainConfig), pStreamer != nullptr);
 		vTerrains.emplace_back(world);
+		mTerrainIndex.build(vTerrains);
 		return world;
 	}
 
 	WorldObject *World::add(ObjectProperties_t& features, ObjectLocation_t location, bool setHeight) {
-		WorldObject *object = new WorldObject(CONFIG, features, location, WorldObject::CLASSID_CODE);
+		WorldObject *object = mPool.create(CONFIG, features, location, WorldObject::CLASSID_CODE);
 		add(object, setHeight);
 		return object;
 	}
@@ -67,7 +82,7 @@ namespace Pix {
 	void World::add(WorldObject *object, bool setHeight) {
 
 		if (setHeight) {
-			float height = getHeight(object->pos());
+			float height = getHeight(object->pos(), &object->pTerrain);
 			object->pos().y = height;
 		}
 
@@ -84,14 +99,67 @@ namespace Pix {
 		}
 
 		cluster->add(object);
+
+		// a handle, in a free place if there is one
+		uint32_t index;
+		if (!vFreeSlots.empty()) {
+			index = vFreeSlots.back();
+			vFreeSlots.pop_back();
+		} else {
+			index = static_cast<uint32_t>(vSlots.size());
+			vSlots.push_back({nullptr, 1});
+		}
+
+		vSlots[index].object = object;
+		object->mHandle = {index, vSlots[index].generation};
+	}
+
+	bool World::remove(ObjectHandle_t handle) {
+
+		WorldObject *object = get(handle);
+		if (object == nullptr) return false;
+
+		// the old handles stop matching, 0 is for no object
+		ObjectSlot_t &slot = vSlots[handle.index];
+		slot.object = nullptr;
+		if (++slot.generation == 0) slot.generation = 1;
+		vFreeSlots.push_back(handle.index);
+
+		object->mHandle = {};
+		vRemoved.push_back(object);
+		return true;
+	}
+
+	void World::flushRemoved() {
+
+		for (WorldObject *object : vRemoved) {
+			mClusters.at(object->CLASS)->remove(object);
+			dispose(object);
+		}
+
+		if (DBG && !vRemoved.empty()) LogV(TAG, SF("Removed %zu objects", vRemoved.size()));
+		vRemoved.clear();
+	}
+
+	void World::dispose(WorldObject *object) {
+		if (mPool.owns(object)) mPool.destroy(object);
+		else delete object;
 	}
 
 	bool World::init(Fu *engine) {
 
 		auto toRad = [](float degs) { return degs * M_PI / 180.0F; };
 
+		// init() runs again when the context is recreated, the programs are loaded again
+		delete pShader;
+		delete pShaderObjects;
+		delete pShaderImpostors;
+		pShaderImpostors = nullptr;
+
 		pShader = new TerrainShader(CONFIG.shaderName);
-		pShaderObjects = new ObjectShader(CONFIG.shaderName + "_objects");
+		pShaderObjects = CONFIG.instancedObjects
+						 ? new ObjectShader(CONFIG.shaderName + "_objects_instanced", true)
+						 : new ObjectShader(CONFIG.shaderName + "_objects");
 
 		pShader->use();
 		pShader->bindAttributes();
@@ -106,8 +174,20 @@ namespace Pix {
 				CONFIG.perspective.FAR_PLANE
 		);
 
+		fPixelScale = (float) engine->screenHeight() * projectionMatrix[1][1];
+
+		if (CONFIG.occlusionCulling)
+			pOcclusion = new OcclusionBuffer(CONFIG.occlusionWidth,
+											 std::max(1, (int) lroundf(CONFIG.occlusionWidth / aspectRatio)));
+
+		if (CONFIG.horizonCulling) pHorizon = new HorizonMap();
+
 		pShader->loadProjectionMatrix(projectionMatrix);
 		pShader->loadLight(CONFIG.light);
+		if (CONFIG.lightBlock) {
+			pLightBlock = new LightBlock();
+			pShader->useLightBlock();
+		}
 		pShader->stop();
 
 		pCamera = new Camera(projectionMatrix);
@@ -124,9 +204,17 @@ namespace Pix {
 			pShaderObjects->bindAttributes();
 			pShaderObjects->loadProjectionMatrix(projectionMatrix);
 			pShaderObjects->loadLight(CONFIG.light);
+			if (pLightBlock != nullptr) pShaderObjects->useLightBlock();
 			pShaderObjects->stop();
 		}
 
+		if (CONFIG.impostors) {
+			pShaderImpostors = new Shader3D(CONFIG.shaderName + "_impostors");
+			pShaderImpostors->use();
+			pShaderImpostors->loadProjectionMatrix(projectionMatrix);
+			pShaderImpostors->stop();
+		}
+
 		if (DBG)
 			LogV(TAG, SF("Init World, FOV %f, aspectRatio %f",
 						 CONFIG.perspective.FOV, aspectRatio));
@@ -136,24 +224,79 @@ namespace Pix {
 
 	void World::tick(Fu *engine, float fElapsedTime) {
 
+		// before anything looks at the objects
+		if (!vRemoved.empty()) flushRemoved();
+
 		pCamera->update(fElapsedTime);
 
+		if (pStreamer != nullptr) {
+			vBodies.clear();
+			iterateObjects([this](WorldObject *object) {
+				if (!object->CONFIG.ISSTATIC) vBodies.emplace_back(object->pos());
+			});
+			pStreamer->update(pCamera->getPosition(), vBodies);
+		}
+
+		mDecals.flush(fElapsedTime, [this](const glm::vec2 &minWorld, const glm::vec2 &maxWorld,
+										   std::vector<Terrain *> &terrains) {
+			mTerrainIndex.find(minWorld, maxWorld, terrains);
+		});
+
 		glClearColor(CONFIG.backgroundColor.x, CONFIG.backgroundColor.y, CONFIG.backgroundColor.z, 1.0);
 		glEnable(GL_DEPTH_TEST);
 
+		// uniform counters are per frame
+		pShader->resetCounters();
+		pShaderObjects->resetCounters();
+
+		const glm::vec3 eye = pCamera->getPosition();
+
+		// the horizon goes first, the lights are tested against it too
+		if (pHorizon != nullptr) {
+			// samples walk out along the sectors, mostly on the terrain of the one before
+			Terrain *last = nullptr;
+			pHorizon->build(eye, CONFIG.horizonDistance, [this, &last](const glm::vec3 &posWorld) {
+				return vTerrains.size() == 1 ? vTerrains[0] : terrainAt(posWorld, &last);
+			});
+		}
+
+		// lights are binned every frame: the terrains get the ones in view, every object the ones around it
+		LightGrid *lights = nullptr;
+		int viewLights = -1;
+
+		if (mLightMode != LIGHTS_OFF) {
+			updateLights();
+			lights = &mLights;
+			viewLights = mLights.select(pCamera->getFrustum(), eye / 1000.0F);
+		}
+
 		pShader->use();
 		pShader->loadViewMatrix(pCamera);
-		
-		if (bLightsChanged) {
-			loadLights(pShader);
-		} else {
-			updateLights(pShader);
-		}
+		loadLights(pShader, viewLights);
+
+		// all the draws of the frame, sorted by shader, material, mesh and depth
+		mQueue.begin(eye, CONFIG.perspective.FAR_PLANE * 1000.0F);
 
 		for (Terrain *terrain:vTerrains) {
-			terrain->render(pShader);
+			terrain->setHorizon(pHorizon);
+			mQueue.submit(terrain, terrain->distance(eye));
 		}
 
+		if (pOcclusion != nullptr) updateOcclusion();
+
+		for (ObjectCluster *object:vObjects) {
+			object->setView(eye, fPixelScale, pOcclusion, pHorizon);
+		}
+
+		if (!pShaderObjects->INSTANCED) {
+			for (ObjectCluster *object:vObjects) {
+				object->enqueue(mQueue, pCamera->getFrustum(), lights);
+			}
+		}
+
+		mQueue.sort();
+		mQueue.execute(pShader, pCamera);
+
 		pShader->stop();
 
 		if (!vObjects.empty()) {
@@ -161,26 +304,47 @@ namespace Pix {
 			// configure object shader
 			pShaderObjects->use();
 			pShaderObjects->loadViewMatrix(pCamera);
+			loadLights(pShaderObjects, viewLights);
 
-			if (bLightsChanged) {
-				loadLights(pShaderObjects);
-				bLightsChanged = false;
+			if (pShaderObjects->INSTANCED) {
+				// one instanced draw per mesh of each cluster
+				for (ObjectCluster *object:vObjects) {
+					object->render(pShaderObjects, pCamera);
+				}
 			} else {
-				updateLights(pShaderObjects);
+				pShaderObjects->setTime((float) Fu::METRONOME);
+				mQueue.execute(pShaderObjects, lights);
 			}
 
-			// draw each cluster
-			for (ObjectCluster *object:vObjects) {
-				object->render(pShaderObjects, pCamera);
+			pShaderObjects->stop();
+
+			// the far objects of every cluster, one draw each
+			if (pShaderImpostors != nullptr) {
+				pShaderImpostors->use();
+				pShaderImpostors->loadViewMatrix(pCamera);
+				for (ObjectCluster *object:vObjects) {
+					object->renderImpostors(pShaderImpostors);
+				}
+				pShaderImpostors->stop();
 			}
 
-			pShaderObjects->stop();
 			if (DBG) OpenGlUtils::glError("terrain tick");
-		} else bLightsChanged = false;
+		}
 
 		glDisable(GL_DEPTH_TEST);
 
-		if (CONFIG.debugMode == DEBUG_COLLISIONS || CONFIG.debugMode == DEBUG_LIGHTS)
+		if (DBG)
+			LogV(TAG, SF("Uniforms sent %d, skipped %d", pShader->uploads() + pShaderObjects->uploads(),
+						 pShader->skipped() + pShaderObjects->skipped()));
+
+		if (DBG && pOcclusion != nullptr)
+			LogV(TAG, SF("Occluder triangles %d, boxes tested %d, hidden %d", pOcclusion->triangles(), pOcclusion->tested(),
+						 pOcclusion->occluded()));
+
+		if (DBG && pHorizon != nullptr)
+			LogV(TAG, SF("Horizon spheres tested %d, hidden %d", pHorizon->tested(), pHorizon->hidden()));
+
+		if ((CONFIG.debugMode == DEBUG_COLLISIONS || CONFIG.debugMode == DEBUG_LIGHTS) && canvas() != nullptr)
 			canvas()->blank();
 
 	}
@@ -211,6 +375,30 @@ namespace Pix {
 		});
 	}
 
+	bool World::raycastTerrain(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, glm::vec3 &hit) {
+
+		// terrains do not overlap, but the ray may cross several of them
+		float nearest = maxDistance, distance;
+		bool found = false;
+
+		for (Terrain *terrain:vTerrains) {
+			if (terrain->raycast(origin, direction, nearest, distance)) {
+				nearest = distance;
+				found = true;
+			}
+		}
+
+		if (found) hit = origin + direction * nearest;
+		return found;
+	}
+
+	bool World::lineOfSight(const glm::vec3 &from, const glm::vec3 &to) {
+		glm::vec3 ray = to - from;
+		float length = glm::length(ray);
+		glm::vec3 hit;
+		return length == 0 || !raycastTerrain(from, ray / length, length, hit);
+	}
+
 	glm::mat4 createTransformationMatrix(glm::vec3 translation, float rxrads, float ryrads, float rzrads,
 										 float scale, bool flipX = true, bool flipY = false, bool flipZ = false) {
 
@@ -241,81 +429,66 @@ namespace Pix {
 	}
 
 	void World::addLight(std::shared_ptr<PointLight> p) {
+		if (CONFIG.lightBlock && vPointLights.size() == LightBlock::MAXPOINTS)
+			throw std::runtime_error("Too many point lights for the light block");
 		vPointLights.emplace_back(p);
-		bLightsChanged = true;
 	}
 
 	void World::addLight(std::shared_ptr<SpotLight> p) {
+		if (CONFIG.lightBlock && vSpotLights.size() == LightBlock::MAXSPOTS)
+			throw std::runtime_error("Too many spot lights for the light block");
 		vSpotLights.emplace_back(p);
-		bLightsChanged = true;
 	}
 
-	void World::updateLights(LightingShader *shader) {
+	void World::updateLights() {
 
-		shader->setLightingMode(mLightMode);
+		mLights.build(vPointLights, vSpotLights, LIGHT_DARKNESS, pHorizon);
 
-		// TODO (better): We model each light as a sphere, centered on the light
-		// position, and with a radius. points after radius are considered dark.
+		// only the lights that changed since the last frame are sent, once for all shaders
+		if (pLightBlock != nullptr) {
+			pLightBlock->update(vPointLights, vSpotLights);
+			pLightBlock->upload();
+		}
 
-		int inFrustum = 0;
-		
-		if (mLightMode != LIGHTS_OFF) {
+		if (CONFIG.debugMode == DEBUG_LIGHTS) {
+			for (auto &p : vPointLights) {
+				const float radius = p->radius(LIGHT_DARKNESS) * 1000;
+				canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius, Pix::Colors::RED);
+				canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius+1, Pix::Colors::RED);
+				canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius+2, Pix::Colors::RED);
+			}
+			for (auto &p : vSpotLights) {
+				const float radius = p->radius(LIGHT_DARKNESS) * 1000;
+				canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius, Pix::Colors::RED);
+			}
+		}
+	}
 
-			auto frustum = pCamera->getFrustum();
-			for (int i = 0, l = (int)vPointLights.size(); i<l; i++) {
-				auto p = vPointLights.at(i).get();
+	void World::updateOcclusion() {
 
-				float radius = p->calcRadius(LIGHT_DARKNESS);
+		pOcclusion->begin(projectionMatrix * pCamera->getViewMatrix(), CONFIG.perspective.NEAR_PLANE);
 
-				if (CONFIG.debugMode==DEBUG_LIGHTS) {
-					canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius, Pix::Colors::RED);
-					canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius+1, Pix::Colors::RED);
-					canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius+2, Pix::Colors::RED);
-				}
+		for (Terrain *terrain:vTerrains) {
+			const OccluderMesh_t &occluder = terrain->occluder();
+			if (!occluder.indices.empty()) pOcclusion->addMesh(occluder);
+		}
 
-//				if (frustum->IsBoxVisible(p->position, radius / 1000.0f)) {
-					// light virtual sphere is visible
-					shader->enablePointLight(i, true);
-					shader->updateLight(p, i);
-					inFrustum++;
-//				} else {
-//					shader->enablePointLight(i, false);
-//				}
+		iterateObjects([this](WorldObject *object) {
+			const float half = object->CONFIG.occluderRadius / 1000.0F;
+			if (half > 0) {
+				const glm::vec3 center = object->pos() / 1000.0F;
+				pOcclusion->addBox(center - half, center + half);
 			}
+		});
 
-			if (DBG) LogV(TAG, SF("%d pointlights in frustum", inFrustum));
-
-			for (int i=0, l = (int)vSpotLights.size(); i<l; i++) {
-				auto p = vSpotLights.at(i).get();
-				float radius = p->calcRadius(LIGHT_DARKNESS);
-				if (CONFIG.debugMode==DEBUG_LIGHTS) {
-					canvas()->drawCircle(p->position.x*1000, p->position.z*1000, radius, Pix::Colors::RED);
-				}
-//				if (true || frustum->IsBoxVisible(p->position, radius)) {
-					// light virtual sphere is visible
-					shader->enableSpotLight(i, true);
-					shader->updateLight(p, i);
-//				} else {
-//					shader->enableSpotLight(i, false);
-//				}
-			}
-		}
+		pOcclusion->finish();
 	}
 
-	void World::loadLights(LightingShader *shader) {
+	void World::loadLights(LightingShader *shader, int set) {
 
 		shader->setLightingMode(mLightMode);
-		
-		const int MAXLIGHTS = 4;
-
-		for (int i = 0, l = (int)vPointLights.size(), m = (int)vSpotLights.size(); i<MAXLIGHTS; i++) {
-			
-			if (i<l) shader->loadLight(vPointLights.at(i).get(), i, true);
-			else shader->enablePointLight(i, false);
-			
-			if (i<m) shader->loadLight(vSpotLights.at(i).get(), i, true);
-			else shader->enableSpotLight(i, false);
-		}
+
+		if (set >= 0) mLights.load(shader, set);
 	};
 }
 
@@ -55,6 +55,20 @@ namespace Pix {
 		return PointInSphere(center, radius(), closest);
 	}
 
+	void WorldObject::setSelected(bool selected) {
+		bSelected = selected;
+		if (pCluster != nullptr) pCluster->touch(nRecord);
+	}
+
+	void WorldObject::setTint(glm::vec4 tintCode) {
+		mTintCode = tintCode;
+		if (pCluster != nullptr) pCluster->touch(nRecord);
+	}
+
+	void WorldObject::moved() {
+		if (CONFIG.ISSTATIC && pCluster != nullptr) pCluster->moved(nRecord);
+	}
+
 	void WorldObject::process(World *world, float fElapsedTime) {
 
 		// process intrinsic animation
@@ -63,6 +77,9 @@ namespace Pix {
 			// apply rotation
 			rot() += CONFIG.animation.deltaRotation * fElapsedTime;
 
+			// the cluster only rereads the moving objects by itself
+			if (CONFIG.ISSTATIC && pCluster != nullptr) pCluster->touch(nRecord);
+
 			// apply scale pulse
 			if (CONFIG.animation.scalePulse > 0)
 				fRadiusAnimator = sinf(Fu::METRONOME) * CONFIG.animation.scalePulse;
@@ -11,11 +11,15 @@
 #include "WorldShader.hpp"
 #include "Camera.hpp"
 
+#include <cstring>
+
 namespace Pix {
 
 	WorldShader::WorldShader(const std::string& name)
 	: Shader3D(name) {
 	
+		LOC_TIME = getLocator("iTime");
+
 		// material locators
 		LOC_MAT_ILLUM =getLocator("material.illum");
 		LOC_MAT_AMBIENT =getLocator("material.ambient");
@@ -28,23 +32,46 @@ namespace Pix {
 		LOC_MAT_TEXTURE =getLocator("materialTexture");
 	}
 
+	bool WorldShader::changed(GLuint location, const void *value, size_t bytes) const {
+
+		// missing uniforms are -1, uploading to them does nothing
+		if (location >= MAX_SHADOWED) {
+			nUploads++;
+			return true;
+		}
+
+		if (location >= vShadow.size()) vShadow.resize(location + 1, {{0, 0, 0, 0}, false});
+
+		// bitwise, so NaNs and -0 are uploaded like any other change
+		UniformShadow_t &shadow = vShadow[location];
+		if (shadow.valid && memcmp(shadow.bits, value, bytes) == 0) {
+			nSkipped++;
+			return false;
+		}
+
+		memcpy(shadow.bits, value, bytes);
+		shadow.valid = true;
+		nUploads++;
+		return true;
+	}
+
 	void WorldShader::loadMaterial(Material& m) {
-		setVec3 (LOC_MAT_AMBIENT,    m.Ka.x, m.Ka.y, m.Ka.z);
-		setVec3 (LOC_MAT_DIFFUSE,    m.Kd.x, m.Kd.y, m.Kd.z);
-		setVec3 (LOC_MAT_SPECULAR,   m.Ks.x, m.Ks.y, m.Ks.z);
-		setFloat(LOC_MAT_SHININESS,  m.Ns);
-		setInt  (LOC_MAT_ILLUM, 	 m.illum);
-		setVec4 (LOC_MAT_ANIMREGION, m.AnR.x, m.AnR.y, m.AnR.z, m.AnR.w);
-		setVec3 (LOC_MAT_ANIMCONFIG, m.AnC.x, m.AnC.y, m.AnC.z);
+		uploadVec3 (LOC_MAT_AMBIENT,    m.Ka.x, m.Ka.y, m.Ka.z);
+		uploadVec3 (LOC_MAT_DIFFUSE,    m.Kd.x, m.Kd.y, m.Kd.z);
+		uploadVec3 (LOC_MAT_SPECULAR,   m.Ks.x, m.Ks.y, m.Ks.z);
+		uploadFloat(LOC_MAT_SHININESS,  m.Ns);
+		uploadInt  (LOC_MAT_ILLUM, 	    m.illum);
+		uploadVec4 (LOC_MAT_ANIMREGION, m.AnR.x, m.AnR.y, m.AnR.z, m.AnR.w);
+		uploadVec3 (LOC_MAT_ANIMCONFIG, m.AnC.x, m.AnC.y, m.AnC.z);
 	}
 
 	void WorldShader::bindMaterial(Material& m) {
 		if (m.textureKd != nullptr) {
-			setInt(LOC_MAT_HASTEXTURE, 1);
+			uploadInt(LOC_MAT_HASTEXTURE, 1);
 			textureUnit(LOC_MAT_TEXTURE, m.textureKd);
 			m.textureKd->bind();
 		} else {
-			setInt(LOC_MAT_HASTEXTURE, 0);
+			uploadInt(LOC_MAT_HASTEXTURE, 0);
 		}
 	}
 
@@ -157,7 +157,7 @@ namespace Pix {
 		glm::vec3 mInterpolatedPosition = {};
 
 		/** Current frustum */
-		Frustum *mFrustum;
+		Frustum *mFrustum = nullptr;
 		
 		// Mouse parameters
 		float mMouseSensitivity = 1;
@@ -24,7 +24,6 @@ namespace Pix {
 
 	class CameraPicker : public FuExtension {
 
-		static constexpr int RECURSION_COUNT = 200;
 		static constexpr float RAY_RANGE = 3000;
 		static CameraPicker *pInstance;
 
@@ -43,16 +42,6 @@ namespace Pix {
 
 		glm::vec4 toEyeCoords(glm::vec4 &clipCoords);
 
-		//**********************************************************
-
-		glm::vec3 getPointOnRay(glm::vec3 &ray, float distance);
-
-		bool binarySearch(glm::vec3 &result, int count, float start, float finish, glm::vec3 ray);
-
-		bool intersectionInRange(float start, float finish, glm::vec3 &ray);
-
-		bool isUnderGround(glm::vec3 &testPoint);
-
 	private:
 		CameraPicker(World *world);
 
@@ -0,0 +1,78 @@
+//
+//  DecalLayer.hpp
+//  PixFu Engine
+//
+//  The fading decals of a terrain canvas, kept apart from the canvas pixels
+//  so fading one never touches what is below or above it. It is stored in
+//  tiles allocated on first write, premultiplied: blending over a blank pixel
+//  leaves color * alpha in it. The canvas composes the layer over its own
+//  pixels as it uploads them, so the GPU sees a single texture.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "Drawable.hpp"
+
+namespace Pix {
+
+	class DecalLayer {
+
+		/** Tile side, in storage pixels */
+		static constexpr int TILE = 64;
+
+		/** Storage dimensions, same as the canvas */
+		const int WIDTH, HEIGHT;
+
+		/** Storage dimensions, in tiles */
+		const int COLS, ROWS;
+
+		/** Tiles, nullptr if never drawn */
+		std::vector<Pixel *> vTiles;
+
+		int nTiles = 0;
+
+		Pixel *tile(int col, int row);
+
+	public:
+
+		/**
+		 * Creates an empty layer
+		 * @param width Width in storage pixels
+		 * @param height Height in storage pixels
+		 */
+		DecalLayer(int width, int height);
+
+		~DecalLayer();
+
+		DecalLayer(const DecalLayer &) = delete;
+
+		DecalLayer &operator=(const DecalLayer &) = delete;
+
+		/** Blends a color over the pixels [x0, x1] of row y */
+		void blendSpan(int x0, int x1, int y, Pixel color);
+
+		/** Blanks the pixels [x0, x1] of row y */
+		void clearSpan(int x0, int x1, int y);
+
+		/** Whether anything was drawn in the rectangle [x0, x1) x [y0, y1) */
+		bool covers(int x0, int y0, int x1, int y1) const;
+
+		/**
+		 * Composes the rectangle [x0, x1) x [y0, y1) of the layer over a copy of the canvas pixels there
+		 * @param dst The copy, its top left pixel is (x0, y0)
+		 * @param stride Pixels per row of the copy
+		 */
+		void compose(int x0, int y0, int x1, int y1, Pixel *dst, int stride) const;
+
+		/** Memory used, in bytes */
+		size_t bytes() const;
+	};
+
+	inline size_t DecalLayer::bytes() const { return nTiles * TILE * TILE * sizeof(Pixel); }
+
+}
@@ -0,0 +1,178 @@
+//
+//  DecalQueue.hpp
+//  PixFu Engine
+//
+//  Marks left on the terrain canvas: skid marks, tyre trails, debug shapes.
+//  Gameplay code queues stamps and lines while it runs, and the queue draws
+//  them all at once before the terrains are rendered: every decal becomes a
+//  list of blended spans, and only its bounding box is marked for upload.
+//
+//  A decal is drawn on every terrain its bounds overlap. One with a life goes
+//  on the decal layer of the canvas, and fades out in a few steps: at every
+//  step the layer is redrawn under its footprint from the decals still
+//  fading, so only its own contribution fades. Permanent marks drawn while it
+//  fades show beneath it until it is gone.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "Drawable.hpp"
+#include "DirtyRegions.hpp"
+
+namespace Pix {
+
+	class Terrain;
+
+	class TerrainCanvas;
+
+	class DecalLayer;
+
+	typedef enum eDecalKind {
+		DECAL_STAMP, DECAL_LINE
+	} DecalKind_t;
+
+	typedef struct sDecal {
+		DecalKind_t kind;
+		/** Center of a stamp, or line ends. World x/z. */
+		glm::vec2 a, b;
+		/** Stamp radius, or half the line width. World units. */
+		float radius;
+		Pixel color;
+		/** Seconds until the decal is gone, 0 is permanent */
+		float life;
+		float age;
+		/** Fade steps already applied */
+		int step;
+	} Decal_t;
+
+	class DecalQueue {
+
+	public:
+
+		/** Finds the terrains that overlap a world x/z rectangle */
+		typedef std::function<void(const glm::vec2 &minWorld, const glm::vec2 &maxWorld,
+								   std::vector<Terrain *> &terrains)> TerrainResolver_t;
+
+	private:
+
+		static std::string TAG;
+
+		/** Number of steps a decal takes to fade out */
+		static constexpr int FADE_STEPS = 8;
+
+		/** Side of the cells that bucket the fading decals, world units */
+		static constexpr float BUCKET = 256;
+
+		/** Decals to draw on the next flush */
+		std::vector<Decal_t> vQueued;
+
+		/** Drawn decals that are fading, in drawing order */
+		std::vector<Decal_t> vFading;
+
+		/** Scratch lists of the fading decals that took a step, and of the terrains under a decal */
+		std::vector<size_t> vStepped;
+		std::vector<Terrain *> vTargets;
+
+		/** Terrains whose canvas has a decal layer, freed once nothing is fading */
+		std::vector<Terrain *> vLayered;
+
+		/** Terrains where decals took a step, and the storage rectangles to redraw on each, merged */
+		std::vector<Terrain *> vRedrawTerrains;
+		std::vector<DirtyRegions> vRedrawRegions;
+
+		/** The fading decals in every bucket they overlap, by index, built when something is redrawn */
+		std::unordered_map<int64_t, std::vector<size_t>> mBuckets;
+
+		/** Scratch list of the decals found in the buckets, and the last query that found every decal */
+		std::vector<size_t> vCandidates;
+		std::vector<uint32_t> vFound;
+		uint32_t nQuery = 0;
+
+		/** Storage pixels per world unit, and terrain origin, of the canvas being drawn */
+		float fScale = 1;
+		glm::vec2 mOrigin = {0, 0};
+
+		/** The row y of a decal, in storage pixels. Whether it covers it and from where to where. */
+		bool row(const Decal_t &decal, float y, float &x0, float &x1) const;
+
+		/** Storage rectangle that holds a decal */
+		DirtyRect_t bounds(const Decal_t &decal) const;
+
+		/**
+		 * Runs an operation on every row span covered by a decal, inside a storage rectangle
+		 * @return The bounds of the spans
+		 */
+		template<typename Func>
+		DirtyRect_t rasterize(const Decal_t &decal, const DirtyRect_t &clip, Func spanOp);
+
+		/** Buckets the fading decals */
+		void bucket();
+
+		/** Finds the fading decals that may overlap a world x/z rectangle, into vCandidates, in drawing order */
+		void candidates(const glm::vec2 &minWorld, const glm::vec2 &maxWorld);
+
+		/** Finds the terrains a decal overlaps, into vTargets */
+		void resolve(const Decal_t &decal, const TerrainResolver_t &resolver);
+
+		/** The canvas of a terrain to draw on, with its scale and origin. nullptr if it has none. */
+		TerrainCanvas *target(Terrain *terrain);
+
+		/** The decal layer of a terrain canvas */
+		DecalLayer *layer(Terrain *terrain, TerrainCanvas *canvas);
+
+		/** Redraws the decal layer of a canvas inside a storage rectangle, from the fading decals. Needs bucket(). */
+		void redraw(Terrain *terrain, TerrainCanvas *canvas, const DirtyRect_t &rect);
+
+	public:
+
+		/**
+		 * Queues a filled circle
+		 * @param posWorld Center, the height is ignored
+		 * @param radius Radius in world units
+		 * @param color Color, its alpha blends it with the canvas
+		 * @param life Seconds until it fades out, 0 for permanent
+		 */
+		void stamp(const glm::vec3 &posWorld, float radius, Pixel color, float life = 0);
+
+		/**
+		 * Queues a line with round ends
+		 * @param from Start, the height is ignored
+		 * @param to End
+		 * @param width Width in world units
+		 * @param color Color, its alpha blends it with the canvas
+		 * @param life Seconds until it fades out, 0 for permanent
+		 */
+		void line(const glm::vec3 &from, const glm::vec3 &to, float width, Pixel color, float life = 0);
+
+		/**
+		 * Draws the queued decals and advances the fading ones. Main thread, once per frame.
+		 * @param elapsed Frame time
+		 * @param resolver Finds the terrains to draw a decal on
+		 */
+		void flush(float elapsed, const TerrainResolver_t &resolver);
+
+		/** Forgets all decals, queued and fading. Does not touch the canvases: what is fading stays. */
+		void clear();
+
+		/** Number of decals waiting for the next flush */
+		size_t queued() const;
+
+		/** Number of decals fading */
+		size_t fading() const;
+	};
+
+	inline size_t DecalQueue::queued() const { return vQueued.size(); }
+
+	inline size_t DecalQueue::fading() const { return vFading.size(); }
+
+}
@@ -0,0 +1,96 @@
+//
+//  DirtyRegions.hpp
+//  PixFu Engine
+//
+//  Bookkeeping of the modified rectangles of a pixel buffer, so only those need
+//  to be sent to the GPU. Nearby rectangles are merged while the merge does not
+//  waste too many clean pixels, and the list is kept short. Pending regions are
+//  handed out under a byte budget, splitting big rectangles by rows.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace Pix {
+
+	typedef struct sDirtyRect {
+		/** top left corner, inclusive */
+		int x0, y0;
+		/** bottom right corner, exclusive */
+		int x1, y1;
+
+		inline int width() const { return x1 - x0; }
+
+		inline int height() const { return y1 - y0; }
+
+		inline size_t area() const { return (size_t) width() * height(); }
+	} DirtyRect_t;
+
+	class DirtyRegions {
+
+		/** Maximum number of rectangles, more are merged with their best match */
+		static constexpr int MAXRECTS = 32;
+
+		/** Rectangles merge if the union is not bigger than this times the sum of both */
+		static constexpr float MERGE_WASTE = 1.5F;
+
+		/** Buffer dimensions */
+		const int WIDTH, HEIGHT;
+
+		/** Pending rectangles, they do not overlap */
+		std::vector<DirtyRect_t> vRects;
+
+		static DirtyRect_t join(const DirtyRect_t &a, const DirtyRect_t &b);
+
+		static bool touch(const DirtyRect_t &a, const DirtyRect_t &b);
+
+		void mergeOverlapping(DirtyRect_t rect);
+
+	public:
+
+		/**
+		 * @param width Buffer width in pixels
+		 * @param height Buffer height in pixels
+		 */
+		DirtyRegions(int width, int height);
+
+		/** Marks a rectangle [x0, x1) x [y0, y1) as modified. It is clipped to the buffer. */
+		void add(int x0, int y0, int x1, int y1);
+
+		/** Marks the whole buffer as modified */
+		void addAll();
+
+		/** Forgets all pending regions */
+		void clear();
+
+		/** Whether there is nothing pending */
+		bool empty() const;
+
+		/** Pending rectangles */
+		const std::vector<DirtyRect_t> &rects() const;
+
+		/** Number of pending pixels */
+		size_t pixels() const;
+
+		/**
+		 * Takes pending regions, up to a byte budget. Rectangles that do not fit are split by rows,
+		 * at least one row is always taken so the queue makes progress.
+		 * @param budget Maximum bytes to take
+		 * @param bytesPerPixel Pixel size
+		 * @param out Receives the rectangles taken
+		 * @return Bytes taken
+		 */
+		size_t take(size_t budget, size_t bytesPerPixel, std::vector<DirtyRect_t> &out);
+	};
+
+	inline bool DirtyRegions::empty() const { return vRects.empty(); }
+
+	inline const std::vector<DirtyRect_t> &DirtyRegions::rects() const { return vRects; }
+
+	inline void DirtyRegions::clear() { vRects.clear(); }
+
+}
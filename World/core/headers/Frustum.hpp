@@ -29,6 +29,11 @@ namespace Pix {
 		bool IsBoxVisible(const glm::vec3 &minp, const glm::vec3 &maxp) const;
 		bool IsBoxVisible(const glm::vec3 &center, float radius) const;
 
+		static constexpr int PLANES = 6;
+
+		// plane i as (normal, distance), inside is positive. Not normalized.
+		const glm::vec4 &plane(int i) const;
+
 	private:
 		enum Planes {
 			Left = 0,
@@ -93,6 +98,10 @@ namespace Pix {
 
 	}
 
+	inline const glm::vec4 &Frustum::plane(int i) const {
+		return m_planes[i];
+	}
+
 	inline bool Frustum::IsBoxVisible(const glm::vec3 &center, float radius) const {
 		return IsBoxVisible(center - radius, center + radius);
 	}
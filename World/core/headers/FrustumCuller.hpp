@@ -0,0 +1,89 @@
+//
+//  FrustumCuller.hpp
+//  PixFu Engine
+//
+//  Tests many bounding spheres against the camera frustum at once. Centers
+//  and radii are kept as structure of arrays, and 4 spheres are tested per
+//  step against the normalized planes. A sphere is out when it is entirely
+//  behind one plane.
+//
+//  The culler remembers, for every group of 4 spheres, the plane that
+//  rejected the whole group on the last call, and tries it first: objects
+//  behind the camera keep being rejected by the same plane frame after frame.
+//  This assumes the spheres are added in the same order on every call.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Frustum.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	typedef enum eCullResult {
+		CULL_OUTSIDE, CULL_INTERSECT, CULL_INSIDE
+	} CullResult_t;
+
+	class FrustumCuller {
+
+		/** Normalized planes: normal, distance */
+		float mPlanes[Frustum::PLANES][4] = {};
+
+		/** Spheres, padded to a multiple of 4 */
+		std::vector<float> vX, vY, vZ, vRadius;
+
+		size_t nCount = 0;
+
+		/** Plane that rejected each group of 4 on the last call */
+		std::vector<uint8_t> vLastPlane;
+
+		/** Bit i is set if sphere i is visible */
+		std::vector<uint32_t> vMask;
+
+	public:
+
+		/** Takes the planes of the frustum. Call when the camera changes. */
+		void setFrustum(const Frustum &frustum);
+
+		/** Starts a new list of spheres */
+		void clear();
+
+		void add(const glm::vec3 &center, float radius);
+
+		size_t size() const;
+
+		/**
+		 * Tests the spheres
+		 * @param visible If not null, receives the indices of the visible spheres
+		 * @return Number of visible spheres
+		 */
+		size_t cull(std::vector<size_t> *visible = nullptr);
+
+		/**
+		 * Classifies a box against the frustum, for culling groups of objects at once
+		 * @param min Box min corner
+		 * @param max Box max corner
+		 * @return Whether the box is out, crosses a plane, or is entirely inside
+		 */
+		CullResult_t classify(const glm::vec3 &min, const glm::vec3 &max) const;
+
+		/** Visibility bits after cull(), 32 spheres per word */
+		const std::vector<uint32_t> &mask() const;
+
+		bool isVisible(size_t index) const;
+	};
+
+	inline size_t FrustumCuller::size() const { return nCount; }
+
+	inline const std::vector<uint32_t> &FrustumCuller::mask() const { return vMask; }
+
+	inline bool FrustumCuller::isVisible(size_t index) const {
+		return (vMask[index >> 5] >> (index & 31)) & 1;
+	}
+
+}
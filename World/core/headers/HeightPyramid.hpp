@@ -0,0 +1,128 @@
+//
+//  HeightPyramid.hpp
+//  PixFu Engine
+//
+//  A min/max mip pyramid built over a terrain heightmap. Level 0 holds the raw
+//  heightmap samples, every upper level holds the minimum and maximum of the 2x2
+//  cells below it. This allows exact hierarchical ray marching over the terrain:
+//  whole regions where the ray stays above the maximum are skipped in one step.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Drawable.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class HeightPyramid {
+
+		/** Level 0 dimensions (heightmap pixels) */
+		const int WIDTH, HEIGHT;
+
+		/** Converts a heightmap sample into world height */
+		const float SCALE;
+
+		/** Level dimensions */
+		std::vector<int> vWidths, vHeights;
+
+		/** Level 0: raw samples. min == max */
+		std::vector<uint8_t> vHeights0;
+
+		/** Levels 1..n: minimum and maximum of the children */
+		std::vector<std::vector<uint8_t>> vMin, vMax;
+
+		uint8_t sampleMin(int level, int x, int z) const;
+
+		uint8_t sampleMax(int level, int x, int z) const;
+
+	public:
+
+		/**
+		 * Builds the pyramid
+		 * @param heightMap The heightmap, only the red channel is used
+		 * @param width Number of samples to read horizontally
+		 * @param height Number of samples to read vertically
+		 * @param scale Multiplier to convert a [0..255] sample to world height
+		 */
+		HeightPyramid(Drawable *heightMap, int width, int height, float scale);
+
+		/** Number of levels, level 0 included */
+		int levels() const;
+
+		/** Nodes across and down a level. Node (x, z) of level l covers the samples [x << l, (x + 1) << l). */
+		int levelWidth(int level) const;
+
+		int levelHeight(int level) const;
+
+		/** Height of a level 0 cell, in world units. 0 out of bounds. */
+		float height(int x, int z) const;
+
+		/** Maximum height in the node (x, z) of the level, in world units */
+		float maxHeight(int level, int x, int z) const;
+
+		/** Minimum height in the node (x, z) of the level, in world units */
+		float minHeight(int level, int x, int z) const;
+
+		/** Maximum height of the whole heightmap */
+		float maxHeight() const;
+
+		/** Memory used by the pyramid, in bytes */
+		size_t bytes() const;
+
+		/**
+		 * Casts a ray against the heightfield. Every heightmap pixel is treated as
+		 * a column of constant height, as Terrain::getHeight does, so the result is
+		 * exact: thin ridges cannot be skipped.
+		 *
+		 * @param origin Ray origin in heightmap coordinates (x, z pixels; y world height)
+		 * @param direction Ray direction (normalized)
+		 * @param maxDistance Ray length
+		 * @param distance Receives the distance to the hit point
+		 * @return Whether the ray hits the terrain
+		 */
+		bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) const;
+	};
+
+	inline int HeightPyramid::levels() const { return (int) vWidths.size(); }
+
+	inline int HeightPyramid::levelWidth(int level) const { return vWidths[level]; }
+
+	inline int HeightPyramid::levelHeight(int level) const { return vHeights[level]; }
+
+	inline uint8_t HeightPyramid::sampleMin(int level, int x, int z) const {
+		return level == 0 ? vHeights0[z * WIDTH + x] : vMin[level - 1][z * vWidths[level] + x];
+	}
+
+	inline uint8_t HeightPyramid::sampleMax(int level, int x, int z) const {
+		return level == 0 ? vHeights0[z * WIDTH + x] : vMax[level - 1][z * vWidths[level] + x];
+	}
+
+	inline float HeightPyramid::height(int x, int z) const {
+		return (x >= 0 && z >= 0 && x < WIDTH && z < HEIGHT) ? SCALE * vHeights0[z * WIDTH + x] : 0;
+	}
+
+	inline float HeightPyramid::maxHeight(int level, int x, int z) const {
+		return SCALE * sampleMax(level, x, z);
+	}
+
+	inline float HeightPyramid::minHeight(int level, int x, int z) const {
+		return SCALE * sampleMin(level, x, z);
+	}
+
+	inline float HeightPyramid::maxHeight() const {
+		return maxHeight(levels() - 1, 0, 0);
+	}
+
+	inline size_t HeightPyramid::bytes() const {
+		size_t total = vHeights0.size();
+		for (int i = 0, l = (int) vMin.size(); i < l; i++) total += vMin[i].size() + vMax[i].size();
+		return total;
+	}
+
+}
@@ -0,0 +1,89 @@
+//
+//  HorizonMap.hpp
+//  PixFu Engine
+//
+//  The terrain horizon around the camera. Space around the eye is split in
+//  azimuth sectors and distance rings. For every sector and ring the map
+//  holds the steepest slope, height over distance, that the terrain reaches
+//  up to that ring, measured with the lowest the terrain can be anywhere in
+//  the sector there (see Terrain::lowest).
+//
+//  A sphere is hidden if, in every sector it spans, the horizon before it is
+//  steeper than the steepest line from the eye to the sphere. The terrain
+//  heights are lower bounds, so what is rejected is never visible.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class Terrain;
+
+	class HorizonMap {
+
+		static std::string TAG;
+
+		/** First ring, and the least distance between rings, world units */
+		static constexpr float FIRST_RING = 16;
+
+		const int SECTORS;
+
+		/** Sector width, radians, and the direction of every sector center */
+		const float SECTOR;
+		std::vector<float> vCos, vSin;
+
+		/** Ring radii, up to the distance they were built for */
+		std::vector<float> vRings;
+		float fRingsDistance = -1;
+
+		/** Steepest terrain slope up to every ring: vSlopes[sector * rings + ring] */
+		std::vector<float> vSlopes;
+
+		glm::vec3 mEye = {0, 0, 0};
+
+		mutable int nTested = 0, nHidden = 0;
+
+	public:
+
+		/** Finds the terrain under a world position */
+		typedef std::function<Terrain *(const glm::vec3 &posWorld)> TerrainResolver_t;
+
+		/** @param sectors Azimuth sectors around the eye */
+		explicit HorizonMap(int sectors = 256);
+
+		/**
+		 * Builds the horizon for a new frame
+		 * @param eyeWorld Camera position, world coordinates
+		 * @param maxDistance Farthest terrain to consider, world units
+		 * @param terrainAt Finds the terrain under a position
+		 */
+		void build(const glm::vec3 &eyeWorld, float maxDistance, const TerrainResolver_t &terrainAt);
+
+		/**
+		 * Tests a sphere, world coordinates
+		 * @return false if the terrain hides the whole sphere
+		 */
+		bool visible(const glm::vec3 &centerWorld, float radius) const;
+
+		/** Tests a box by its bounding sphere, world coordinates */
+		bool visible(const glm::vec3 &minWorld, const glm::vec3 &maxWorld) const;
+
+		/** Spheres tested and found hidden since build() */
+		int tested() const;
+
+		int hidden() const;
+	};
+
+	inline int HorizonMap::tested() const { return nTested; }
+
+	inline int HorizonMap::hidden() const { return nHidden; }
+
+}
@@ -0,0 +1,119 @@
+//
+//  ImpostorBatch.hpp
+//  PixFu Engine
+//
+//  Far detail tier of an object cluster: the objects past their impostor
+//  distance are drawn as camera facing quads, textured from a pre-rendered
+//  atlas of the model seen from around it. The atlas is a sprite sheet of one
+//  row of square cells, cell i being the model seen from i / numX of a turn
+//  around its vertical axis, starting at +Z. It is described and loaded like
+//  any SpriteSheet, and the shader reads it with the same uniforms:
+//
+//    layout(location = 0) in vec2 corner;            // quad corner, -1..1
+//    layout(location = 1) in vec4 impostorSphere;    // center xyz and radius, render units
+//    layout(location = 2) in vec4 impostorTint;
+//    layout(location = 3) in float impostorSprite;   // cell in the sheet
+//    uniform vec4 iSpriteSheet;                      // width, height, numX, numY
+//    uniform sampler2D sampler;
+//
+//  plus the projection and view matrices of Shader3D. Cells are alpha tested,
+//  so impostors write depth like the models and need no sorting. All the
+//  impostors of an atlas go in one instanced draw.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OpenGL.h"
+#include "Shader.hpp"
+#include "Texture2D.hpp"
+#include "SpriteSheet.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+namespace Pix {
+
+	typedef struct sImpostor {
+		glm::vec4 sphere;
+		glm::vec4 tint;
+		float sprite;
+	} Impostor_t;
+
+	class ImpostorBatch {
+
+		static std::string TAG;
+
+		SpriteSheetInfo_t sInfo;
+
+		Texture2D *pTexture = nullptr;
+
+		std::vector<Impostor_t> vImpostors;
+
+		/** The quad, and the per impostor buffer that feeds it */
+		GLuint mQuadVao = 0, mQuadBuffer = 0, mBuffer = 0;
+
+		/** Impostors the GPU buffer can hold */
+		size_t nCapacity = 0;
+
+		/** Uniform locations, looked up once for the shader program they belong to */
+		const Shader *pLocated = nullptr;
+		GLuint nLocatedProgram = 0;
+		GLint LOC_SPRITESHEET = -1, LOC_SAMPLER = -1;
+
+		/** Uploads the atlas and builds the quad. Main thread. */
+		void init();
+
+	public:
+
+		/** Attribute locations */
+		static constexpr GLuint LOC_CORNER = 0, LOC_SPHERE = 1, LOC_TINT = 2, LOC_SPRITE = 3;
+
+		/** @param filename The atlas png, one row of square cells */
+		explicit ImpostorBatch(const std::string &filename);
+
+		virtual ~ImpostorBatch();
+
+		void clear();
+
+		/**
+		 * Adds an impostor, facing the camera
+		 * @param eyeWorld Camera position, world coordinates
+		 * @param posWorld Object position, world coordinates
+		 * @param yaw Object rotation around the vertical axis, radians
+		 * @param radius Object draw radius, render units
+		 * @param tint Object tint
+		 */
+		void add(const glm::vec3 &eyeWorld, const glm::vec3 &posWorld, float yaw, float radius, const glm::vec4 &tint);
+
+		/**
+		 * The atlas cell that shows the object as the camera sees it
+		 * @param eyeWorld Camera position, world coordinates
+		 * @param posWorld Object position, world coordinates
+		 * @param yaw Object rotation around the vertical axis, radians
+		 */
+		int view(const glm::vec3 &eyeWorld, const glm::vec3 &posWorld, float yaw) const;
+
+		/** Sends the impostors and draws them at once. The shader must be in use. */
+		void draw(Shader *shader);
+
+		/** Cells around the model */
+		int views() const;
+
+		size_t size() const;
+
+		bool empty() const;
+	};
+
+	inline void ImpostorBatch::clear() { vImpostors.clear(); }
+
+	inline int ImpostorBatch::views() const { return sInfo.numX; }
+
+	inline size_t ImpostorBatch::size() const { return vImpostors.size(); }
+
+	inline bool ImpostorBatch::empty() const { return vImpostors.empty(); }
+
+}
@@ -0,0 +1,79 @@
+//
+//  InstanceBuffer.hpp
+//  PixFu Engine
+//
+//  Per instance data for instanced draws: the model transform and the tint of
+//  every visible object of a cluster. The list is built on the CPU, without
+//  GL, and uploaded to one vertex buffer that feeds the instance attributes
+//  of the cluster meshes:
+//
+//    layout(location = 3) in mat4 instanceTransform;   // 3, 4, 5, 6
+//    layout(location = 7) in vec4 instanceTint;
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OpenGL.h"
+#include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
+
+namespace Pix {
+
+	typedef struct sInstance {
+		glm::mat4 transform;
+		glm::vec4 tint;
+	} Instance_t;
+
+	class InstanceBuffer {
+
+		static std::string TAG;
+
+		std::vector<Instance_t> vInstances;
+
+		GLuint mBuffer = 0;
+
+		/** Instances the GPU buffer can hold */
+		size_t nCapacity = 0;
+
+	public:
+
+		/** Attribute locations, the transform takes four */
+		static constexpr GLuint LOC_TRANSFORM = 3, LOC_TINT = 7;
+
+		virtual ~InstanceBuffer();
+
+		void clear();
+
+		void add(const glm::mat4 &transform, const glm::vec4 &tint);
+
+		size_t size() const;
+
+		bool empty() const;
+
+		const Instance_t *data() const;
+
+		/** Sends the instances to the GPU. Main thread. */
+		void upload();
+
+		/** Points the instance attributes of the bound VAO at this buffer. After the first upload. */
+		void attach();
+	};
+
+	inline void InstanceBuffer::clear() { vInstances.clear(); }
+
+	inline void InstanceBuffer::add(const glm::mat4 &transform, const glm::vec4 &tint) {
+		vInstances.push_back({transform, tint});
+	}
+
+	inline size_t InstanceBuffer::size() const { return vInstances.size(); }
+
+	inline bool InstanceBuffer::empty() const { return vInstances.empty(); }
+
+	inline const Instance_t *InstanceBuffer::data() const { return vInstances.data(); }
+
+}
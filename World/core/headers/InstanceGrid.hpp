@@ -0,0 +1,81 @@
+//
+//  InstanceGrid.hpp
+//  PixFu Engine
+//
+//  Groups the static objects of a cluster into square cells on the ground
+//  plane, each with the bounding box of its objects, so the culler can reject
+//  or accept a whole cell, or the whole cluster, with one box test. Only the
+//  objects of cells that cross the frustum are tested one by one.
+//
+//  Only occupied cells are stored. The grid is built from a snapshot of the
+//  objects: rebuild it when they move.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+namespace Pix {
+
+	typedef struct sInstanceCell {
+		/** Bounds of the spheres of the objects in the cell */
+		glm::vec3 min, max;
+		/** Objects are vMembers[start .. end) */
+		unsigned start, end;
+	} InstanceCell_t;
+
+	class InstanceGrid {
+
+		const float CELLSIZE;
+
+		std::vector<InstanceCell_t> vCells;
+
+		/** Object indices, grouped by cell */
+		std::vector<size_t> vMembers;
+
+		/** Bounds of all cells */
+		glm::vec3 mMin = {0, 0, 0}, mMax = {0, 0, 0};
+
+	public:
+
+		/** @param cellSize Cell side, in the units of the spheres */
+		explicit InstanceGrid(float cellSize);
+
+		/**
+		 * (Re)builds the grid
+		 * @param spheres Center and radius of every object
+		 * @param indices The object index to store for every sphere
+		 */
+		void build(const std::vector<glm::vec4> &spheres, const std::vector<size_t> &indices);
+
+		void clear();
+
+		bool empty() const;
+
+		const std::vector<InstanceCell_t> &cells() const;
+
+		/** Objects of a cell */
+		const size_t *members(const InstanceCell_t &cell) const;
+
+		const glm::vec3 &min() const;
+
+		const glm::vec3 &max() const;
+	};
+
+	inline bool InstanceGrid::empty() const { return vCells.empty(); }
+
+	inline const std::vector<InstanceCell_t> &InstanceGrid::cells() const { return vCells; }
+
+	inline const size_t *InstanceGrid::members(const InstanceCell_t &cell) const { return vMembers.data() + cell.start; }
+
+	inline const glm::vec3 &InstanceGrid::min() const { return mMin; }
+
+	inline const glm::vec3 &InstanceGrid::max() const { return mMax; }
+
+}
@@ -0,0 +1,79 @@
+//
+//  LightBlock.hpp
+//  PixFu Engine
+//
+//  All the point and spot lights of the world in one uniform buffer, shared
+//  by the terrain and object shaders. The buffer is packed on the CPU every
+//  frame, and only the lights that changed since the last frame are sent.
+//  Draws then pick their lights from the block by index, see
+//  LightingShader::loadLightIndices(). The shaders declare:
+//
+//    struct PointLightData { vec4 position; vec4 ambient; vec4 diffuse; vec4 specular; vec4 params; };
+//    struct SpotLightData { vec4 position; vec4 direction; vec4 ambient; vec4 diffuse; vec4 specular;
+//                           vec4 params; vec4 cutOff; };
+//    layout(std140) uniform Lights {
+//        PointLightData points[64];
+//        SpotLightData spots[64];
+//    };
+//
+//  params is constant, linear, quadratic and enabled; cutOff holds the cosines
+//  of the inner and outer cut off angles.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "OpenGL.h"
+#include "Lighting.hpp"
+
+namespace Pix {
+
+	class LightBlock {
+
+		static std::string TAG;
+
+		/** Floats per light, in std140 vec4s */
+		static constexpr size_t POINT_FLOATS = 5 * 4, SPOT_FLOATS = 7 * 4;
+
+		/** The block as sent to the GPU */
+		std::vector<float> vData;
+
+		GLuint mBuffer = 0;
+
+		/** Floats changed since the last upload */
+		size_t nDirtyFrom = 0, nDirtyTo = 0;
+
+		/** Lights changed on the last update */
+		int nChanged = 0;
+
+		/** Copies a light into the block, marking it dirty if it differs */
+		void pack(size_t offset, const float *light, size_t floats);
+
+	public:
+
+		/** Lights of each kind the block holds */
+		static constexpr int MAXPOINTS = 64, MAXSPOTS = 64;
+
+		LightBlock();
+
+		~LightBlock();
+
+		/** Packs the lights, tracking the ones that changed */
+		void update(const std::vector<std::shared_ptr<PointLight>> &points,
+					const std::vector<std::shared_ptr<SpotLight>> &spots);
+
+		/** Sends the changed lights, and binds the buffer to the shader block binding point */
+		void upload();
+
+		/** Lights changed on the last update */
+		int changed() const;
+	};
+
+	inline int LightBlock::changed() const { return nChanged; }
+
+}
@@ -0,0 +1,119 @@
+//
+//  LightGrid.hpp
+//  PixFu Engine
+//
+//  The shaders have a few light slots, the level may have many lights. The
+//  grid bins the point and spot lights by their influence radius into square
+//  cells on the ground plane, and picks for a position the lights that light
+//  it most. Selections are kept as light sets, numbered for the frame, that
+//  are loaded into the shader slots when a draw needs a different one.
+//
+//  Lights are rebinned every frame: they are few, and they move with the cars.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "Lighting.hpp"
+#include "HorizonMap.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class Frustum;
+
+	/** The lights chosen for a draw, indices into the world lights */
+	typedef struct sLightSet {
+		uint8_t points, spots;
+		uint16_t point[LightingShader::MAXLIGHTS];
+		uint16_t spot[LightingShader::MAXLIGHTS];
+	} LightSet_t;
+
+	class LightGrid {
+
+		static std::string TAG;
+
+		/** Lights covering more cells are tested from every cell */
+		static constexpr int MAXCELLS = 64;
+
+		/** Influence sphere of a light, render coordinates */
+		typedef struct sLightSphere {
+			glm::vec3 center;
+			float radius;
+			bool spot;
+			uint16_t index;
+		} LightSphere_t;
+
+		const float CELLSIZE;
+
+		std::vector<LightSphere_t> vSpheres;
+
+		/** Occupied cells, sorted by key, and their spheres as vCellSpheres[vCellStart[i] .. vCellStart[i + 1]) */
+		std::vector<int64_t> vCellKeys;
+		std::vector<unsigned> vCellStart;
+		std::vector<uint16_t> vCellSpheres;
+
+		/** The big lights */
+		std::vector<uint16_t> vEverywhere;
+
+		const std::vector<std::shared_ptr<PointLight>> *pPoints = nullptr;
+		const std::vector<std::shared_ptr<SpotLight>> *pSpots = nullptr;
+
+		std::vector<LightSet_t> vSets;
+
+		int64_t key(int col, int row) const;
+
+		/** Adds a light to the set if it ranks in the top of its kind */
+		static void rank(LightSet_t &set, float scores[2][LightingShader::MAXLIGHTS], const LightSphere_t &sphere, float score);
+
+		/** Stores a set, reusing the last one if equal */
+		int store(const LightSet_t &set);
+
+	public:
+
+		/** @param cellSize Cell side, render units */
+		explicit LightGrid(float cellSize);
+
+		/**
+		 * Bins the lights, and forgets the sets of the last frame
+		 * @param points The point lights
+		 * @param spots The spot lights
+		 * @param darkness Attenuation considered dark, sets the influence radius
+		 * @param horizon Lights that only reach what hides below it are left out. Optional.
+		 */
+		void build(const std::vector<std::shared_ptr<PointLight>> &points,
+				   const std::vector<std::shared_ptr<SpotLight>> &spots, float darkness,
+				   const HorizonMap *horizon = nullptr);
+
+		/**
+		 * Selects the lights that reach a position, nearest and biggest first
+		 * @param posRender Position, render coordinates
+		 * @return The light set
+		 */
+		int select(const glm::vec3 &posRender);
+
+		/**
+		 * Selects the lights in the view, for draws that span a large area
+		 * @param frustum The camera frustum, nullptr for all lights
+		 * @param eyeRender The camera position, render coordinates
+		 * @return The light set
+		 */
+		int select(const Frustum *frustum, const glm::vec3 &eyeRender);
+
+		/** Loads a light set into the shader light slots */
+		void load(LightingShader *shader, int set) const;
+
+		size_t size() const;
+	};
+
+	inline size_t LightGrid::size() const { return vSpheres.size(); }
+
+	inline int64_t LightGrid::key(int col, int row) const { return row * (INT64_C(1) << 32) + col; }
+
+}
@@ -130,7 +130,7 @@ namespace Pix {
 		bool enabled = true;
 		
 		/**
-		 * The radius for what is considered Dark (The target attenuation)
+		 * The radius for what is considered Dark (The target attenuation), in render units (like position)
 		 */
 
 		inline float calcRadius(float targetAttenuation) const {
@@ -140,7 +140,17 @@ namespace Pix {
 			// qx2 + lx +     d     = 0
 			// x = -l + sqrt((l*2 - 4*q*(c-1/a)))/(2 *q)
 			float d = params.constant - 1 / targetAttenuation;
-			return  ( -params.linear + glm::fastSqrt( params.linear*params.linear - 4 * params.quadratic * d  )) / 2 * params.quadratic;
+			if (params.quadratic == 0) return params.linear > 0 ? -d / params.linear : INFINITY;
+			return  ( -params.linear + glm::fastSqrt( params.linear*params.linear - 4 * params.quadratic * d  )) / (2 * params.quadratic);
+		}
+
+		/** calcRadius, remembered: the parameters do not change */
+		inline float radius(float targetAttenuation) const {
+			if (targetAttenuation != fRadiusAttenuation) {
+				fRadius = calcRadius(targetAttenuation);
+				fRadiusAttenuation = targetAttenuation;
+			}
+			return fRadius;
 		}
 		
 		inline static std::shared_ptr<PointLight> create(LightColor_t color, PointLightParams_t params, glm::vec3 position) {
@@ -150,6 +160,10 @@ namespace Pix {
 		PointLight(LightColor_t lcolor, PointLightParams_t lparams, glm::vec3 lposition)
 		: color(lcolor), params(lparams), position(lposition / 1000.0F) {}
 
+	private:
+
+		mutable float fRadius = 0, fRadiusAttenuation = 0;
+
 	};
 
 	/**
@@ -173,6 +187,7 @@ namespace Pix {
 		/** Whether */
 		bool enabled = true;
 		
+		/** The radius for what is considered Dark, in render units. Ignores the cone. */
 		float calcRadius(float targetAttenuation) const {
 
 			// 1/att =  (constant + linear * distance + quadratic * (distance2);
@@ -182,15 +197,37 @@ namespace Pix {
 			// x = -l + sqrt((l*2 - 4*q*d))/(2 *q)
 
 			const float d = params.constant - 1 / targetAttenuation;
-			return ( -params.linear + glm::fastSqrt( params.linear*params.linear - 4 * params.quadratic * d  )) / 2 * params.quadratic;
+			if (params.quadratic == 0) return params.linear > 0 ? -d / params.linear : INFINITY;
+			return ( -params.linear + glm::fastSqrt( params.linear*params.linear - 4 * params.quadratic * d  )) / (2 * params.quadratic);
+		}
+
+		/** calcRadius, remembered: the parameters do not change */
+		inline float radius(float targetAttenuation) const {
+			if (targetAttenuation != fRadiusAttenuation) {
+				fRadius = calcRadius(targetAttenuation);
+				fRadiusAttenuation = targetAttenuation;
+			}
+			return fRadius;
 		}
+
+		/** Cosines of the cut off angles, as the shaders take them */
+		inline float cutOffCosine() const { return fCutOffCosine; }
+
+		inline float outerCutOffCosine() const { return fOuterCutOffCosine; }
 		
 		inline static std::shared_ptr<SpotLight> create(LightColor_t color, SpotLightParams_t params, glm::vec3 position, glm::vec3 direction) {
 			return std::make_shared<SpotLight>(color, params, position, direction);
 		}
 		
 		SpotLight(LightColor_t lcolor, SpotLightParams_t lparams, glm::vec3 lposition, glm::vec3 ldirection)
-		: color(lcolor), params(lparams), position(lposition / 1000.0f), direction(ldirection) {}
+		: color(lcolor), params(lparams), position(lposition / 1000.0f), direction(ldirection),
+		  fCutOffCosine(cosf(lparams.cutOff)), fOuterCutOffCosine(cosf(lparams.outerCutOff)) {}
+
+	private:
+
+		const float fCutOffCosine, fOuterCutOffCosine;
+
+		mutable float fRadius = 0, fRadiusAttenuation = 0;
 
 	};
 
@@ -201,6 +238,22 @@ namespace Pix {
 
 
 	class LightingShader : public WorldShader {
+
+	public:
+
+		/** Light slots of each kind in the shaders */
+		static constexpr int MAXLIGHTS = 4;
+
+		/** Uniform buffer binding point of the Lights block */
+		static constexpr GLuint LIGHTBLOCK_BINDING = 1;
+
+	private:
+
+		/** Whether the lights come from the shared block */
+		bool bLightBlock = false;
+
+		GLuint LOC_POINTINDEX;
+		GLuint LOC_SPOTINDEX;
 		
 		// cached locators for quickest update
 		
@@ -231,7 +284,7 @@ namespace Pix {
 
 	public:
 		
-		LightingShader(const std::string& name, int maxLights = 4);
+		LightingShader(const std::string& name, int maxLights = MAXLIGHTS);
 		/** Loads the directional light */
 		void loadLight(const DirLight& light) const;
 		/** Loads a spotlight */
@@ -248,31 +301,39 @@ namespace Pix {
 		void enablePointLight(int index, bool enable) const;
 		/** Sets lighting mode */
 		void setLightingMode(LightMode_t lightMode) const;
+		/** Reads the lights from the shared Lights block, see LightBlock. The shader must be in use. */
+		void useLightBlock();
+		/** Whether the lights come from the shared block */
+		bool lightBlock() const;
+		/** Selects the lights of the block for the next draws, -1 fills the unused slots */
+		void loadLightIndices(const uint16_t *points, int pointCount, const uint16_t *spots, int spotCount) const;
 		
 	};
 
 	// this is a per-frame function so lets try to make it faster
 	inline void LightingShader::updateLight(PointLight *p, int index) const {
-		setVec3(PL_POSITION[index], p->position);
+		uploadVec3(PL_POSITION[index], p->position);
 	}
 
 
 	// this is a per-frame function so lets try to make it faster
 	inline void LightingShader::updateLight(SpotLight *s, int index) const {
-		setVec3(SL_POSITION[index], s->position);
-		setVec3(SL_DIRECTION[index], s->direction);
+		uploadVec3(SL_POSITION[index], s->position);
+		uploadVec3(SL_DIRECTION[index], s->direction);
 	}
 
+	inline bool LightingShader::lightBlock() const { return bLightBlock; }
+
 	inline void LightingShader::setLightingMode(LightMode_t lightMode) const {
-		setInt(L_LIGHTMODE, lightMode);
+		uploadInt(L_LIGHTMODE, lightMode);
 	}
 
 	inline void LightingShader::enableSpotLight(int index, bool enable) const {
-		setInt(SL_ENABLED[index], enable?1:0);
+		uploadInt(SL_ENABLED[index], enable?1:0);
 	}
 
 	inline void LightingShader::enablePointLight(int index, bool enable) const {
-		setInt(PL_ENABLED[index], enable?1:0);
+		uploadInt(PL_ENABLED[index], enable?1:0);
 	}
 
 }
@@ -11,6 +11,16 @@
 #include "LayerVao.hpp"
 #include "WorldMeta.hpp"
 #include "ObjectShader.hpp"
+#include "InstanceBuffer.hpp"
+#include "TransformBatch.hpp"
+#include "FrustumCuller.hpp"
+#include "InstanceGrid.hpp"
+#include "RenderQueue.hpp"
+#include "LightGrid.hpp"
+#include "ImpostorBatch.hpp"
+#include "StaticBatch.hpp"
+#include "OcclusionBuffer.hpp"
+#include "HorizonMap.hpp"
 
 
 namespace Pix {
@@ -21,22 +31,158 @@ namespace Pix {
 
 	class Camera;
 
-	typedef struct sVisible {
-		WorldObject *object;
-		glm::mat4 transformMatrix;
-	} Visible_t;
+	class Frustum;
+
+	/** Flags of an instance record */
+	typedef enum eInstanceFlags {
+		INSTANCE_STATIC = 1,
+		INSTANCE_SELECTED = 2
+	} InstanceFlags_t;
+
+	/** What drawing needs of an object, copied from it so the frame reads the instances in order */
+	typedef struct sInstanceRecord {
+		glm::vec3 pos;        // world coordinates
+		float radius;        // draw radius, render units
+		glm::vec3 rot;
+		uint32_t flags;        // InstanceFlags_t
+		glm::vec4 tint;        // selection applied
+	} InstanceRecord_t;
+
+	/** The last model matrix of an object, and what it was built from */
+	typedef struct sCachedTransform {
+		glm::vec3 pos, rot;
+		float radius;
+		glm::mat4 matrix;
+		bool valid;
+	} CachedTransform_t;
 
 	class ObjectCluster : public LayerVao {
 
 		friend class World;
 
+		friend class WorldObject;
+
+	public:
+
+		/** Most detail levels of a model */
+		static constexpr int MAXLODS = 4;
+
+	private:
+
 		static std::string TAG;
 
 		bool bInited = false;
-		ObjLoader *pLoader;
 
-		std::vector<Visible_t> vVisibles;
+		/** The model, then the lower details: <name>.obj, <name>.lod1.obj, <name>.lod2.obj ... */
+		std::vector<ObjLoader *> vLods;
+
+		/** First VAO mesh of every detail level, and the end of the last */
+		std::vector<int> vLodMesh;
+
 		glm::mat4 mPlacer;
+
+		/** The instances as drawn, one per object in vInstances. Moving objects are read every frame, the others on change. */
+		std::vector<InstanceRecord_t> vRecords;
+		bool bRecordsDirty = true;
+
+		/** Instances whose tint or selection changed since the last frame */
+		std::vector<size_t> vTouched;
+
+		/** Draw and impostor distances of the class, world units */
+		float fMaxDrawDistance = 0, fImpostorDistance = 0;
+
+		/** Brings the records up to date with the objects */
+		void sync();
+
+		/** Reads an object into its record */
+		void refresh(size_t index);
+
+		/** An object changed its tint or selection */
+		void touch(size_t index);
+
+		/** A static object was moved: reread it, and regroup the static objects */
+		void moved(size_t index);
+
+		/** Model matrices (placer included), one per instance */
+		std::vector<CachedTransform_t> vTransforms;
+
+		/** Matrices rebuilt on the last render */
+		int nRebuilt = 0;
+
+		/** Bounding spheres of the instances */
+		FrustumCuller mCuller;
+
+		/** Static instances grouped in cells, the moving ones are tested one by one */
+		InstanceGrid mCells;
+		bool bCellsDirty = true;
+
+		/** The instance of every sphere given to the culler, and the visible spheres */
+		std::vector<size_t> vCullIndex, vCulled;
+
+		void buildCells();
+
+		/** The static objects merged per cell, only with PLANET.staticBatching */
+		StaticBatch *pStatic = nullptr;
+		bool bStaticDirty = true;
+
+		/** Cells drawn from the merged meshes this frame */
+		std::vector<unsigned> vBatchedCells;
+
+		/** Merges the static objects of every cell. Main thread. */
+		void buildStatic();
+
+		/** Whether a visible cell can be drawn merged, or its objects need their own tint, detail or impostor */
+		bool batchable(const InstanceCell_t &cell) const;
+
+		/** Instances visible this frame */
+		std::vector<size_t> vVisibleIndex;
+
+		/** Light set of every instance, for the render queue */
+		std::vector<int> vLightSets;
+
+		/** Detail level of every instance, and the visible instances of each level */
+		std::vector<uint8_t> vLod;
+		std::vector<size_t> vLodVisible[MAXLODS];
+
+		/** Camera position, and projected diameter in pixels of a radius at distance 1, 0 for no detail selection */
+		glm::vec3 mEye = {0, 0, 0};
+		float fPixelScale = 0;
+
+		/** The occluders of the frame, nullptr for no occlusion culling */
+		const OcclusionBuffer *pOcclusion = nullptr;
+
+		/** The terrain horizon of the frame, nullptr for no horizon culling */
+		const HorizonMap *pHorizon = nullptr;
+
+		/** Whether the occluders or the horizon hide a box, render coordinates */
+		bool hidden(const glm::vec3 &min, const glm::vec3 &max) const;
+
+		/** The far objects, only if the model has an impostor atlas and the world draws them */
+		ImpostorBatch *pImpostors = nullptr;
+
+		/** The detail level of an instance, for its current one and its projected diameter */
+		int selectLod(int current, float pixels) const;
+
+		/** Visible instances whose matrix is stale, rebuilt in one batch */
+		std::vector<size_t> vStale;
+		TransformBatch mBatch;
+		std::vector<glm::mat4> vBuilt;
+
+		/**
+		 * Finds the visible instances, and rebuilds the matrices of those that moved, turned or resized
+		 * @param frustum The camera frustum, nullptr to take all objects
+		 * @param merged Take the visible cells of static objects whole, to draw them from the merged meshes
+		 * @return Number of objects culled
+		 */
+		int cull(const Frustum *frustum, bool merged = false);
+
+		/** Visible objects of every detail level, for the instanced path */
+		InstanceBuffer mInstances[MAXLODS];
+
+		/** Whether the mesh VAOs of every detail level read its instance buffer */
+		bool bAttached[MAXLODS] = {};
+
+		void renderInstanced(ObjectShader *shader, Camera *camera);
 // todo		std::vector<WorldObject *> vInstances;
 
 	public:
@@ -55,9 +201,96 @@ namespace Pix {
 
 		void add(WorldObject *object);
 
+		/**
+		 * Takes an object out, in constant time: the last object takes its place. Removing a static
+		 * object, or one whose place a static object takes, regroups the static objects.
+		 */
+		void remove(WorldObject *object);
+
 		void init();
 
 		void render(ObjectShader *shader, Camera *camera);
+
+		/**
+		 * Builds the instance list of the visible objects. Does not touch GL.
+		 * @param frustum The camera frustum, nullptr to take all objects
+		 * @return Number of objects culled
+		 */
+		int collect(const Frustum *frustum);
+
+		/**
+		 * Queues a draw per mesh of every visible object
+		 * @param queue The frame render queue
+		 * @param frustum The camera frustum, nullptr to take all objects
+		 * @param lights Picks the lights of each object, nullptr for none
+		 * @return Number of objects culled
+		 */
+		int enqueue(RenderQueue &queue, const Frustum *frustum, LightGrid *lights = nullptr);
+
+		/** The instances of a detail level collected for the current frame */
+		const InstanceBuffer &instances(int lod = 0) const;
+
+		/**
+		 * Sets the view for the detail levels and the draw distance. Call every frame before drawing.
+		 * @param eyeWorld Camera position, world coordinates
+		 * @param pixelScale Projected diameter in pixels of a radius at distance 1: screen height * projection[1][1]
+		 * @param occlusion The occluders of the frame, finished, nullptr for none
+		 * @param horizon The terrain horizon of the frame, built, nullptr for none
+		 */
+		void setView(const glm::vec3 &eyeWorld, float pixelScale, const OcclusionBuffer *occlusion = nullptr,
+					 const HorizonMap *horizon = nullptr);
+
+		/** Number of detail levels of the model */
+		int lodCount() const;
+
+		/**
+		 * Draws the far objects collected on the last cull, in one call
+		 * @param shader The impostors shader, in use
+		 */
+		void renderImpostors(Shader *shader);
+
+		/** Number of objects drawn as impostors on the last cull */
+		size_t impostorCount() const;
+
+		/** Rereads and regroups the static objects, after moving them */
+		void invalidateCells();
+
+		/** Number of model matrices rebuilt on the last render, the others came from the cache */
+		int rebuiltMatrices() const;
 	};
 
+	inline int ObjectCluster::rebuiltMatrices() const { return nRebuilt; }
+
+	inline void ObjectCluster::invalidateCells() { bCellsDirty = bRecordsDirty = true; }
+
+	inline void ObjectCluster::touch(size_t index) {
+		// past one change per object, rereading them all is cheaper
+		if (vTouched.size() < vRecords.size()) vTouched.push_back(index);
+		else bRecordsDirty = true;
+	}
+
+	inline void ObjectCluster::moved(size_t index) {
+		touch(index);
+		bCellsDirty = true;
+	}
+
+	inline const InstanceBuffer &ObjectCluster::instances(int lod) const { return mInstances[lod]; }
+
+	inline void ObjectCluster::setView(const glm::vec3 &eyeWorld, float pixelScale, const OcclusionBuffer *occlusion,
+									   const HorizonMap *horizon) {
+		mEye = eyeWorld;
+		fPixelScale = pixelScale;
+		pOcclusion = occlusion;
+		pHorizon = horizon;
+	}
+
+	inline bool ObjectCluster::hidden(const glm::vec3 &min, const glm::vec3 &max) const {
+		return (pHorizon != nullptr && !pHorizon->visible(min * 1000.0F, max * 1000.0F))
+			   || (pOcclusion != nullptr && !pOcclusion->visible(min, max));
+	}
+
+	inline size_t ObjectCluster::impostorCount() const { return pImpostors != nullptr ? pImpostors->size() : 0; }
+
+	inline int ObjectCluster::lodCount() const { return static_cast<int>(vLods.size()); }
+
 }
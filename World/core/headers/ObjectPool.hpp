@@ -0,0 +1,137 @@
+//
+//  ObjectPool.hpp
+//  PixFu Engine
+//
+//  Allocates objects of one class in blocks, and keeps the freed places in a
+//  list for the next ones. Spawning and removing objects all the time, as
+//  projectiles and pickups do, then costs no heap allocation once the pool
+//  has grown to the peak, and the objects of a class stay close in memory.
+//
+//  Objects still alive when the pool goes away are destroyed with it.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <functional>
+
+namespace Pix {
+
+	template<typename T>
+	class ObjectPool {
+
+		/** A place for an object, the object first so both share the address */
+		typedef struct sSlot {
+			alignas(T) unsigned char storage[sizeof(T)];
+			sSlot *next;
+			bool live;
+		} Slot_t;
+
+		/** Objects per block */
+		const size_t BLOCK;
+
+		std::vector<Slot_t *> vBlocks;
+
+		/** Free places, the most recently freed first */
+		Slot_t *pFree = nullptr;
+
+		size_t nLive = 0;
+
+		void grow();
+
+	public:
+
+		/** @param block Objects allocated at once when the pool runs out */
+		explicit ObjectPool(size_t block = 64);
+
+		~ObjectPool();
+
+		ObjectPool(const ObjectPool &) = delete;
+
+		ObjectPool &operator=(const ObjectPool &) = delete;
+
+		/** Constructs an object in a free place */
+		template<typename... Args>
+		T *create(Args &&... args);
+
+		/** Destroys an object of the pool, and frees its place */
+		void destroy(T *object);
+
+		/** Whether the object lives in the pool */
+		bool owns(const T *object) const;
+
+		/** Objects alive */
+		size_t size() const;
+
+		/** Objects that fit without allocating */
+		size_t capacity() const;
+	};
+
+	template<typename T>
+	ObjectPool<T>::ObjectPool(size_t block) : BLOCK(block > 0 ? block : 1) {}
+
+	template<typename T>
+	ObjectPool<T>::~ObjectPool() {
+		for (Slot_t *block : vBlocks) {
+			for (size_t i = 0; i < BLOCK; i++)
+				if (block[i].live) reinterpret_cast<T *>(block[i].storage)->~T();
+			delete[] block;
+		}
+	}
+
+	template<typename T>
+	void ObjectPool<T>::grow() {
+		Slot_t *block = new Slot_t[BLOCK];
+		vBlocks.push_back(block);
+		// chained so the first place of the block is taken first
+		for (size_t i = BLOCK; i-- > 0;) {
+			block[i].live = false;
+			block[i].next = pFree;
+			pFree = &block[i];
+		}
+	}
+
+	template<typename T>
+	template<typename... Args>
+	T *ObjectPool<T>::create(Args &&... args) {
+		if (pFree == nullptr) grow();
+		Slot_t *slot = pFree;
+		// the place is only taken once the constructor returns
+		T *object = new(slot->storage) T(std::forward<Args>(args)...);
+		pFree = slot->next;
+		slot->live = true;
+		nLive++;
+		return object;
+	}
+
+	template<typename T>
+	void ObjectPool<T>::destroy(T *object) {
+		Slot_t *slot = reinterpret_cast<Slot_t *>(object);
+		object->~T();
+		slot->live = false;
+		slot->next = pFree;
+		pFree = slot;
+		nLive--;
+	}
+
+	template<typename T>
+	bool ObjectPool<T>::owns(const T *object) const {
+		const auto *slot = reinterpret_cast<const Slot_t *>(object);
+		const std::less<const Slot_t *> before;
+		for (const Slot_t *block : vBlocks)
+			if (!before(slot, block) && before(slot, block + BLOCK)) return slot->live;
+		return false;
+	}
+
+	template<typename T>
+	inline size_t ObjectPool<T>::size() const { return nLive; }
+
+	template<typename T>
+	inline size_t ObjectPool<T>::capacity() const { return vBlocks.size() * BLOCK; }
+
+}
@@ -22,10 +22,15 @@ namespace Pix {
 
 	public:
 
-		ObjectShader(std::string name);
+		/** Whether the shader reads the transform and tint from the instance attributes */
+		const bool INSTANCED;
+
+		ObjectShader(std::string name, bool instanced = false);
 
 		void setTint(glm::vec4 tint);
 
+		void bindAttributes();
+
 	};
 
 }
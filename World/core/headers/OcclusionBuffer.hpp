@@ -0,0 +1,135 @@
+//
+//  OcclusionBuffer.hpp
+//  PixFu Engine
+//
+//  Software occlusion culling. Every frame a few large occluders, the terrain
+//  ridges and the biggest static objects, are rasterized on the CPU into a
+//  small depth buffer, 4 pixels at a time. A min pyramid (hi-Z) is built over
+//  it, and the bounding boxes of the objects are tested against the farthest
+//  occluder in the few texels their screen rectangle covers: a box nearer
+//  than that is hidden.
+//
+//  Depths are 1 / w, so they interpolate linearly on the screen, and pixels
+//  without occluders hold 0, farther than anything. Occluders must lie inside
+//  what they stand for, so they never hide something that could be seen;
+//  depths are sampled at the pixel centers, which is not exact below a pixel.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace Pix {
+
+	/** Triangles that hide what is behind them, render coordinates */
+	typedef struct sOccluderMesh {
+		std::vector<glm::vec3> vertices;
+		std::vector<unsigned> indices;
+	} OccluderMesh_t;
+
+	class OcclusionBuffer {
+
+		static std::string TAG;
+
+		const int WIDTH, HEIGHT;
+
+		/** Floats per row of the depth buffer, whole SIMD vectors */
+		const int STRIDE;
+
+		/** 1 / w of the nearest occluder in every pixel */
+		std::vector<float> vDepth;
+
+		/** hi-Z levels 1..n: every texel holds the minimum (farthest) of the 2x2 texels below */
+		std::vector<std::vector<float>> vLevels;
+		std::vector<int> vWidths, vHeights;
+
+		glm::mat4 mViewProjection = glm::mat4(1.0F);
+
+		/** Occluders closer than this to the eye are clipped */
+		float fNear = 0;
+
+		int nTriangles = 0;
+		mutable int nTested = 0, nOccluded = 0;
+
+		/** Clips a triangle against the near plane, and rasterizes what remains */
+		void draw(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+
+		/** Rasterizes a triangle in screen space: x and y in pixels, z = 1 / w */
+		void rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+
+		/** Projects a clip space vertex to the screen */
+		glm::vec3 screen(const glm::vec4 &clip) const;
+
+		/** A texel of the hi-Z, level 0 being the depth buffer */
+		float texel(int level, int x, int y) const;
+
+	public:
+
+		/**
+		 * @param width Buffer width, pixels
+		 * @param height Buffer height, pixels
+		 */
+		OcclusionBuffer(int width, int height);
+
+		/**
+		 * Clears the buffer for a new frame
+		 * @param viewProjection Projection * view matrix, render coordinates
+		 * @param near Near plane distance, render units
+		 */
+		void begin(const glm::mat4 &viewProjection, float near);
+
+		void addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+
+		void addMesh(const OccluderMesh_t &mesh);
+
+		/** Adds a solid axis aligned box */
+		void addBox(const glm::vec3 &min, const glm::vec3 &max);
+
+		/** Builds the hi-Z. Call after adding the occluders, before testing. */
+		void finish();
+
+		/**
+		 * Tests an axis aligned box, render coordinates
+		 * @return false if the occluders hide the whole box
+		 */
+		bool visible(const glm::vec3 &min, const glm::vec3 &max) const;
+
+		/** 1 / w of the nearest occluder at a pixel, 0 for none */
+		float depth(int x, int y) const;
+
+		int width() const;
+
+		int height() const;
+
+		/** Triangles rasterized, boxes tested and boxes found hidden since begin() */
+		int triangles() const;
+
+		int tested() const;
+
+		int occluded() const;
+	};
+
+	inline float OcclusionBuffer::depth(int x, int y) const { return vDepth[y * STRIDE + x]; }
+
+	inline float OcclusionBuffer::texel(int level, int x, int y) const {
+		return level == 0 ? vDepth[y * STRIDE + x] : vLevels[level - 1][y * vWidths[level] + x];
+	}
+
+	inline int OcclusionBuffer::width() const { return WIDTH; }
+
+	inline int OcclusionBuffer::height() const { return HEIGHT; }
+
+	inline int OcclusionBuffer::triangles() const { return nTriangles; }
+
+	inline int OcclusionBuffer::tested() const { return nTested; }
+
+	inline int OcclusionBuffer::occluded() const { return nOccluded; }
+
+}
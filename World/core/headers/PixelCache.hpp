@@ -0,0 +1,86 @@
+//
+//  PixelCache.hpp
+//  PixFu Engine
+//
+//  On-disk cache of decoded images. The first load of a PNG decodes it and
+//  stores the raw RGBA pixels in the cache folder; later loads map the cache
+//  file instead of inflating the PNG again. Entries are named after the source
+//  path, and are valid while the source size and mtime match, or, if only the
+//  mtime changed (files copied to a new device), while its content hash does.
+//
+//  Sources that can't be stat'ed (packaged assets) are always decoded.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "Drawable.hpp"
+
+namespace Pix {
+
+	typedef struct sPixelCacheHeader {
+		char magic[4];
+		uint32_t version;
+		int32_t width, height;
+		/** the source image when the entry was written */
+		int64_t mtime;
+		uint64_t size;
+		uint64_t hash;
+	} PixelCacheHeader_t;
+
+	class PixelCache {
+
+		static std::string TAG;
+
+		static constexpr char MAGIC[4] = {'P', 'X', 'C', 'H'};
+
+		static constexpr uint32_t VERSION = 1;
+
+		/** Pixels start here, past the header */
+		static constexpr size_t DATA_OFFSET = 64;
+
+		/** Cache folder, empty when disabled */
+		static std::string sFolder;
+
+		static uint64_t hash(const void *data, size_t bytes, uint64_t seed);
+
+		static bool hashFile(const std::string &path, uint64_t &hash);
+
+		static std::string entry(const std::string &path);
+
+		static Drawable *read(const std::string &entry, int64_t mtime, uint64_t size, const std::string &source);
+
+		static void write(const std::string &entry, PixelCacheHeader_t header, Drawable *image);
+
+	public:
+
+		/**
+		 * Enables the cache. Call before loading any world.
+		 * @param folder Where to store the entries, created if missing
+		 * @return Whether the cache could be enabled
+		 */
+		static bool enable(const std::string &folder);
+
+		/** Disables the cache, entries are kept on disk */
+		static void disable();
+
+		static bool enabled();
+
+		/**
+		 * Loads an image through the cache. Thread safe.
+		 * @param path Image path
+		 * @return The image, as Drawable::fromFile
+		 */
+		static Drawable *load(const std::string &path);
+	};
+
+	inline bool PixelCache::enabled() { return !sFolder.empty(); }
+
+	inline void PixelCache::disable() { sFolder.clear(); }
+
+}
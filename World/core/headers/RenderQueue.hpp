@@ -0,0 +1,148 @@
+//
+//  RenderQueue.hpp
+//  PixFu Engine
+//
+//  Collects the draws of a frame from all terrains and object clusters, and
+//  executes them sorted by a 64 bit key, from the most significant field:
+//
+//      pass (8) | material (16) | mesh (16) | depth (24)
+//
+//  so each shader, material and mesh is set up once per frame, and draws
+//  sharing them go front to back to save overdraw. Keys are sorted with an
+//  LSD radix sort on bytes, skipping the bytes all keys share.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <string>
+
+#include "Material.hpp"
+#include "LayerVao.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace Pix {
+
+	class Camera;
+
+	class Terrain;
+
+	class TerrainShader;
+
+	class ObjectShader;
+
+	class LightGrid;
+
+	/** Passes, in drawing order. Each pass has its own shader. */
+	typedef enum eRenderPass {
+		PASS_TERRAIN, PASS_OBJECTS
+	} RenderPass_t;
+
+	typedef struct sDrawItem {
+		/** Terrain pass: the terrain draws itself */
+		Terrain *terrain;
+		/** Objects pass: mesh, material and placement */
+		LayerVao *vao;
+		int mesh;
+		Material *material;
+		glm::mat4 *transform;
+		glm::vec4 tint;
+		/** Light set, -1 to keep the loaded lights */
+		int lights;
+	} DrawItem_t;
+
+	class RenderQueue {
+
+		static std::string TAG;
+
+		static constexpr int DEPTH_BITS = 24, MESH_BITS = 16, MATERIAL_BITS = 16;
+		static constexpr int MESH_SHIFT = DEPTH_BITS, MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS,
+				PASS_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+
+		std::vector<DrawItem_t> vItems;
+
+		/** Keys, and the item of each key, with their radix sort scratch */
+		std::vector<uint64_t> vKeys, vKeysScratch;
+		std::vector<uint32_t> vOrder, vOrderScratch;
+
+		/** Dense ids of the materials and meshes, stable across frames */
+		std::map<const Material *, uint64_t> mMaterialIds;
+		std::map<std::pair<const LayerVao *, int>, uint64_t> mMeshIds;
+
+		glm::vec3 mEye = {0, 0, 0};
+		float fDepthScale = 0;
+
+		bool bSorted = false;
+
+		int nMaterialChanges = 0, nMeshChanges = 0, nLightChanges = 0;
+
+		/** First and last + 1 sorted items of a pass */
+		void range(RenderPass_t pass, size_t &first, size_t &last) const;
+
+	public:
+
+		/**
+		 * Starts a new frame
+		 * @param eye Camera position, world coordinates
+		 * @param far Farthest depth to tell apart, world units
+		 */
+		void begin(const glm::vec3 &eye, float far);
+
+		/**
+		 * The sort key of the state of a draw, to combine with the depth in submit()
+		 * @param pass The pass
+		 * @param material The material, nullptr for none
+		 * @param vao The meshes, nullptr for none
+		 * @param mesh The mesh in the vao
+		 */
+		uint64_t state(RenderPass_t pass, const Material *material, const LayerVao *vao, int mesh);
+
+		/**
+		 * Queues a draw
+		 * @param state Key from state()
+		 * @param posWorld Where the draw is, to sort by depth
+		 * @param item What to draw
+		 */
+		void submit(uint64_t state, const glm::vec3 &posWorld, const DrawItem_t &item);
+
+		/** Queues a terrain */
+		void submit(Terrain *terrain, float distance);
+
+		/** Sorts the queue. Executing sorts it if needed. */
+		void sort();
+
+		/** Draws the terrain pass. The shader must be in use. */
+		void execute(TerrainShader *shader, Camera *camera);
+
+		/**
+		 * Draws the objects pass. The shader must be in use.
+		 * @param shader The objects shader
+		 * @param lights The light sets of the draws, nullptr if they have none
+		 */
+		void execute(ObjectShader *shader, const LightGrid *lights = nullptr);
+
+		size_t size() const;
+
+		/** State changes of the last objects pass */
+		int materialChanges() const;
+
+		int meshChanges() const;
+
+		int lightChanges() const;
+	};
+
+	inline size_t RenderQueue::size() const { return vItems.size(); }
+
+	inline int RenderQueue::materialChanges() const { return nMaterialChanges; }
+
+	inline int RenderQueue::meshChanges() const { return nMeshChanges; }
+
+	inline int RenderQueue::lightChanges() const { return nLightChanges; }
+
+}
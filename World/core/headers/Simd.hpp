@@ -0,0 +1,255 @@
+//
+//  Simd.hpp
+//  PixFu Engine
+//
+//  A minimal 4-wide float vector over SSE2 or NEON, with a scalar fallback
+//  for other targets, for the batched math kernels. Only what the kernels
+//  use: arithmetic, max, loads and stores, a 4x4 transpose, lane compares and
+//  sin/cos.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PIX_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIX_SIMD_NEON
+#endif
+
+namespace Pix {
+
+	namespace Simd {
+
+		/** Floats per vector */
+		static constexpr int WIDTH = 4;
+
+#if defined(PIX_SIMD_SSE2)
+
+		struct float4 {
+			__m128 v;
+			float4() = default;
+			float4(__m128 x) : v(x) {}
+			float4(float x) : v(_mm_set1_ps(x)) {}
+		};
+
+		struct int4 {
+			__m128i v;
+		};
+
+		inline float4 load(const float *p) { return _mm_loadu_ps(p); }
+
+		inline void store(float *p, const float4 &a) { _mm_storeu_ps(p, a.v); }
+
+		inline float4 operator+(const float4 &a, const float4 &b) { return _mm_add_ps(a.v, b.v); }
+
+		inline float4 operator-(const float4 &a, const float4 &b) { return _mm_sub_ps(a.v, b.v); }
+
+		inline float4 operator*(const float4 &a, const float4 &b) { return _mm_mul_ps(a.v, b.v); }
+
+		inline float4 max(const float4 &a, const float4 &b) { return _mm_max_ps(a.v, b.v); }
+
+		/** Nearest integer */
+		inline int4 roundToInt(const float4 &a) { return {_mm_cvtps_epi32(a.v)}; }
+
+		inline float4 toFloat(const int4 &a) { return _mm_cvtepi32_ps(a.v); }
+
+		/** Bit n of every lane, as 0 or 1 */
+		inline int4 bit(const int4 &a, int n) {
+			return {_mm_and_si128(_mm_srai_epi32(a.v, n), _mm_set1_epi32(1))};
+		}
+
+		inline int4 operator+(const int4 &a, int b) { return {_mm_add_epi32(a.v, _mm_set1_epi32(b))}; }
+
+		inline void transpose(float4 &a, float4 &b, float4 &c, float4 &d) {
+			_MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+		}
+
+		/** Lanes where a < b, as bits 0..3 */
+		inline int lessMask(const float4 &a, const float4 &b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+
+#elif defined(PIX_SIMD_NEON)
+
+		struct float4 {
+			float32x4_t v;
+			float4() = default;
+			float4(float32x4_t x) : v(x) {}
+			float4(float x) : v(vdupq_n_f32(x)) {}
+		};
+
+		struct int4 {
+			int32x4_t v;
+		};
+
+		inline float4 load(const float *p) { return vld1q_f32(p); }
+
+		inline void store(float *p, const float4 &a) { vst1q_f32(p, a.v); }
+
+		inline float4 operator+(const float4 &a, const float4 &b) { return vaddq_f32(a.v, b.v); }
+
+		inline float4 operator-(const float4 &a, const float4 &b) { return vsubq_f32(a.v, b.v); }
+
+		inline float4 operator*(const float4 &a, const float4 &b) { return vmulq_f32(a.v, b.v); }
+
+		inline float4 max(const float4 &a, const float4 &b) { return vmaxq_f32(a.v, b.v); }
+
+		inline int4 roundToInt(const float4 &a) {
+			// the conversion truncates: add half away from zero first
+			const float32x4_t half = vbslq_f32(vcgeq_f32(a.v, vdupq_n_f32(0)), vdupq_n_f32(0.5F), vdupq_n_f32(-0.5F));
+			return {vcvtq_s32_f32(vaddq_f32(a.v, half))};
+		}
+
+		inline float4 toFloat(const int4 &a) { return vcvtq_f32_s32(a.v); }
+
+		inline int4 bit(const int4 &a, int n) {
+			return {vandq_s32(vshlq_s32(a.v, vdupq_n_s32(-n)), vdupq_n_s32(1))};
+		}
+
+		inline int4 operator+(const int4 &a, int b) { return {vaddq_s32(a.v, vdupq_n_s32(b))}; }
+
+		inline void transpose(float4 &a, float4 &b, float4 &c, float4 &d) {
+			const float32x4x2_t ab = vtrnq_f32(a.v, b.v), cd = vtrnq_f32(c.v, d.v);
+			a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+			b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+			c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+			d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+		}
+
+		inline int lessMask(const float4 &a, const float4 &b) {
+			static const uint32_t bits[4] = {1, 2, 4, 8};
+			const uint32x4_t lanes = vandq_u32(vcltq_f32(a.v, b.v), vld1q_u32(bits));
+			const uint32x2_t sum = vpadd_u32(vget_low_u32(lanes), vget_high_u32(lanes));
+			return static_cast<int>(vget_lane_u32(vpadd_u32(sum, sum), 0));
+		}
+
+#else
+
+		struct float4 {
+			float v[4];
+			float4() = default;
+			float4(float x) : v{x, x, x, x} {}
+		};
+
+		struct int4 {
+			int32_t v[4];
+		};
+
+		inline float4 load(const float *p) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = p[i];
+			return r;
+		}
+
+		inline void store(float *p, const float4 &a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+
+		inline float4 operator+(const float4 &a, const float4 &b) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i];
+			return r;
+		}
+
+		inline float4 operator-(const float4 &a, const float4 &b) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i];
+			return r;
+		}
+
+		inline float4 operator*(const float4 &a, const float4 &b) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i];
+			return r;
+		}
+
+		inline float4 max(const float4 &a, const float4 &b) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+			return r;
+		}
+
+		inline int4 roundToInt(const float4 &a) {
+			int4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = static_cast<int32_t>(lrintf(a.v[i]));
+			return r;
+		}
+
+		inline float4 toFloat(const int4 &a) {
+			float4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = static_cast<float>(a.v[i]);
+			return r;
+		}
+
+		inline int4 bit(const int4 &a, int n) {
+			int4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = (a.v[i] >> n) & 1;
+			return r;
+		}
+
+		inline int4 operator+(const int4 &a, int b) {
+			int4 r;
+			for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b;
+			return r;
+		}
+
+		inline void transpose(float4 &a, float4 &b, float4 &c, float4 &d) {
+			float m[4][4];
+			store(m[0], a);
+			store(m[1], b);
+			store(m[2], c);
+			store(m[3], d);
+			for (int i = 0; i < 4; i++) {
+				a.v[i] = m[i][0];
+				b.v[i] = m[i][1];
+				c.v[i] = m[i][2];
+				d.v[i] = m[i][3];
+			}
+		}
+
+		inline int lessMask(const float4 &a, const float4 &b) {
+			int mask = 0;
+			for (int i = 0; i < 4; i++) mask |= (a.v[i] < b.v[i] ? 1 : 0) << i;
+			return mask;
+		}
+
+#endif
+
+		inline float4 operator-(const float4 &a) { return float4(0.0F) - a; }
+
+		/**
+		 * Sine and cosine of every lane, within a few ulps for |x| up to a few thousand radians.
+		 * Cephes style: reduce to [-pi/4, pi/4] around the nearest multiple of pi/2, and pick
+		 * and sign the polynomials by quadrant.
+		 */
+		inline void sincos(const float4 &x, float4 &s, float4 &c) {
+
+			const int4 q = roundToInt(x * float4(0.636619772F));
+			const float4 fq = toFloat(q);
+
+			// pi/2 in three parts, so the reduction is exact enough
+			const float4 r = ((x - fq * float4(1.5703125F)) - fq * float4(4.837512969970703125e-4F))
+							 - fq * float4(7.54978995489188216e-8F);
+			const float4 r2 = r * r;
+
+			const float4 ps = r + r * r2 * (float4(-1.6666654611e-1F)
+											+ r2 * (float4(8.3321608736e-3F) + r2 * float4(-1.9515295891e-4F)));
+			const float4 pc = float4(1.0F) - float4(0.5F) * r2
+							  + r2 * r2 * (float4(4.166664568298827e-2F)
+										   + r2 * (float4(-1.388731625493765e-3F) + r2 * float4(2.443315711809948e-5F)));
+
+			// odd quadrants swap the polynomials, quadrants 2-3 negate the sine, 1-2 the cosine
+			const float4 swap = toFloat(bit(q, 0));
+			const float4 sinSign = float4(1.0F) - float4(2.0F) * toFloat(bit(q, 1));
+			const float4 cosSign = float4(1.0F) - float4(2.0F) * toFloat(bit(q + 1, 1));
+
+			s = sinSign * (ps + swap * (pc - ps));
+			c = cosSign * (pc + swap * (ps - pc));
+		}
+
+	}
+
+}
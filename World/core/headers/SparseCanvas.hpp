@@ -0,0 +1,149 @@
+//
+//  SparseCanvas.hpp
+//  PixFu Engine
+//
+//  A terrain canvas that only stores the tiles that have been drawn on. Tiles
+//  are allocated on first write, and the canvas can be stored at a lower
+//  resolution than the terrain: callers keep drawing in terrain pixels. The
+//  GPU texture is only created when something is drawn, until then a 1x1
+//  blank texture is bound. A terrain without drawings costs a few bytes.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cmath>
+
+#include "TerrainCanvas.hpp"
+#include "OpenGL.h"
+
+namespace Pix {
+
+	class SparseCanvas : public TerrainCanvas {
+
+		static std::string TAG;
+
+		/** Tile side, in storage pixels */
+		static constexpr int TILE = 64;
+
+		/** Scratch area where text is rendered before copying it to the tiles */
+		static constexpr int SCRATCH_WIDTH = 512, SCRATCH_HEIGHT = 64;
+
+		/** Logical dimensions, terrain pixels */
+		const int WIDTH, HEIGHT;
+
+		/** Storage pixels per terrain pixel */
+		const float SCALE;
+
+		/** Storage dimensions */
+		const int SWIDTH, SHEIGHT;
+
+		/** Storage dimensions, in tiles */
+		const int COLS, ROWS;
+
+		/** Tiles, nullptr if never drawn or blanked */
+		std::vector<Pixel *> vTiles;
+
+		/** Tiles pending upload. A pending tile that is nullptr uploads as blank. */
+		std::vector<bool> vPending;
+		std::deque<int> qPending;
+
+		int nTiles = 0;
+
+		/** Scratch tile, composed with the decal layer */
+		std::vector<Pixel> vComposed;
+
+		/** The canvas texture, 0 until the first upload */
+		GLuint mTexture = 0;
+
+		/** 1x1 blank texture bound until then (owned). The canvas texture uses its unit too. */
+		Texture2D *pBlank;
+
+		/** The scratch area, the Canvas2D buffer */
+		Drawable *pScratch;
+
+		int toStorage(int32_t coordinate) const;
+
+		Pixel *tile(int col, int row);
+
+		void queue(int index);
+
+		void plot(int x, int y, Pixel p);
+
+		void span(int x0, int x1, int y, Pixel p);
+
+		void line(int x1, int y1, int x2, int y2, Pixel p, uint32_t pattern);
+
+		void createTexture();
+
+	public:
+
+		/**
+		 * Creates an empty canvas
+		 * @param width Width in terrain pixels
+		 * @param height Height in terrain pixels
+		 * @param resolution Storage pixels per terrain pixel, (0..1]
+		 * @param font The font for drawString
+		 */
+		SparseCanvas(int width, int height, float resolution, Font *font);
+
+		virtual ~SparseCanvas();
+
+		void init() override;
+
+		size_t upload(size_t budget) override;
+
+		void bind(Shader *shader, const std::string &sampler) override;
+
+		size_t bytes() override;
+
+		int width() override;
+
+		int height() override;
+
+		float resolution() override;
+
+		void invalidate(int x0, int y0, int x1, int y1) override;
+
+		void blendSpan(int x0, int x1, int y, Pixel color) override;
+
+		void fadeSpan(int x0, int x1, int y, uint32_t factor) override;
+
+		void setPixel(int32_t x, int32_t y, Pixel p) override;
+
+		void drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p, uint32_t pattern = 0xFFFFFFFF) override;
+
+		void drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask = 0xFF) override;
+
+		void fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p) override;
+
+		void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) override;
+
+		void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) override;
+
+		void drawString(int32_t x, int32_t y, const std::string &text, Pixel col, uint32_t scale = 1) override;
+
+		void clear(Pixel p) override;
+
+		void blank() override;
+	};
+
+	inline int SparseCanvas::width() { return WIDTH; }
+
+	inline int SparseCanvas::height() { return HEIGHT; }
+
+	inline float SparseCanvas::resolution() { return SCALE; }
+
+	inline int SparseCanvas::toStorage(int32_t coordinate) const {
+		return static_cast<int>(floorf(coordinate * SCALE));
+	}
+
+	inline void SparseCanvas::plot(int x, int y, Pixel p) {
+		if (x < 0 || y < 0 || x >= SWIDTH || y >= SHEIGHT) return;
+		tile(x / TILE, y / TILE)[(y % TILE) * TILE + (x % TILE)] = p;
+	}
+
+}
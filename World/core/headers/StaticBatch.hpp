@@ -0,0 +1,69 @@
+//
+//  StaticBatch.hpp
+//  PixFu Engine
+//
+//  The static objects of a cluster, merged per cell of its InstanceGrid: for
+//  every cell and every mesh of the model, the vertices of all the objects
+//  in the cell are transformed once to render coordinates and stored in one
+//  mesh, drawn with an identity model matrix. A cell then costs one draw per
+//  material instead of one per object and material, for the memory of a
+//  copy of the model per object.
+//
+//  Only the full detail model is merged. Built from a snapshot of the
+//  objects: rebuild it when the cells are rebuilt.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "LayerVao.hpp"
+#include "ObjLoader.hpp"
+#include "InstanceGrid.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace Pix {
+
+	class StaticBatch : public LayerVao {
+
+		static std::string TAG;
+
+		/** Floats per vertex: position, normal, texture coordinate */
+		static constexpr int FLOATS = 8;
+
+		const int MESHES;
+
+		glm::mat4 mIdentity;
+
+		size_t nBytes = 0;
+
+	public:
+
+		/**
+		 * Merges and uploads the cells. Main thread.
+		 * @param model The full detail model
+		 * @param cells The cells of the static objects
+		 * @param transforms Model matrix of every object, by object index
+		 */
+		StaticBatch(ObjLoader *model, const InstanceGrid &cells, const std::vector<glm::mat4> &transforms);
+
+		/** The VAO mesh of a model mesh in a cell */
+		int mesh(unsigned cell, int modelMesh) const;
+
+		/** Model matrix of the merged meshes */
+		glm::mat4 &identity();
+
+		/** Memory taken by the merged vertices and indices */
+		size_t bytes() const;
+	};
+
+	inline int StaticBatch::mesh(unsigned cell, int modelMesh) const { return static_cast<int>(cell) * MESHES + modelMesh; }
+
+	inline glm::mat4 &StaticBatch::identity() { return mIdentity; }
+
+	inline size_t StaticBatch::bytes() const { return nBytes; }
+
+}
@@ -8,56 +8,181 @@
 
 #pragma once
 
-#include "Canvas2D.hpp"
+#include "TerrainCanvas.hpp"
+#include "SparseCanvas.hpp"
 #include "Texture2D.hpp"
 #include "LayerVao.hpp"
 #include "ObjLoader.hpp"
 #include "TerrainShader.hpp"
+#include "HeightPyramid.hpp"
+#include "TerrainMesh.hpp"
+#include "OcclusionBuffer.hpp"
+#include "HorizonMap.hpp"
+
+#include <cmath>
+#include <algorithm>
 
 namespace Pix {
 
-	class Terrain : public LayerVao {
+	class Camera;
+
+	/** How much of a terrain is loaded */
+	typedef enum eTerrainResidency {
+		/** nothing loaded, the terrain is only a placeholder */
+		TERRAIN_UNLOADED,
+		/** heightmap loaded: the terrain supports physics, but is not drawn */
+		TERRAIN_HEIGHTS,
+		/** heightmap, render mesh, textures and canvas loaded */
+		TERRAIN_RESIDENT
+	} TerrainResidency_t;
+
+	/**
+	 * CPU side resources of a terrain. Loading them does not involve OpenGL, so it can
+	 * be done off the main thread and adopted later by the terrain.
+	 */
+	typedef struct sTerrainResources {
+		HeightPyramid *heights = nullptr;
+		ObjLoader *loader = nullptr;
+		TerrainMesh *mesh = nullptr;
+		Material *material = nullptr;
+		glm::vec2 size = {0, 0};
+	} TerrainResources_t;
+
+	class Terrain {
 
 		static std::string TAG;
 
-		Texture2D *pDirtTexture = nullptr;    // 3D canvas texture
-		Canvas2D *pDirtCanvas = nullptr;    // 3D canvas over the texture
-		Drawable *pHeightMap = nullptr;        // Height Map
+		/** Bounds of a render chunk, in render coordinates (world / 1000) */
+		typedef struct sChunkBounds {
+			glm::vec3 min, max;
+		} ChunkBounds_t;
+
+		TerrainCanvas *pDirtCanvas = nullptr;    // 3D canvas and its texture
+		HeightPyramid *pHeights = nullptr;    // Height Map min/max pyramid
 		ObjLoader *pLoader = nullptr;        // 3D model loader
+		LayerVao *pMesh = nullptr;            // Uploaded 3D model, one LayerVao mesh per chunk
+		std::vector<ChunkBounds_t> vChunkBounds;    // Bounds of the LayerVao meshes
+		TerrainMesh *pChunks = nullptr;        // Heightmap generated model (meshFromHeightmap)
+		Material *pMaterial = nullptr;        // Material of the heightmap generated model
+		OccluderMesh_t mOccluder;            // Coarse grid under the heightmap generated model
+		const HorizonMap *pHorizon = nullptr;    // Horizon the chunks are tested against, if any
+
+		/** Most occluder grid nodes per side */
+		static constexpr int OCCLUDER_NODES = 64;
 
 		/** Terrain Size */
 		glm::vec2 mSize;
 
+		/** Terrain placement */
+		glm::mat4 mTransform;
+
 		/** Whether terrain has been inited */
 		bool bInited = false;
 		
 		/** Inits the terrain */
 		void init(TerrainShader *shader);
 
+		/** Uploads the OBJ model split in spatial chunks, for culling */
+		void uploadChunks();
+
+		/** Builds the occluder grid from the height pyramid */
+		void buildOccluder();
+
+		/** The terrain material */
+		Material &material();
+
 	public:
 
 		const TerrainConfig_t CONFIG;
 		const WorldConfig_t PLANET;
 
-		Terrain(WorldConfig_t  planetConfig, TerrainConfig_t config);
+		/**
+		 * Creates a terrain
+		 * @param planetConfig The world configuration
+		 * @param config The terrain configuration
+		 * @param deferred Do not load any resource: they will be streamed in later. Requires config.size.
+		 */
+		Terrain(WorldConfig_t  planetConfig, TerrainConfig_t config, bool deferred = false);
 
 		virtual ~Terrain();
 
-		/** Renders the terrain */
+		/**
+		 * Loads the terrain resources. Thread safe, does not touch the terrain nor OpenGL.
+		 * @param config The terrain configuration
+		 * @param size The terrain size, if known. The heightmap needs it.
+		 * @param heights Whether to load the heightmap
+		 * @param render Whether to load the mesh and textures
+		 * @return The loaded resources, to adopt() from the main thread
+		 */
+		static TerrainResources_t load(const TerrainConfig_t &config, glm::vec2 size, bool heights, bool render);
 
-		void render(TerrainShader *shader);
+		/** Takes ownership of loaded resources. Resources already present are discarded. */
+		void adopt(TerrainResources_t resources);
+
+		/** Releases resources until the terrain is at most at the residency level. Main thread. */
+		void release(TerrainResidency_t residency);
+
+		/** Current residency level */
+		TerrainResidency_t residency();
+
+		/** Approximate memory used by the loaded resources, in bytes */
+		size_t residentBytes();
+
+		/**
+		 * Renders the terrain
+		 * @param shader The terrain shader
+		 * @param camera The camera, heightmap generated meshes choose their detail from its position
+		 */
+
+		void render(TerrainShader *shader, Camera *camera);
 
 		/** Queries heightmap */
 		float getHeight(glm::vec3 &posWorld);
 
+		/**
+		 * Casts a ray against the heightmap
+		 * @param origin Ray origin in world coordinates
+		 * @param direction Normalized ray direction
+		 * @param maxDistance Ray length
+		 * @param distance Receives the distance to the hit point
+		 * @return Whether the ray hits this terrain
+		 */
+		bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance);
+
+		/**
+		 * The terrain as an occluder: a coarse grid that never rises above the drawn surface. Only
+		 * resident terrains with a heightmap generated mesh have one, it is empty otherwise.
+		 */
+		const OccluderMesh_t &occluder();
+
+		/**
+		 * The lowest the drawn terrain gets in a square. Only resident terrains with a heightmap
+		 * generated mesh answer, as the other meshes are not bound to the heightmap.
+		 * @param xWorld Square center
+		 * @param zWorld Square center
+		 * @param size Square side, world units
+		 * @param height Receives a height at or below the drawn surface in the whole square
+		 * @return false if the terrain does not know, or the square leaves the terrain
+		 */
+		bool lowest(float xWorld, float zWorld, float size, float &height) const;
+
+		/** Sets the horizon the chunks are tested against when rendering, nullptr for none */
+		void setHorizon(const HorizonMap *horizon);
+
 		/** Whether the absolute coordinates belong to this terrain (mult-terrain world) */
-		bool contains(glm::vec3 &posWorld);
+		bool contains(const glm::vec3 &posWorld);
+
+		/** Whether the absolute coordinates are inside this terrain and off its edges */
+		bool interior(const glm::vec3 &posWorld);
+
+		/** Distance from a world position to the terrain rectangle, on the XZ plane */
+		float distance(const glm::vec3 &posWorld);
 
 		/** draws a debug grid */
 		void wireframe(int inc = 100);
 
-		/** Canvas rendered over the 3D texture */
-		Canvas2D *canvas();
+		/** Canvas rendered over the 3D texture. Not available when the terrain is not resident. */
+		TerrainCanvas *canvas();
 
 		/** Gets Terrain pixel dimensions. Terrain pixel dimensions are the ones of the supporting texture. */
 		int xPixels();
@@ -65,24 +190,51 @@ namespace Pix {
 		int zPixels();
 	};
 
+	inline TerrainResidency_t Terrain::residency() {
+		return pLoader != nullptr || pChunks != nullptr ? TERRAIN_RESIDENT : pHeights != nullptr ? TERRAIN_HEIGHTS : TERRAIN_UNLOADED;
+	}
+
+	inline Material &Terrain::material() {
+		return pChunks != nullptr ? *pMaterial : pLoader->material(0);
+	}
+
 	inline int Terrain::xPixels() { return mSize.x; }
 
 	inline int Terrain::zPixels() { return mSize.y; }
 
 	inline float Terrain::getHeight(glm::vec3 &posWorld3d) {
-		return (pHeightMap != nullptr)
-			   ? CONFIG.scaleHeight * 1000 * pHeightMap->getPixel(posWorld3d.x - CONFIG.origin.x, (posWorld3d.z) - CONFIG.origin.y).r /
-				 (float) 255
+		return (pHeights != nullptr)
+			   ? pHeights->height((int) (posWorld3d.x - CONFIG.origin.x), (int) (posWorld3d.z - CONFIG.origin.y))
 			   : 0;
 	}
 
-	inline bool Terrain::contains(glm::vec3 &posWorld) {
+	inline bool Terrain::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) {
+		return pHeights != nullptr
+			   && pHeights->raycast({origin.x - CONFIG.origin.x, origin.y, origin.z - CONFIG.origin.y}, direction, maxDistance, distance);
+	}
+
+	inline bool Terrain::contains(const glm::vec3 &posWorld) {
 		return posWorld.x >= CONFIG.origin.x
 			   && posWorld.z >= CONFIG.origin.y
 			   && posWorld.x <= CONFIG.origin.x + mSize.x
 			   && posWorld.z <= CONFIG.origin.y + mSize.y;
 	}
 
-	inline Canvas2D *Terrain::canvas() { return pDirtCanvas; }
+	inline bool Terrain::interior(const glm::vec3 &posWorld) {
+		return posWorld.x > CONFIG.origin.x
+			   && posWorld.z > CONFIG.origin.y
+			   && posWorld.x < CONFIG.origin.x + mSize.x
+			   && posWorld.z < CONFIG.origin.y + mSize.y;
+	}
+
+	inline float Terrain::distance(const glm::vec3 &posWorld) {
+		const float dx = std::max(std::max(CONFIG.origin.x - posWorld.x, posWorld.x - CONFIG.origin.x - mSize.x), 0.0F);
+		const float dz = std::max(std::max(CONFIG.origin.y - posWorld.z, posWorld.z - CONFIG.origin.y - mSize.y), 0.0F);
+		return sqrtf(dx * dx + dz * dz);
+	}
+
+	inline TerrainCanvas *Terrain::canvas() { return pDirtCanvas; }
+
+	inline void Terrain::setHorizon(const HorizonMap *horizon) { pHorizon = horizon; }
 
 }
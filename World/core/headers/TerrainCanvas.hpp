@@ -0,0 +1,188 @@
+//
+//  TerrainCanvas.hpp
+//  PixFu Engine
+//
+//  The 3D canvas drawn over a terrain, and its texture. It is a Canvas2D that
+//  records the rectangle touched by every primitive, so only the modified
+//  regions of the texture are uploaded, under a per frame byte budget.
+//
+//  Fading decals go on a separate layer (see DecalLayer), composed over the
+//  canvas pixels as they are uploaded.
+//
+//  Drawing through a plain Canvas2D pointer, or into the buffer directly, is
+//  not tracked: it marks the buffer dirty and causes a full upload.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Canvas2D.hpp"
+#include "Texture2D.hpp"
+#include "Shader.hpp"
+#include "DirtyRegions.hpp"
+#include "DecalLayer.hpp"
+
+namespace Pix {
+
+	class TerrainCanvas : public Canvas2D {
+
+		/** Texture over the canvas buffer (owned) */
+		Texture2D *pTexture = nullptr;
+
+		/** Rectangles pending upload */
+		DirtyRegions mRegions;
+
+		/** Whether the primitives drawn since the last upload were tracked */
+		bool bTracked = false;
+
+		/** Scratch list of regions to upload */
+		std::vector<DirtyRect_t> vUpload;
+
+		/** Scratch pixels of a region composed with the layer */
+		std::vector<Pixel> vComposed;
+
+		void touched(int x0, int y0, int x1, int y1);
+
+	protected:
+
+		/** Fading decals, nullptr until one is drawn */
+		DecalLayer *pLayer = nullptr;
+
+		/** For canvases that manage their own storage: the buffer is only a scratch area */
+		TerrainCanvas(Drawable *scratch, Font *font);
+
+	public:
+
+		/**
+		 * Creates the canvas
+		 * @param texture The texture, the canvas draws on its buffer. The canvas takes ownership.
+		 * @param font The font for drawString
+		 */
+		TerrainCanvas(Texture2D *texture, Font *font);
+
+		virtual ~TerrainCanvas();
+
+		/** Pending regions */
+		const DirtyRegions &regions() const;
+
+		/** Uploads the whole texture. Main thread. */
+		virtual void init();
+
+		/**
+		 * Uploads the modified regions to the texture
+		 * @param budget Maximum bytes to upload, the remaining regions wait for the next call
+		 * @return Bytes uploaded
+		 */
+		virtual size_t upload(size_t budget);
+
+		/** Binds the texture to a sampler of the shader */
+		virtual void bind(Shader *shader, const std::string &sampler);
+
+		/** Memory used by the canvas (CPU + GPU), in bytes */
+		virtual size_t bytes();
+
+		/** Canvas dimensions, in terrain pixels */
+		virtual int width();
+
+		virtual int height();
+
+		/** Storage pixels per terrain pixel. Span operations work in storage pixels. */
+		virtual float resolution();
+
+		/** Marks a storage rectangle [x0, x1) x [y0, y1) as modified, after span operations */
+		virtual void invalidate(int x0, int y0, int x1, int y1);
+
+		/** Blends a color over the storage pixels [x0, x1] of row y. Not tracked, see invalidate. */
+		virtual void blendSpan(int x0, int x1, int y, Pixel color);
+
+		/** Scales the alpha of the storage pixels [x0, x1] of row y by factor / 256. Not tracked. */
+		virtual void fadeSpan(int x0, int x1, int y, uint32_t factor);
+
+		/** The layer of fading decals, created on first use. Span operations on it are not tracked either. */
+		DecalLayer *layer();
+
+		/** Frees the layer, once nothing is left on it */
+		void releaseLayer();
+
+		virtual void setPixel(int32_t x, int32_t y, Pixel p);
+
+		virtual void drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p, uint32_t pattern = 0xFFFFFFFF);
+
+		virtual void drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask = 0xFF);
+
+		virtual void fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p);
+
+		virtual void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p);
+
+		virtual void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p);
+
+		virtual void drawString(int32_t x, int32_t y, const std::string &text, Pixel col, uint32_t scale = 1);
+
+		virtual void clear(Pixel p);
+
+		virtual void blank();
+	};
+
+	inline const DirtyRegions &TerrainCanvas::regions() const { return mRegions; }
+
+	inline int TerrainCanvas::width() { return Canvas2D::width(); }
+
+	inline int TerrainCanvas::height() { return Canvas2D::height(); }
+
+	inline float TerrainCanvas::resolution() { return 1.0F; }
+
+	inline void TerrainCanvas::invalidate(int x0, int y0, int x1, int y1) { touched(x0, y0, x1, y1); }
+
+	inline void TerrainCanvas::touched(int x0, int y0, int x1, int y1) {
+		mRegions.add(x0, y0, x1, y1);
+		bTracked = true;
+	}
+
+	inline void TerrainCanvas::setPixel(int32_t x, int32_t y, Pixel p) {
+		touched(x, y, x + 1, y + 1);
+		Canvas2D::setPixel(x, y, p);
+	}
+
+	inline void TerrainCanvas::drawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p, uint32_t pattern) {
+		touched(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2) + 1, std::max(y1, y2) + 1);
+		Canvas2D::drawLine(x1, y1, x2, y2, p, pattern);
+	}
+
+	inline void TerrainCanvas::drawCircle(int32_t x, int32_t y, int32_t radius, Pixel p, uint8_t mask) {
+		touched(x - radius, y - radius, x + radius + 1, y + radius + 1);
+		Canvas2D::drawCircle(x, y, radius, p, mask);
+	}
+
+	inline void TerrainCanvas::fillCircle(int32_t x, int32_t y, int32_t radius, Pixel p) {
+		touched(x - radius, y - radius, x + radius + 1, y + radius + 1);
+		Canvas2D::fillCircle(x, y, radius, p);
+	}
+
+	inline void TerrainCanvas::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) {
+		touched(x, y, x + w + 1, y + h + 1);
+		Canvas2D::drawRect(x, y, w, h, p);
+	}
+
+	inline void TerrainCanvas::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel p) {
+		touched(x, y, x + w, y + h);
+		Canvas2D::fillRect(x, y, w, h, p);
+	}
+
+	inline void TerrainCanvas::clear(Pixel p) {
+		mRegions.addAll();
+		bTracked = true;
+		Canvas2D::clear(p);
+	}
+
+	inline void TerrainCanvas::blank() {
+		mRegions.addAll();
+		bTracked = true;
+		Canvas2D::blank();
+	}
+
+}
@@ -0,0 +1,83 @@
+//
+//  TerrainIndex.hpp
+//  PixFu Engine
+//
+//  A uniform grid over the terrains of a multi-terrain world, so finding the
+//  terrain under a world position does not need to scan all of them. Cells are
+//  sized after the smallest terrain, so tiled worlds get one terrain per cell.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+
+#include "Terrain.hpp"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class TerrainIndex {
+
+		/** Maximum number of cells, cells grow to honor it */
+		static constexpr int MAXCELLS = 1 << 20;
+
+		/** Grid origin and extent in world coordinates */
+		glm::vec2 mOrigin = {0, 0};
+		glm::vec2 mExtent = {0, 0};
+
+		/** Inverse cell size */
+		glm::vec2 mInvCell = {0, 0};
+
+		int nCols = 0, nRows = 0;
+
+		/** cell i candidates are vCandidates[vCellStart[i] .. vCellStart[i+1]) */
+		std::vector<int> vCellStart;
+		std::vector<Terrain *> vCandidates;
+
+	public:
+
+		/**
+		 * (Re)builds the index
+		 * @param terrains The world terrains. On shared edges, the first one wins.
+		 */
+		void build(const std::vector<Terrain *> &terrains);
+
+		/**
+		 * Finds the terrain that contains a world position
+		 * @param posWorld The position
+		 * @return The terrain, or nullptr if there is no terrain there
+		 */
+		Terrain *find(const glm::vec3 &posWorld) const;
+
+		/**
+		 * Finds the terrains that overlap a world rectangle
+		 * @param minWorld Smallest x/z corner
+		 * @param maxWorld Largest x/z corner
+		 * @param terrains Receives the terrains, each once
+		 */
+		void find(const glm::vec2 &minWorld, const glm::vec2 &maxWorld, std::vector<Terrain *> &terrains) const;
+
+	};
+
+	inline Terrain *TerrainIndex::find(const glm::vec3 &posWorld) const {
+
+		const float x = posWorld.x - mOrigin.x, z = posWorld.z - mOrigin.y;
+
+		if (nCols == 0 || x < 0 || z < 0 || x > mExtent.x || z > mExtent.y) return nullptr;
+
+		// far edges belong to the last cell
+		const int col = std::min((int) (x * mInvCell.x), nCols - 1);
+		const int row = std::min((int) (z * mInvCell.y), nRows - 1);
+		const int cell = row * nCols + col;
+
+		for (int i = vCellStart[cell], l = vCellStart[cell + 1]; i < l; i++)
+			if (vCandidates[i]->contains(posWorld)) return vCandidates[i];
+
+		return nullptr;
+	}
+
+}
@@ -0,0 +1,126 @@
+//
+//  TerrainMesh.hpp
+//  PixFu Engine
+//
+//  A terrain render mesh generated from the heightmap, as a grid of square
+//  chunks (geomipmapping). Every chunk is drawn at a detail level chosen from
+//  its distance to the camera. Edges shared with a coarser neighbor collapse
+//  their odd vertices, so there are no cracks between levels.
+//
+//  All chunks share one vertex buffer and one index buffer. The index buffer
+//  holds, for every level, the 16 variants of edges to stitch. Indices are
+//  local to the chunk, and every chunk has its own VAO pointing at its vertices.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "OpenGL.h"
+#include "Frustum.hpp"
+#include "HeightPyramid.hpp"
+#include "HorizonMap.hpp"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class TerrainMesh {
+
+		static std::string TAG;
+
+		/** Floats per vertex: position, normal, texture coordinates */
+		static constexpr int FLOATS = 8;
+
+		/** Edges to stitch: the neighbor there is one level coarser */
+		static constexpr int EDGE_NORTH = 1, EDGE_EAST = 2, EDGE_SOUTH = 4, EDGE_WEST = 8, EDGE_VARIANTS = 16;
+
+		typedef struct sChunk {
+			/** First vertex in the shared vertex buffer */
+			unsigned firstVertex;
+			/** Bounds, world coordinates */
+			glm::vec3 min, max;
+			/** Detail level for the current frame */
+			int lod;
+			GLuint vao;
+		} Chunk_t;
+
+		typedef struct sRange {
+			unsigned offset, count;
+		} Range_t;
+
+		/** Quads per chunk side at full detail */
+		const int CHUNK;
+
+		/** Number of detail levels */
+		const int LODS;
+
+		/** Distance where the first reduced level starts, world units */
+		const float LODDISTANCE;
+
+		int nCols = 0, nRows = 0;
+
+		std::vector<Chunk_t> vChunks;
+
+		/** index ranges for level l and edge mask m are at l * EDGE_VARIANTS + m */
+		std::vector<Range_t> vRanges;
+
+		/** CPU copies, released once uploaded */
+		std::vector<float> vVertices;
+		std::vector<uint16_t> vIndices;
+
+		GLuint mVbo = 0, mIbo = 0;
+		size_t mBytes = 0;
+		bool bUploaded = false;
+
+		void buildVertices(const HeightPyramid *heights, glm::vec2 size, glm::vec2 origin, int step);
+
+		void buildIndices();
+
+		void selectLods(const glm::vec3 &camera);
+
+		Chunk_t *neighbor(int col, int row);
+
+	public:
+
+		/**
+		 * Builds the mesh on the CPU. Does not touch OpenGL, so it can run off the main thread.
+		 * @param heights The terrain heights
+		 * @param size The terrain size (heightmap pixels)
+		 * @param origin The terrain origin in world coordinates
+		 * @param step Heightmap pixels between vertices at full detail
+		 * @param chunkSize Quads per chunk side at full detail. Power of two, up to 128.
+		 * @param lods Number of detail levels. Every level halves the vertices per side.
+		 * @param lodDistance Distance where the first reduced level starts. It doubles for every level.
+		 */
+		TerrainMesh(const HeightPyramid *heights, glm::vec2 size, glm::vec2 origin,
+					int step, int chunkSize, int lods, float lodDistance);
+
+		~TerrainMesh();
+
+		/** Uploads the buffers to the GPU. Main thread. */
+		void upload();
+
+		/**
+		 * Draws the visible chunks
+		 * @param camera Camera position in world coordinates, to choose the detail levels
+		 * @param frustum The camera frustum, nullptr to draw all chunks
+		 * @param horizon The terrain horizon, chunks below it are not drawn. Optional.
+		 * @return Number of chunks drawn
+		 */
+		int draw(const glm::vec3 &camera, const Frustum *frustum, const HorizonMap *horizon = nullptr);
+
+		/** Memory used by the mesh, in bytes */
+		size_t bytes() const;
+	};
+
+	inline TerrainMesh::Chunk_t *TerrainMesh::neighbor(int col, int row) {
+		return col >= 0 && row >= 0 && col < nCols && row < nRows ? &vChunks[row * nCols + col] : nullptr;
+	}
+
+	inline size_t TerrainMesh::bytes() const { return mBytes; }
+
+}
@@ -0,0 +1,133 @@
+//
+//  TerrainStreamer.hpp
+//  PixFu Engine
+//
+//  Streams the terrains of a tiled world: terrains near the camera are fully
+//  loaded, terrains near physics bodies get their heightmap, and everything else
+//  is unloaded when the memory budget is exceeded. Loading happens on background
+//  threads, the loaded resources are adopted by the terrains on the main thread.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "Terrain.hpp"
+#include "WorldMeta.hpp"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+
+namespace Pix {
+
+	class TerrainStreamer {
+
+		static std::string TAG;
+
+		typedef struct sJob {
+			Terrain *terrain;
+			bool heights, render;
+			glm::vec2 size;
+			TerrainResources_t resources = {};
+			bool failed = false;
+		} Job_t;
+
+		typedef struct sFailure {
+			int count;
+			uint64_t retry;        // update at which the terrain may be loaded again
+		} Failure_t;
+
+		/** Updates to wait before loading a failed terrain again, doubled on each new failure */
+		static constexpr uint64_t RETRY_UPDATES = 60;
+
+		/** Cap of the doubling, 2^MAX_BACKOFF * RETRY_UPDATES */
+		static constexpr int MAX_BACKOFF = 6;
+
+		/** The world terrains */
+		const std::vector<Terrain *> &vTerrains;
+
+		/** Loader threads */
+		std::vector<std::thread> vWorkers;
+
+		std::mutex mLock;
+		std::condition_variable mSignal;
+		bool bStop = false;
+
+		/** Pending jobs, nearest first */
+		std::deque<Job_t> qJobs;
+
+		/** Finished jobs, to adopt on the main thread */
+		std::vector<Job_t> vFinished;
+
+		/** Terrains with a job queued or in progress (main thread) */
+		std::unordered_set<Terrain *> sPending;
+
+		/** Terrains that failed to load, retried after a backoff (main thread) */
+		std::unordered_map<Terrain *, Failure_t> mFailed;
+
+		/** Number of updates so far (main thread) */
+		uint64_t nUpdate = 0;
+
+		/** Per-frame scratch (main thread) */
+		std::vector<Terrain *> vWantRender, vWantHeights, vPinned;
+
+		void work();
+
+		void request(Terrain *terrain, bool heights, bool render);
+
+		void adoptFinished();
+
+		/** Whether the terrain failed to load and is still backing off */
+		bool failed(Terrain *terrain);
+
+		/** Records a failed load */
+		void fail(Terrain *terrain);
+
+		static void discard(TerrainResources_t &resources);
+
+		void enforceBudget(const glm::vec3 &camera);
+
+		static bool has(const std::vector<Terrain *> &terrains, Terrain *terrain);
+
+	public:
+
+		const TerrainStreaming_t CONFIG;
+
+		/**
+		 * Creates the streamer and starts its threads
+		 * @param config Streaming configuration
+		 * @param terrains The world terrains. They must outlive the streamer.
+		 */
+		TerrainStreamer(const TerrainStreaming_t &config, const std::vector<Terrain *> &terrains);
+
+		~TerrainStreamer();
+
+		/**
+		 * Updates the loaded set. Called by the world every frame.
+		 * @param camera Camera position in world coordinates
+		 * @param bodies Positions of the physics bodies in world coordinates
+		 */
+		void update(const glm::vec3 &camera, const std::vector<glm::vec3> &bodies);
+
+		/** Memory used by the loaded terrains, in bytes */
+		size_t residentBytes();
+	};
+
+	inline bool TerrainStreamer::failed(Terrain *terrain) {
+		auto failure = mFailed.find(terrain);
+		return failure != mFailed.end() && nUpdate < failure->second.retry;
+	}
+
+	inline bool TerrainStreamer::has(const std::vector<Terrain *> &terrains, Terrain *terrain) {
+		return std::find(terrains.begin(), terrains.end(), terrain) != terrains.end();
+	}
+
+}
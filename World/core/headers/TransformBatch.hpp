@@ -0,0 +1,60 @@
+//
+//  TransformBatch.hpp
+//  PixFu Engine
+//
+//  Builds many model matrices at once. Equivalent to createTransformationMatrix
+//  (translate, rotate X, Y, Z, uniform scale, flip) followed by an optional
+//  placer matrix, but the rotation is written in closed form from the sines
+//  and cosines, and 4 instances are computed per step from SoA inputs.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace Pix {
+
+	class TransformBatch {
+
+		/** Inputs, structure of arrays */
+		std::vector<float> vX, vY, vZ, vRX, vRY, vRZ, vScale;
+
+		/** Column signs from the flips */
+		float mFlip[3];
+
+	public:
+
+		TransformBatch(bool flipX = false, bool flipY = false, bool flipZ = false);
+
+		void clear();
+
+		/**
+		 * Queues an instance
+		 * @param translation Translation
+		 * @param rotation Euler angles, radians, applied X, then Y, then Z
+		 * @param scale Uniform scale
+		 */
+		void add(const glm::vec3 &translation, const glm::vec3 &rotation, float scale);
+
+		size_t size() const;
+
+		/**
+		 * Builds the matrices of the queued instances, in order
+		 * @param out Receives size() matrices
+		 * @param placer Multiplied on the right of every matrix, nullptr for none
+		 */
+		void build(glm::mat4 *out, const glm::mat4 *placer = nullptr) const;
+
+		/** Closed form of a single matrix, same as a batch of one */
+		static glm::mat4 build(const glm::vec3 &translation, const glm::vec3 &rotation, float scale,
+							   const float flip[3], const glm::mat4 *placer);
+	};
+
+	inline size_t TransformBatch::size() const { return vX.size(); }
+
+}
@@ -13,7 +13,17 @@
 
 #include "WorldMeta.hpp"
 #include "Terrain.hpp"
+#include "TerrainIndex.hpp"
+#include "TerrainStreamer.hpp"
+#include "DecalQueue.hpp"
+#include "RenderQueue.hpp"
+#include "LightGrid.hpp"
+#include "LightBlock.hpp"
+#include "OcclusionBuffer.hpp"
+#include "HorizonMap.hpp"
+#include "WorldObject.hpp"
 #include "ObjectCluster.hpp"
+#include "ObjectPool.hpp"
 #include "Lighting.hpp"
 
 #include <map>
@@ -40,22 +50,77 @@ namespace Pix {
 		/** Shader for objects */
 		ObjectShader *pShaderObjects = nullptr;
 
+		/** Shader for the far objects, only with CONFIG.impostors */
+		Shader3D *pShaderImpostors = nullptr;
+
 		/** World Camera */
 		Camera *pCamera = nullptr;
 
 		/** Object Clusters */
 		std::map<std::string, ObjectCluster *> mClusters;
 
-		/** Change in number of lights */
-		bool bLightsChanged = false;
-		
+		/** Terrain lookup grid (multi-terrain worlds) */
+		TerrainIndex mTerrainIndex;
+
+		/** Terrain streamer, only on streamed worlds */
+		TerrainStreamer *pStreamer = nullptr;
+
+		/** Positions of the moving objects, for the streamer */
+		std::vector<glm::vec3> vBodies;
+
+		/** Marks queued for the terrain canvases */
+		DecalQueue mDecals;
+
+		/** A place for an object handle: the object there, and the generation of the handles to it */
+		typedef struct sObjectSlot {
+			WorldObject *object;
+			uint32_t generation;
+		} ObjectSlot_t;
+
+		/** Object handles, and the places free for the next objects */
+		std::vector<ObjectSlot_t> vSlots;
+		std::vector<uint32_t> vFreeSlots;
+
+		/** Objects removed, they leave their clusters on the next tick */
+		std::vector<WorldObject *> vRemoved;
+
+		/** The objects created by the world */
+		ObjectPool<WorldObject> mPool;
+
+		/** Takes the removed objects out of their clusters, and frees them */
+		void flushRemoved();
+
+		/** Draws of the frame, sorted by state and depth */
+		RenderQueue mQueue;
+
+		/**
+		 * Finds the terrain under a world position. On shared edges the first terrain wins.
+		 * @param hint The last terrain found for the caller, tried first and updated. nullptr for none.
+		 */
+		Terrain *terrainAt(const glm::vec3 &posWorld, Terrain **hint = nullptr);
+
+		/** Point and spot lights binned for selection */
+		LightGrid mLights;
+
+		/** The lights, uploaded once for all shaders, only with CONFIG.lightBlock */
+		LightBlock *pLightBlock = nullptr;
+
 		LightMode_t mLightMode = LIGHTS_OFF;
 
+		/** Terrain and big objects rasterized for occlusion culling, only with CONFIG.occlusionCulling */
+		OcclusionBuffer *pOcclusion = nullptr;
+
+		/** Terrain horizon around the camera, only with CONFIG.horizonCulling */
+		HorizonMap *pHorizon = nullptr;
+
 	protected:
 
 		/** The current projection matrix */
 		glm::mat4 projectionMatrix;
 
+		/** Projected diameter in pixels of a radius at distance 1, for the object detail levels */
+		float fPixelScale = 0;
+
 		/** Object Clusters */
 		std::vector<ObjectCluster *> vObjects;
 
@@ -126,11 +191,36 @@ namespace Pix {
 
 		virtual WorldObject *add(int oid, bool setHeight);
 
+		/**
+		 * Removes an object from the world. Its handle stops finding it at once; it is drawn until
+		 * the next tick, when it is taken out of its cluster and freed.
+		 * @param handle The object handle
+		 * @return false if the object was already removed
+		 */
+		bool remove(ObjectHandle_t handle);
+
+		bool remove(WorldObject *object);
+
+		/**
+		 * Frees a removed object. Objects the world did not create are deleted: worlds that create
+		 * their own objects override this to free them.
+		 */
+		virtual void dispose(WorldObject *object);
+
 		void addLight(std::shared_ptr<PointLight> p);
 		void addLight(std::shared_ptr<SpotLight> p);
 
-		void loadLights(LightingShader *shader);
-		void updateLights(LightingShader *shader);
+		/**
+		 * Loads the lighting mode and a light set into a shader
+		 * @param set Light set from the light grid, -1 to only set the mode
+		 */
+		void loadLights(LightingShader *shader, int set);
+
+		/** Bins the lights for this frame */
+		void updateLights();
+
+		/** Rasterizes the occluders of this frame */
+		void updateOcclusion();
 
 		/**
 		 * Iterates all world objects
@@ -216,18 +306,49 @@ namespace Pix {
 		 * Looks up the terrain height (+Y) for a world position. Height will be adjusted using the height scale
 		 * parameter passed on the TerrainConfig object.
 		 * @param posWorld Position to check
+		 * @param hint The caller's last terrain, see WorldObject::pTerrain. Speeds up coherent queries.
 		 * @return height in world coordinates
 		 */
 
-		float getHeight(glm::vec3 &posWorld);
+		float getHeight(glm::vec3 &posWorld, Terrain **hint = nullptr);
+
+		/**
+		 * Finds an object by its handle
+		 * @param handle The object handle
+		 * @return The object, nullptr if it was removed
+		 */
+		WorldObject *get(ObjectHandle_t handle);
 
 		/**
 		 * Whether there is a terrain at that world coords.
 		 * @param posWorld Position to check
+		 * @param hint The caller's last terrain, see getHeight
 		 * @return whether
 		 */
 
-		bool hasTerrain(glm::vec3 &posWorld);
+		bool hasTerrain(glm::vec3 &posWorld, Terrain **hint = nullptr);
+
+		/**
+		 * Casts a ray against the terrain heightmaps. The march is hierarchical and exact:
+		 * every heightmap pixel the ray crosses is checked.
+		 *
+		 * @param origin Ray origin in world coordinates
+		 * @param direction Normalized ray direction
+		 * @param maxDistance Ray length in world units
+		 * @param hit Receives the terrain point hit by the ray
+		 * @return Whether the ray hits the terrain
+		 */
+
+		bool raycastTerrain(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, glm::vec3 &hit);
+
+		/**
+		 * Whether there is terrain between two points
+		 * @param from Start point in world coordinates
+		 * @param to End point in world coordinates
+		 * @return true if the segment does not cross the terrain
+		 */
+
+		bool lineOfSight(const glm::vec3 &from, const glm::vec3 &to);
 
 		/**
 		 * Selects an object using raytracing (nehavior is object dependent)
@@ -249,16 +370,31 @@ namespace Pix {
 		 * Gets the 3D canvas. A
 		 * @param posWorld Any world position. As we can have several terrains, we need to supply this world coordinates
 		 * so the engine knows what terrain canvas to return (each terrain has a 3D canvas)
+		 * @param hint The caller's last terrain, see getHeight
 		 * @return The 3D canvas
 		 */
 
-		Canvas2D *canvas(glm::vec3 &posWorld);
+		TerrainCanvas *canvas(glm::vec3 &posWorld, Terrain **hint = nullptr);
 
 		/**
 		 * Convenience function to return the 3D canvas of the first terrain.
 		 * @return The 3D canvas
 		 */
-		Canvas2D *canvas();
+		TerrainCanvas *canvas();
+
+		/**
+		 * Gets the decal queue. Decals are drawn on the terrain canvases before the next frame
+		 * is rendered, in one pass. Cheaper than drawing on the canvas for many marks.
+		 * @return The decal queue
+		 */
+		DecalQueue &decals();
+
+		/**
+		 * Model matrices rebuilt on the last frame, for all clusters. Objects that did not move
+		 * reuse their matrix.
+		 * @return The number of matrices
+		 */
+		int rebuiltMatrices();
 
 	};
 
@@ -268,52 +404,68 @@ namespace Pix {
 
 	inline Camera *World::camera() { return pCamera; }
 
-	inline float World::getHeight(glm::vec3 &posWorld) {
+	inline Terrain *World::terrainAt(const glm::vec3 &posWorld, Terrain **hint) {
+
+		// only off the edges: there the index decides, in terrain order
+		if (hint != nullptr && *hint != nullptr && (*hint)->interior(posWorld))
+			return *hint;
+
+		Terrain *terrain = mTerrainIndex.find(posWorld);
+		if (hint != nullptr && terrain != nullptr) *hint = terrain;
+		return terrain;
+	}
+
+	inline float World::getHeight(glm::vec3 &posWorld, Terrain **hint) {
 
 		if (vTerrains.size() == 1)
 			return vTerrains[0]->getHeight(posWorld);
 
-		for (Terrain *terrain:vTerrains) {
-			if (terrain->contains(posWorld))
-				return terrain->getHeight(posWorld);
-		}
-
-		return 0;
+		Terrain *terrain = terrainAt(posWorld, hint);
+		return terrain != nullptr ? terrain->getHeight(posWorld) : 0;
 	}
 
 	inline glm::mat4 World::getProjectionMatrix() {
 		return projectionMatrix;
 	}
 
-	inline bool World::hasTerrain(glm::vec3 &posWorld) {
+	inline bool World::hasTerrain(glm::vec3 &posWorld, Terrain **hint) {
 
 		if (vTerrains.size() == 1)
 			return vTerrains[0]->contains(posWorld);
 
-		for (Terrain *terrain:vTerrains)
-			if (terrain->contains(posWorld))
-				return true;
-
-		return false;
+		return terrainAt(posWorld, hint) != nullptr;
 	}
 
-	inline Canvas2D *World::canvas(glm::vec3 &posWorld) {
+	inline TerrainCanvas *World::canvas(glm::vec3 &posWorld, Terrain **hint) {
 
 		if (vTerrains.size() == 1)
 			return vTerrains[0]->canvas();
 
-		for (Terrain *terrain:vTerrains) {
-			if (terrain->contains(posWorld))
-				return terrain->canvas();
-		}
-
-		return nullptr;
+		Terrain *terrain = terrainAt(posWorld, hint);
+		return terrain != nullptr ? terrain->canvas() : nullptr;
 	}
 
-	inline Canvas2D *World::canvas() {
+	inline TerrainCanvas *World::canvas() {
 		return vTerrains[0]->canvas();
 	}
 
+	inline DecalQueue &World::decals() {
+		return mDecals;
+	}
+
+	inline int World::rebuiltMatrices() {
+		int total = 0;
+		for (ObjectCluster *cluster : vObjects) total += cluster->rebuiltMatrices();
+		return total;
+	}
+
+	inline WorldObject *World::get(ObjectHandle_t handle) {
+		return handle.index < vSlots.size() && vSlots[handle.index].generation == handle.generation
+			   ? vSlots[handle.index].object : nullptr;
+	}
+
+	inline bool World::remove(WorldObject *object) { return remove(object->handle()); }
+
 	inline WorldObject *World::add(int oid, ObjectLocation_t location, bool setHeight) {
 		const ObjectDbEntry_t *entry = ObjectDb::get(oid);
 		return add(entry->first, location, setHeight);
@@ -17,6 +17,7 @@
 #include "Lighting.hpp"
 
 #include "glm/mat4x4.hpp"
+#include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
 
@@ -75,6 +76,31 @@ namespace Pix {
 		DEBUG_NONE, DEBUG_GRID, DEBUG_COLLISIONS, DEBUG_WIREFRAME, DEBUG_LIGHTS
 	} WorldDebug_t;
 
+	/**
+	 * Terrain streaming configuration. When enabled, terrains are not loaded when added to the
+	 * world: they are loaded and unloaded on background threads around the camera and around
+	 * the physics bodies, within a memory budget.
+	 */
+
+	typedef struct sTerrainStreaming {
+
+		/** Whether to stream terrains (streamed terrains require TerrainConfig_t::size) */
+		const bool enabled = false;
+
+		/** Terrains closer than this to the camera are fully loaded (world units) */
+		const float renderDistance = 3000;
+
+		/** Heightmaps closer than this to a physics body are loaded (world units) */
+		const float heightsDistance = 1000;
+
+		/** Memory budget for the loaded terrains, in bytes */
+		const size_t memoryBudget = 256u * 1024u * 1024u;
+
+		/** Number of loader threads */
+		const int threads = 1;
+
+	} TerrainStreaming_t;
+
 	/**
 	 * World configuration object. It is used to instantiate the world class and
 	 * contains the root parameters: lighting, background ...
@@ -109,6 +135,57 @@ namespace Pix {
 		/** determines which shader to use (assets) */
 		const std::string shaderName = "luxworld";
 
+		/** terrain streaming for big tiled worlds */
+		const TerrainStreaming_t streaming = {};
+
+		/** maximum bytes of 3d canvas uploaded to the terrain textures per frame */
+		const size_t canvasUploadBudget = 4u * 1024u * 1024u;
+
+		/** store the 3d canvas in tiles allocated on first write, instead of a full size buffer */
+		const bool sparseCanvas = false;
+
+		/** sparse canvas pixels per terrain pixel, (0..1] */
+		const float canvasResolution = 1.0;
+
+		/** side of the cells that group static objects for culling, world units */
+		const float objectCellSize = 512;
+
+		/** side of the cells that bin the point and spot lights, world units */
+		const float lightCellSize = 1024;
+
+		/** share the lights between shaders in a uniform block (needs shaders with the Lights block, see LightBlock) */
+		const bool lightBlock = false;
+
+		/** objects look smaller than this, in pixels across, use their first lower detail model, each next one half of it */
+		const float lodPixels = 160;
+
+		/** margin around the detail switches, so objects near one do not flicker between models (0.1 = 10%) */
+		const float lodHysteresis = 0.1;
+
+		/** hide the objects behind the terrain and the occluder objects, tested on the CPU (see OcclusionBuffer) */
+		const bool occlusionCulling = false;
+
+		/** width of the occlusion depth buffer in pixels, the height follows the screen aspect */
+		const int occlusionWidth = 256;
+
+		/** hide the terrain chunks, objects and lights below the heightmap horizon around the camera (see HorizonMap) */
+		const bool horizonCulling = false;
+
+		/** farthest terrain that can hide something, in world units */
+		const float horizonDistance = 5000;
+
+		/** merge the static objects of every cell into one mesh per material at load, and draw them per cell (not with instancedObjects) */
+		const bool staticBatching = false;
+
+		/** draw every object cluster with one instanced call per mesh (needs the <shaderName>_objects_instanced shader) */
+		const bool instancedObjects = false;
+
+		/** draw far objects as quads from their <name>.impostor.png atlas (needs the <shaderName>_impostors shader, see ImpostorBatch) */
+		const bool impostors = false;
+
+		/** folder to cache decoded heightmaps and textures, empty to decode them on every load */
+		const std::string pixelCache = "";
+
 	} WorldConfig_t;
 
 	//
@@ -207,6 +284,15 @@ namespace Pix {
 		 */
 		const float drawRadiusMultiplier = 1.0;
 
+		/** Objects of the class farther than this from the camera are not drawn (world units), 0 for no limit */
+		const float maxDrawDistance = 0;
+
+		/** Objects of the class farther than this from the camera are drawn as impostors (world units), 0 for never */
+		const float impostorDistance = 0;
+
+		/** Half side of a box around the object position that the object fills whatever its rotation, to hide what is behind it (world units), 0 for none */
+		const float occluderRadius = 0;
+
 	} ObjectProperties_t;
 
 	/**
@@ -275,6 +361,33 @@ namespace Pix {
 		/** use a provided mesh instead of loading one */
 		const Static3DObject_t *staticMesh = nullptr;
 
+		/**
+		 * Terrain size in world units (the size of its texture). Optional, but streamed terrains
+		 * need it to be placed before they are loaded.
+		 */
+		const glm::vec2 size = {0, 0};
+
+		/**
+		 * Build the render mesh from the heightmap instead of loading <name>.obj. The mesh is split
+		 * in chunks with several detail levels, chosen by distance to the camera. The texture is <name>.png
+		 */
+		const bool meshFromHeightmap = false;
+
+		/** heightmap pixels between mesh vertices at full detail */
+		const int meshStep = 4;
+
+		/** quads per chunk side at full detail, power of two up to 128 */
+		const int meshChunkSize = 64;
+
+		/** number of detail levels, every level halves the vertices per chunk side */
+		const int meshLods = 4;
+
+		/** distance to the camera where the first reduced level starts (world units). Doubles every level. */
+		const float meshLodDistance = 1000;
+
+		/** OBJ terrain meshes are split in square chunks of this size (world units) to frustum cull them */
+		const float cullChunkSize = 512;
+
 	} TerrainConfig_t;
 
 
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "glm/mat4x4.hpp"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
@@ -17,6 +19,19 @@ namespace Pix {
 
 	class World;
 
+	class ObjectCluster;
+
+	class Terrain;
+
+	/**
+	 * Refers to an object of a world. The generation tells apart the objects that take the
+	 * same place one after the other, so a handle to a removed object finds nothing.
+	 */
+	typedef struct sObjectHandle {
+		uint32_t index = 0;
+		uint32_t generation = 0;    // 0: no object
+	} ObjectHandle_t;
+
 	class WorldObjectBase {
 
 		static int instanceCounter;
@@ -77,6 +92,9 @@ namespace Pix {
 
 	class WorldObject : public WorldObjectBase {
 
+		friend class ObjectCluster;
+
+		friend class World;
 
 		/** Whether the object is selected (settable flag) */
 		bool bSelected = false;
@@ -84,10 +102,20 @@ namespace Pix {
 		/** Object Tint */
 		glm::vec4 mTintCode = TINT_NONE;
 
+		/** The cluster that draws the object, and the object record there */
+		ObjectCluster *pCluster = nullptr;
+		size_t nRecord = 0;
+
+		/** The handle of the object in its world */
+		ObjectHandle_t mHandle;
+
 	protected:
 
 		float fRadiusAnimator = 0;
 
+		/** The terrain found under the object last time, a hint for the terrain queries of the object */
+		Terrain *pTerrain = nullptr;
+
 		// Object Location
 		ObjectLocation_t LOCATION;
 
@@ -116,19 +144,29 @@ namespace Pix {
 		// todo comment why this is normaized !!
 		inline virtual float drawRadius() override { return CONFIG.radius * CONFIG.drawRadiusMultiplier / 1000.0F; }
 
+		/** The object tint. Change it with setTint, so the cluster redraws it. */
 		inline virtual glm::vec4 &tintCode() { return mTintCode; }
 
 		inline bool isSelected() { return bSelected; };
 
+		/** The handle of the object, empty until it is added to a world */
+		inline ObjectHandle_t handle() const { return mHandle; }
+
 		/**
 		 * Selects this object
 		 */
-		inline void setSelected(bool selected = true) { bSelected = selected; };
+		void setSelected(bool selected = true);
 
 		/**
 		 * Tints this object
 		 */
-		inline void setTint(glm::vec4 tintCode) { mTintCode = tintCode; };
+		void setTint(glm::vec4 tintCode);
+
+		/**
+		 * Tells the world a static object was moved, as when something bumps it, so it is
+		 * drawn and culled where it is now. Moving objects are reread every frame anyway.
+		 */
+		void moved();
 
 		/** process animations */
 		virtual void process(World *world, float fElapsedTime);
@@ -9,14 +9,38 @@
 #pragma once
 #include "Shader.hpp"
 #include "Material.hpp"
+#include "glm/vec3.hpp"
+
+#include <vector>
+#include <cstdint>
 
 namespace Pix {
 
+	/** Last value uploaded to a uniform location */
+	typedef struct sUniformShadow {
+		uint32_t bits[4];
+		bool valid;
+	} UniformShadow_t;
+
 	class Camera;
 	class WorldShader : public Shader3D {
 
+		/** Locations past this are not shadowed, and always uploaded */
+		static constexpr GLuint MAX_SHADOWED = 1024;
+
+		mutable std::vector<UniformShadow_t> vShadow;
+		mutable int nUploads = 0, nSkipped = 0;
+
+		/** The program the shadowed values were uploaded to */
+		GLuint nShadowedProgram = 0;
+
+		/** Whether the value differs from the last one uploaded to the location. Remembers it. */
+		bool changed(GLuint location, const void *value, size_t bytes) const;
+
 	protected:
 
+		GLuint LOC_TIME;
+
 		GLuint LOC_MAT_AMBIENT;
 		GLuint LOC_MAT_DIFFUSE;
 		GLuint LOC_MAT_SPECULAR;
@@ -27,14 +51,77 @@ namespace Pix {
 		GLuint LOC_MAT_HASTEXTURE;
 		GLuint LOC_MAT_TEXTURE;
 
-		
+
+		// uniform uploads, skipped when the location already holds the value
+		void uploadInt(GLuint location, int value) const;
+		void uploadFloat(GLuint location, float value) const;
+		void uploadVec2(GLuint location, float x, float y) const;
+		void uploadVec3(GLuint location, float x, float y, float z) const;
+		void uploadVec3(GLuint location, const glm::vec3 &value) const;
+		void uploadVec4(GLuint location, float x, float y, float z, float w) const;
+
 	public:
 
 		WorldShader (const std::string& name);
+		/** Uses the program. A program reloaded since the last use starts with nothing shadowed. */
+		void use();
+		/** Sets the iTime uniform */
+		void setTime(float time) const;
+		/** Uniform uploads issued, and skipped because the value was already there */
+		int uploads() const;
+		int skipped() const;
+		void resetCounters();
+		/** Forgets the shadowed values, after setting uniforms behind the cache */
+		void invalidateUniforms();
 		void loadMaterial(Material& m);
 		void bindMaterial(Material& m);
 		void bindAttributes();
 
 	};
 
+	inline void WorldShader::uploadInt(GLuint location, int value) const {
+		if (changed(location, &value, sizeof(value))) setInt(location, value);
+	}
+
+	inline void WorldShader::uploadFloat(GLuint location, float value) const {
+		if (changed(location, &value, sizeof(value))) setFloat(location, value);
+	}
+
+	inline void WorldShader::uploadVec2(GLuint location, float x, float y) const {
+		const float value[2] = {x, y};
+		if (changed(location, value, sizeof(value))) setVec2(location, x, y);
+	}
+
+	inline void WorldShader::uploadVec3(GLuint location, float x, float y, float z) const {
+		const float value[3] = {x, y, z};
+		if (changed(location, value, sizeof(value))) setVec3(location, x, y, z);
+	}
+
+	inline void WorldShader::uploadVec3(GLuint location, const glm::vec3 &value) const {
+		uploadVec3(location, value.x, value.y, value.z);
+	}
+
+	inline void WorldShader::uploadVec4(GLuint location, float x, float y, float z, float w) const {
+		const float value[4] = {x, y, z, w};
+		if (changed(location, value, sizeof(value))) setVec4(location, x, y, z, w);
+	}
+
+	inline void WorldShader::use() {
+		if (id() != nShadowedProgram) {
+			invalidateUniforms();
+			nShadowedProgram = id();
+		}
+		Shader3D::use();
+	}
+
+	inline void WorldShader::setTime(float time) const { uploadFloat(LOC_TIME, time); }
+
+	inline int WorldShader::uploads() const { return nUploads; }
+
+	inline int WorldShader::skipped() const { return nSkipped; }
+
+	inline void WorldShader::resetCounters() { nUploads = nSkipped = 0; }
+
+	inline void WorldShader::invalidateUniforms() { vShadow.clear(); }
+
 }
@@ -257,26 +257,26 @@ namespace Pix {
 		// to calculate terrain angle
 
 		glm::vec3 chk = {mPosition.x, 0, mPosition.z};
-		float cheight = world->getHeight(chk);
+		float cheight = world->getHeight(chk, &pTerrain);
 
 		const float ang = angle();
 		glm::vec3 heading = {cosf(ang), 0, sinf(ang)};
 
 		// left side
 		glm::vec3 point = mPosition + heading * glm::vec3{-collisionRadius, 0, 0};
-		float heightl = world->getHeight(point);
+		float heightl = world->getHeight(point, &pTerrain);
 
 		// right side
 		point = mPosition + heading * glm::vec3{collisionRadius, 0, 0};
-		float heightr = world->getHeight(point);
+		float heightr = world->getHeight(point, &pTerrain);
 
 		// front
 		point = mPosition + heading * glm::vec3{-0, 0, -collisionRadius};
-		float heightt = world->getHeight(point);
+		float heightt = world->getHeight(point, &pTerrain);
 
 		// back
 		point = mPosition + heading * glm::vec3{-0, 0, collisionRadius};
-		float heightd = world->getHeight(point);
+		float heightd = world->getHeight(point, &pTerrain);
 //		float LERP = 0.5;
 
 		// terrain angle, x and z
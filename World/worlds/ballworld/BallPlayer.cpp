@@ -83,7 +83,7 @@ namespace Pix {
 		WorldObject::process(world, fElapsedTime); // NOLINT(bugprone-parent-virtual-call)
 
 		const bool debug = world->CONFIG.debugMode == DEBUG_COLLISIONS;
-		Canvas2D *canvas = debug ? world->canvas(mPosition) : nullptr;
+		DecalQueue &decals = world->decals();
 
 		// following is a simulation based on that website that models back and front axis
 		// so steering is applied to the front wheels
@@ -104,13 +104,9 @@ namespace Pix {
 			const float TAIL = 40.0F;
 
 			glm::vec2 r = glm::rotate(glm::vec2(TAIL, 0), ang - steerAngle);
-			canvas->drawLine(static_cast<int32_t>(mPosition.x), static_cast<int32_t>(mPosition.z), static_cast<int32_t>(mPosition.x + r.x),
-							 static_cast<int32_t>(mPosition.z + r.y),
-							 Pix::Colors::RED);
+			decals.line(mPosition, mPosition + glm::vec3(r.x, 0, r.y), 1, Pix::Colors::RED);
 			r = glm::rotate(glm::vec2(TAIL, 0), ang);
-			canvas->drawLine(static_cast<int32_t>(mPosition.x), static_cast<int32_t>(mPosition.z), static_cast<int32_t>(mPosition.x + r.x),
-							 static_cast<int32_t>(mPosition.z + r.y),
-							 Pix::Colors::GREEN);
+			decals.line(mPosition, mPosition + glm::vec3(r.x, 0, r.y), 1, Pix::Colors::GREEN);
 		}
 
 
@@ -135,8 +131,8 @@ namespace Pix {
 		glm::vec3 backWheel = mPosition - offset;
 
 		if (debug) {
-			canvas->fillCircle(static_cast<int32_t>(frontWheel.x), static_cast<int32_t>(frontWheel.z), 2, Pix::Colors::RED);
-			canvas->fillCircle(static_cast<int32_t>(backWheel.x), static_cast<int32_t>(backWheel.z), 2, Pix::Colors::GREEN);
+			decals.stamp(frontWheel, 2, Pix::Colors::RED);
+			decals.stamp(backWheel, 2, Pix::Colors::GREEN);
 		}
 
 		/**
@@ -152,8 +148,8 @@ namespace Pix {
 		backWheel += modSpeed * fElapsedTime * headingBack;
 		frontWheel += modSpeed * fElapsedTime * headingFront;
 		if (debug) {
-			canvas->fillCircle(static_cast<int32_t>(frontWheel.x), static_cast<int32_t>(frontWheel.z), 2, Pix::Colors::BLACK);
-			canvas->fillCircle(static_cast<int32_t>(backWheel.x), static_cast<int32_t>(backWheel.z), 2, Pix::Colors::GREY);
+			decals.stamp(frontWheel, 2, Pix::Colors::BLACK);
+			decals.stamp(backWheel, 2, Pix::Colors::GREY);
 		}
 		/*
 		The new car position can be calculated by averaging the two new wheel positions.
@@ -162,7 +158,7 @@ namespace Pix {
 		mPosition = (frontWheel + backWheel) / 2.0F;
 
 		if (debug) {
-			canvas->fillCircle(static_cast<int32_t>(mPosition.x), static_cast<int32_t>(mPosition.z), 2, Pix::Colors::BLUE);
+			decals.stamp(mPosition, 2, Pix::Colors::BLUE);
 		}
 
 		/*
@@ -47,11 +47,16 @@ namespace Pix {
 	constexpr int HEIGHT_EDGE_FLYOVER = 100;
 
 	BallWorld::BallWorld(const std::string &levelName, WorldConfig_t &config) :
-			World(config) {
+			World(config),
+			pBalls(new ObjectPool<BallObject>()) {
 		vObjects.clear();
 		load(levelName);
 	}
 
+	BallWorld::~BallWorld() {
+		delete pBalls;
+	}
+
 	void BallWorld::load(const std::string &levelName) {
 
 		if (pMap != nullptr)
@@ -107,6 +112,7 @@ namespace Pix {
 
 		// Displace Target Ball away from collision
 		target->mPosition += (1.0F - K) * displacement;
+		target->moved();
 
 		if (DBG)
 			LogV(TAG, SF("after displacement %f", ball->intersectsAmount(target, false)));
@@ -160,11 +166,17 @@ namespace Pix {
 	}
 
 	WorldObject *BallWorld::add(ObjectProperties_t &features, ObjectLocation_t location, bool setHeight) {
-		auto *ball = new BallObject(this, features, location);
+		auto *ball = pBalls->create(this, features, location);
 		World::add(ball, setHeight);
 		return ball;
 	}
 
+	void BallWorld::dispose(WorldObject *object) {
+		auto *ball = dynamic_cast<BallObject *>(object);
+		if (ball != nullptr && pBalls->owns(ball)) pBalls->destroy(ball);
+		else World::dispose(object);
+	}
+
 	long BallWorld::processCollisions(float fElapsedTime) {
 
 		const long crono = nowns();
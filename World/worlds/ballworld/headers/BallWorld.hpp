@@ -20,6 +20,8 @@ namespace Pix {
 
 	class Ball;
 
+	class BallObject;
+
 	class BallWorld : public World {
 
 		inline const static std::string TAG = "BallWorld";
@@ -32,6 +34,9 @@ namespace Pix {
 		std::vector<std::pair<Ball *, Ball *>> vCollidingPairs;
 		std::vector<std::pair<Ball *, Ball *>> vFutureColliders;
 
+		/** The balls created by the world */
+		ObjectPool<BallObject> *pBalls = nullptr;
+
 		/**
 		 * Add Balls to the world
 		 */
@@ -59,6 +64,9 @@ namespace Pix {
 
 		WorldObject *add(int oid, bool setHeight = true) override;
 
+		/** Frees a removed ball */
+		void dispose(WorldObject *object) override;
+
 		/**
 		 * Processes ball updates and collisions.
 		 */
@@ -75,6 +83,8 @@ namespace Pix {
 
 		BallWorld(const std::string &levelName, WorldConfig_t &config);
 
+		~BallWorld() override;
+
 		virtual void tick(Pix::Fu *engine, float fElapsedTime) override;
 
 		void load(const std::string& levelName);
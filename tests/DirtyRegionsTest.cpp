@@ -0,0 +1,97 @@
+//
+//  DirtyRegionsTest.cpp
+//  PixFu Engine
+//
+//  Random rectangles are added to a DirtyRegions and to a reference bitmap.
+//  The pending rectangles must stay few and disjoint, and taking them under
+//  random budgets must hand out every modified pixel exactly once, clipped to
+//  the buffer.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "DirtyRegions.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace Pix;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, int round) {
+	if (condition) return;
+	if (failures++ < 20) fprintf(stderr, "round %d: %s\n", round, what);
+}
+
+int main() {
+
+	constexpr int WIDTH = 200, HEIGHT = 150, ROUNDS = 2000;
+
+	std::mt19937 random(1234);
+	auto next = [&random](int n) { return static_cast<int>(random() % n); };
+
+	for (int round = 0; round < ROUNDS; round++) {
+
+		DirtyRegions regions(WIDTH, HEIGHT);
+		std::vector<char> modified(WIDTH * HEIGHT, 0);
+
+		// some rectangles stick out of the buffer
+		for (int i = 0, l = next(60); i < l; i++) {
+			const int x = next(WIDTH + 20) - 10, y = next(HEIGHT + 20) - 10, w = next(30), h = next(30);
+			regions.add(x, y, x + w, y + h);
+			for (int py = std::max(y, 0); py < std::min(y + h, HEIGHT); py++)
+				for (int px = std::max(x, 0); px < std::min(x + w, WIDTH); px++)
+					modified[py * WIDTH + px] = 1;
+		}
+
+		const std::vector<DirtyRect_t> &rects = regions.rects();
+
+		check(rects.size() <= 32, "too many rectangles", round);
+
+		for (size_t a = 0; a < rects.size(); a++) {
+			const DirtyRect_t &r = rects[a];
+			check(r.x0 >= 0 && r.y0 >= 0 && r.x1 <= WIDTH && r.y1 <= HEIGHT, "not clipped", round);
+			check(r.x0 < r.x1 && r.y0 < r.y1, "empty rectangle", round);
+			for (size_t b = a + 1; b < rects.size(); b++) {
+				const DirtyRect_t &o = rects[b];
+				check(r.x1 <= o.x0 || o.x1 <= r.x0 || r.y1 <= o.y0 || o.y1 <= r.y0, "overlapping rectangles", round);
+			}
+		}
+
+		std::vector<int> taken(WIDTH * HEIGHT, 0);
+		std::vector<DirtyRect_t> out;
+
+		while (!regions.empty()) {
+
+			const size_t budget = 1 + next(5000);
+			out.clear();
+			const size_t bytes = regions.take(budget, sizeof(uint32_t), out);
+
+			size_t area = 0, widest = 0;
+			for (const DirtyRect_t &r : out) {
+				area += r.area();
+				widest = std::max(widest, static_cast<size_t>(r.width()));
+				for (int py = r.y0; py < r.y1; py++)
+					for (int px = r.x0; px < r.x1; px++)
+						taken[py * WIDTH + px]++;
+			}
+
+			check(bytes > 0, "no progress", round);
+			check(bytes == area * sizeof(uint32_t), "bytes do not match the rectangles", round);
+			// over budget only to take a single row
+			check(bytes <= budget || (out.size() == 1 && out[0].height() == 1), "over budget", round);
+		}
+
+		for (int i = 0; i < WIDTH * HEIGHT; i++) {
+			check(!modified[i] || taken[i] > 0, "modified pixel not taken", round);
+			check(taken[i] <= 1, "pixel taken twice", round);
+		}
+	}
+
+	printf("DirtyRegions: %d rounds, %d failures\n", ROUNDS, failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+//
+//  OcclusionBufferTest.cpp
+//  PixFu Engine
+//
+//  Random triangles are rasterized into an OcclusionBuffer and, one pixel at
+//  a time, into a scalar reference: both must hold the same depths, except
+//  for pixel centers that fall on a triangle edge. Then random boxes are
+//  tested against the hi-Z, and a box reported as occluded must be behind the
+//  occluders in every pixel it covers.
+//
+//  Copyright © 2020 rodo. All rights reserved.
+//
+
+#include "OcclusionBuffer.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace Pix;
+
+static constexpr int WIDTH = 101, HEIGHT = 57;
+
+static constexpr float NEAR = 0.005F;
+
+/** Barycentric coordinates closer than this to an edge do not say which side the pixel center is */
+static constexpr float EDGE = 1e-4F;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+	if (condition) return;
+	if (failures++ < 20) fprintf(stderr, "%s\n", what);
+}
+
+static glm::vec3 screen(const glm::vec4 &clip) {
+	return {(clip.x / clip.w * 0.5F + 0.5F) * WIDTH, (clip.y / clip.w * 0.5F + 0.5F) * HEIGHT, 1.0F / clip.w};
+}
+
+/** The reference: every pixel center tested against the triangle, the nearest 1 / w kept */
+static void reference(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+					  std::vector<float> &depth, std::vector<char> &edge) {
+
+	const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	if (!(fabsf(area) > 1e-6F)) return;
+
+	for (int y = 0; y < HEIGHT; y++)
+		for (int x = 0; x < WIDTH; x++) {
+			const float px = x + 0.5F, py = y + 0.5F;
+			const float w0 = ((b.x - px) * (c.y - py) - (c.x - px) * (b.y - py)) / area;
+			const float w1 = ((c.x - px) * (a.y - py) - (a.x - px) * (c.y - py)) / area;
+			const float w2 = 1.0F - w0 - w1;
+			const float nearest = std::min(std::min(w0, w1), w2);
+			if (fabsf(nearest) < EDGE) edge[y * WIDTH + x] = 1;
+			if (nearest >= 0)
+				depth[y * WIDTH + x] = std::max(depth[y * WIDTH + x], w0 * a.z + w1 * b.z + w2 * c.z);
+		}
+}
+
+int main() {
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> unit(-1, 1);
+
+	const glm::mat4 projection = glm::perspective(1.2F, (float) WIDTH / HEIGHT, NEAR, 1000.0F);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0, 0.2F, 0), glm::vec3(0, 0.1F, -1), glm::vec3(0, 1, 0));
+	const glm::mat4 viewProjection = projection * view;
+
+	OcclusionBuffer buffer(WIDTH, HEIGHT);
+	buffer.begin(viewProjection, NEAR);
+
+	std::vector<float> depth(WIDTH * HEIGHT, 0.0F);
+	std::vector<char> edge(WIDTH * HEIGHT, 0);
+
+	// triangles in front of the near plane, the reference does not clip
+	for (int i = 0; i < 300; i++) {
+
+		const glm::vec3 a(unit(random) * 3, unit(random), -1.5F + unit(random) * 1.4F);
+		const glm::vec3 b = a + glm::vec3(unit(random), unit(random), unit(random)) * 0.8F;
+		const glm::vec3 c = a + glm::vec3(unit(random), unit(random), unit(random)) * 0.8F;
+
+		const glm::vec4 ca = viewProjection * glm::vec4(a, 1.0F);
+		const glm::vec4 cb = viewProjection * glm::vec4(b, 1.0F);
+		const glm::vec4 cc = viewProjection * glm::vec4(c, 1.0F);
+
+		if (ca.w < NEAR || cb.w < NEAR || cc.w < NEAR) continue;
+
+		buffer.addTriangle(a, b, c);
+		reference(screen(ca), screen(cb), screen(cc), depth, edge);
+	}
+
+	check(buffer.triangles() > 0, "nothing rasterized");
+
+	int compared = 0;
+	for (int y = 0; y < HEIGHT; y++)
+		for (int x = 0; x < WIDTH; x++) {
+			if (edge[y * WIDTH + x]) continue;
+			const float expected = depth[y * WIDTH + x];
+			check(fabsf(buffer.depth(x, y) - expected) <= 1e-3F * std::max(1.0F, expected), "depth differs from the reference");
+			compared++;
+		}
+
+	buffer.finish();
+
+	// boxes behind, inside and in front of the occluders
+	int hidden = 0;
+	for (int i = 0; i < 5000; i++) {
+
+		const glm::vec3 center(unit(random) * 3, unit(random), -3 + unit(random) * 2.5F);
+		const float r = 0.02F + 0.1F * (unit(random) + 1);
+		const glm::vec3 min = center - glm::vec3(r), max = center + glm::vec3(r);
+
+		if (buffer.visible(min, max)) continue;
+
+		hidden++;
+
+		float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, nearest = 0;
+		for (int k = 0; k < 8; k++) {
+			const glm::vec4 clip = viewProjection * glm::vec4(k & 1 ? max.x : min.x, k & 2 ? max.y : min.y,
+															  k & 4 ? max.z : min.z, 1.0F);
+			check(clip.w >= NEAR, "box reaching the eye reported occluded");
+			const glm::vec3 p = screen(clip);
+			minX = std::min(minX, p.x);
+			maxX = std::max(maxX, p.x);
+			minY = std::min(minY, p.y);
+			maxY = std::max(maxY, p.y);
+			nearest = std::max(nearest, p.z);
+		}
+
+		bool behind = true;
+		for (int y = std::max(0, (int) minY); y <= std::min(HEIGHT - 1, (int) maxY); y++)
+			for (int x = std::max(0, (int) minX); x <= std::min(WIDTH - 1, (int) maxX); x++)
+				behind = behind && buffer.depth(x, y) > nearest;
+
+		check(behind, "visible box reported occluded");
+	}
+
+	check(hidden > 0, "no box occluded, the test proves nothing");
+
+	printf("OcclusionBuffer: %d triangles, %d pixels compared, %d of 5000 boxes occluded, %d failures\n",
+		   buffer.triangles(), compared, hidden, failures);
+
+	return failures == 0 ? 0 : 1;
+}